@@ -12,6 +12,7 @@
 #include <google/protobuf/descriptor.pb.h>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <stdlib.h>
 
 using namespace std;
@@ -63,6 +64,12 @@ protected:
     return true;
   }
 
+  // --c_opt=codegen / --corpc_opt=codegen, the two must match
+  bool codegen() const
+  {
+    return opts.find("codegen") != opts.end();
+  }
+
 
 
 
@@ -127,6 +134,19 @@ protected:
     return has_suffix(fname, ".protodevel") ? strip_suffix(fname, ".protodevel") : strip_suffix(fname, ".proto");
   }
 
+  // CRC-32C, must match corpc_method_id()
+  static uint32_t crc32c(const string & s)
+  {
+    uint32_t crc = 0xFFFFFFFF;
+    for ( size_t i = 0; i < s.size(); ++i ) {
+      crc ^= (uint8_t) s[i];
+      for ( int k = 0; k < 8; ++k ) {
+        crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+      }
+    }
+    return ~crc;
+  }
+
   static string t2s(int x)
   {
     char s[16] = "";
@@ -395,6 +415,10 @@ public:
         "\n"
         "#include <cuttle/pb/pb.h>\n");
 
+    if ( codegen() ) {
+      printer->Print("#include <cuttle/pb/codegen.h>\n");
+    }
+
 
     for ( int i = 0; i < file->dependency_count(); i++ ) {
       vars["dep"] = pb_h_filename(file->dependency(i));
@@ -710,7 +734,35 @@ public:
     printer->Print(vars,
         "size_t cf_pb_pack_$class_name$(const struct $class_name$ * obj,void ** buf);\n");
     printer->Print(vars,
-        "bool cf_pb_unpack_$class_name$(struct $class_name$ * obj,const void * buf, size_t size);\n\n");
+        "bool cf_pb_unpack_$class_name$(struct $class_name$ * obj,const void * buf, size_t size);\n");
+    printer->Print(vars,
+        "bool cf_pb_unpack_reuse_$class_name$(struct $class_name$ * obj,const void * buf, size_t size);\n");
+    printer->Print(vars,
+        "bool cf_pb_unpack_arena_$class_name$(struct $class_name$ * obj,const void * buf, size_t size, cf_arena * arena);\n");
+    printer->Print(vars,
+        "bool cf_pb_unpack_views_$class_name$(struct $class_name$ * obj, void * buf, size_t size, cf_arena * arena);\n");
+    printer->Print(vars,
+        "void cf_pb_reset_$class_name$(struct $class_name$ * obj);\n");
+    printer->Print(vars,
+        "void cf_pb_cleanup_$class_name$(struct $class_name$ * obj);\n\n");
+
+    for ( int i = 0, n = type->field_count(); i < n; ++i ) {
+      if ( lazy(field = type->field(i)) ) {
+        vars["name"] = field_name(field);
+        vars["rtype"] = field->is_repeated() ? "ccarray_t" : cfctype(field);
+        printer->Print(vars,
+            "$rtype$ * cf_pb_get_$class_name$_$name$(struct $class_name$ * obj); /* decodes lazy field */\n");
+        printer->Print(vars,
+            "void cf_pb_set_$class_name$_$name$(struct $class_name$ * obj, $rtype$ * value); /* takes malloc()'ed value */\n");
+      }
+    }
+
+    if ( codegen() ) {
+      printer->Print(vars,
+          "bool cf_pb_write_$class_name$(cf_pb_wbuf * w, const struct $class_name$ * obj);\n");
+      printer->Print(vars,
+          "bool cf_pb_read_$class_name$(cf_pb_rbuf * r, struct $class_name$ * obj);\n\n");
+    }
 
 
     printer->Print("\n\n");
@@ -725,7 +777,12 @@ public:
     vars["field_name"] = field_name(field);
     vars["field_type"] = cfctype(field);
 
-    if ( field->label() == FieldDescriptor::LABEL_REPEATED ) {
+    if ( lazy(field) ) {
+      printer->Print(vars, field->is_repeated() ?
+          "cf_pb_lazy $field_name$; /* lazy ccarray_t <$field_type$> */\n" :
+          "cf_pb_lazy $field_name$; /* lazy <$field_type$> */\n");
+    }
+    else if ( field->label() == FieldDescriptor::LABEL_REPEATED ) {
       printer->Print(vars, "ccarray_t $field_name$; /* <$field_type$> */\n");
     }
     else if ( field->type() == FieldDescriptor::TYPE_BYTES ) {
@@ -736,6 +793,12 @@ public:
     }
   }
 
+  // [lazy = true] field kept encoded until accessed, see cf_pb_lazy
+  bool lazy(const FieldDescriptor * field)
+  {
+    return field->options().lazy() && !field->containing_oneof();
+  }
+
   void generate_struct_has_member(const FieldDescriptor * field, Printer * printer)
   {
     if ( field->label() == FieldDescriptor::LABEL_OPTIONAL && !field->containing_oneof() ) {
@@ -766,6 +829,21 @@ public:
 
     vars["class_name"] = full_name(type);
 
+    // field indexes sorted by tag for the decoder to look up out-of-order tags
+    if ( (n = type->field_count()) > 0 ) {
+      vector<pair<int, int> > order;
+      for ( i = 0; i < n; ++i ) {
+        order.push_back(make_pair(type->field(i)->number(), i));
+      }
+      sort(order.begin(), order.end());
+
+      printer->Print(vars, "static const uint16_t $class_name$_tag_order[] = {");
+      for ( i = 0; i < n; ++i ) {
+        printer->Print(i ? ", $index$" : "$index$", "index", t2s(order[i].second));
+      }
+      printer->Print("};\n\n");
+    }
+
     printer->Print(vars, "const cf_pb_field_t $class_name$_fields[] = {\n");
     printer->Indent();
 
@@ -777,6 +855,7 @@ public:
       vars["pbtype"] = cfpbtype(field);
       vars["ctype"] = cfctype(field);
       vars["ptr"] = cfdescptr(field);
+      vars["lazy"] = lazy(field) ? "|CF_PB_LAZY" : "";
 
       if ( field->containing_oneof() ) {
         // CF_PB_ONEOF_FIELD
@@ -786,33 +865,524 @@ public:
       }
       else if ( field->label() == FieldDescriptor::LABEL_REPEATED ) {
         printer->Print(vars,
-            "CF_PB_REQUIRED_FIELD($class_name$,\t$tag$,\tCF_PB_$pbtype$,\tCF_PB_ARRAY ,\t$name$,\t$ctype$,\t$ptr$),\n");
+            "CF_PB_REQUIRED_FIELD($class_name$,\t$tag$,\tCF_PB_$pbtype$,\tCF_PB_ARRAY$lazy$ ,\t$name$,\t$ctype$,\t$ptr$),\n");
       }
       else if ( field->label() == FieldDescriptor::LABEL_REQUIRED ) {
         printer->Print(vars,
-            "CF_PB_REQUIRED_FIELD($class_name$,\t$tag$,\tCF_PB_$pbtype$,\tCF_PB_SCALAR, $name$, $ctype$, $ptr$),\n");
+            "CF_PB_REQUIRED_FIELD($class_name$,\t$tag$,\tCF_PB_$pbtype$,\tCF_PB_SCALAR$lazy$, $name$, $ctype$, $ptr$),\n");
       }
       else {
         printer->Print(vars,
-            "CF_PB_OPTIONAL_FIELD($class_name$,\t$tag$,\tCF_PB_$pbtype$,\tCF_PB_SCALAR, $name$, $ctype$, $ptr$),\n");
+            "CF_PB_OPTIONAL_FIELD($class_name$,\t$tag$,\tCF_PB_$pbtype$,\tCF_PB_SCALAR$lazy$, $name$, $ctype$, $ptr$),\n");
       }
     }
 
-    printer->Print("CF_PB_LAST_FIELD\n");
+    if ( type->field_count() > 0 ) {
+      printer->Print(vars, "CF_PB_LAST_FIELD_INDEXED($class_name$_tag_order)\n");
+    }
+    else {
+      printer->Print("CF_PB_LAST_FIELD\n");
+    }
     printer->Outdent();
     printer->Print(vars, "};\n\n");
 
+    printer->Print(vars,
+        "void cf_pb_reset_$class_name$(struct $class_name$ * obj) {\n"
+        "  cf_pb_reset($class_name$_fields, obj);\n"
+        "}\n\n");
 
     printer->Print(vars,
-        "size_t cf_pb_pack_$class_name$(const struct $class_name$ * obj, void ** buf) {\n"
-        "  return cf_pb_pack(obj, $class_name$_fields, buf);\n"
+        "void cf_pb_cleanup_$class_name$(struct $class_name$ * obj) {\n"
+        "  cf_pb_cleanup($class_name$_fields, obj);\n"
         "}\n\n");
 
+    for ( i = 0, n = type->field_count(); i < n; ++i ) {
+      if ( lazy(field = type->field(i)) ) {
+        vars["name"] = field_name(field);
+        vars["index"] = t2s(i);
+        vars["rtype"] = field->is_repeated() ? "ccarray_t" : cfctype(field);
+        printer->Print(vars,
+            "$rtype$ * cf_pb_get_$class_name$_$name$(struct $class_name$ * obj) {\n"
+            "  return cf_pb_lazy_value(&$class_name$_fields[$index$], &obj->$name$);\n"
+            "}\n\n");
+        printer->Print(vars,
+            "void cf_pb_set_$class_name$_$name$(struct $class_name$ * obj, $rtype$ * value) {\n"
+            "  cf_pb_lazy_set(&$class_name$_fields[$index$], &obj->$name$, value);\n");
+        if ( !field->is_repeated() && field->label() == FieldDescriptor::LABEL_OPTIONAL ) {
+          printer->Print(vars,
+              "  obj->has_$name$ = value != NULL;\n");
+        }
+        printer->Print("}\n\n");
+      }
+    }
+
+
+    if ( !codegen() ) {
+
+      printer->Print(vars,
+          "size_t cf_pb_pack_$class_name$(const struct $class_name$ * obj, void ** buf) {\n"
+          "  return cf_pb_pack(obj, $class_name$_fields, buf);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_$class_name$(struct $class_name$ * obj, const void * buf, size_t size) {\n"
+          "  return cf_pb_unpack(buf, size, $class_name$_fields, obj);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_reuse_$class_name$(struct $class_name$ * obj, const void * buf, size_t size) {\n"
+          "  return cf_pb_unpack_reuse(buf, size, $class_name$_fields, obj);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_arena_$class_name$(struct $class_name$ * obj, const void * buf, size_t size, cf_arena * arena) {\n"
+          "  return cf_pb_unpack_arena(buf, size, $class_name$_fields, obj, arena);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_views_$class_name$(struct $class_name$ * obj, void * buf, size_t size, cf_arena * arena) {\n"
+          "  return cf_pb_unpack_views(buf, size, $class_name$_fields, obj, arena);\n"
+          "}\n\n\n");
+    }
+    else {
+
+      generate_writer(type, printer);
+      generate_reader(type, printer);
+
+      printer->Print(vars,
+          "size_t cf_pb_pack_$class_name$(const struct $class_name$ * obj, void ** buf) {\n"
+          "  cf_pb_wbuf w = CF_PB_WBUF_INITIALIZER;\n"
+          "  if ( !cf_pb_write_$class_name$(&w, obj) ) {\n"
+          "    cf_pb_wbuf_cleanup(&w);\n"
+          "    *buf = NULL;\n"
+          "    return 0;\n"
+          "  }\n"
+          "  return cf_pb_wbuf_detach(&w, buf);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_$class_name$(struct $class_name$ * obj, const void * buf, size_t size) {\n"
+          "  cf_pb_rbuf r = { buf, (const uint8_t *) buf + size, NULL, NULL, false };\n"
+          "  return cf_pb_read_$class_name$(&r, obj);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_reuse_$class_name$(struct $class_name$ * obj, const void * buf, size_t size) {\n"
+          "  cf_pb_rbuf r = { buf, (const uint8_t *) buf + size, NULL, NULL, true };\n"
+          "  return cf_pb_read_$class_name$(&r, obj);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_arena_$class_name$(struct $class_name$ * obj, const void * buf, size_t size, cf_arena * arena) {\n"
+          "  cf_pb_rbuf r = { buf, (const uint8_t *) buf + size, arena, NULL, false };\n"
+          "  return cf_pb_read_$class_name$(&r, obj);\n"
+          "}\n\n");
+
+      printer->Print(vars,
+          "bool cf_pb_unpack_views_$class_name$(struct $class_name$ * obj, void * buf, size_t size, cf_arena * arena) {\n"
+          "  cf_pb_views views = { (const uint8_t *) buf + size, NULL };\n"
+          "  cf_pb_rbuf r = { buf, (const uint8_t *) buf + size, arena, &views, false };\n"
+          "  return arena && cf_pb_read_$class_name$(&r, obj);\n"
+          "}\n\n\n");
+    }
+  }
+
+
+  /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Type-specialized encoders and decoders, --c_opt=codegen.
+  //  The tables are still emitted for generic code, the specialized functions replace them in pack/unpack.
+  //  Messages of imported files must be generated with the same option.
+
+  // lvalue of the field member in obj
+  string member(const FieldDescriptor * field)
+  {
+    if ( field->containing_oneof() ) {
+      return "obj->" + name(field->containing_oneof()) + "." + field_name(field);
+    }
+    return "obj->" + field_name(field);
+  }
+
+  string item_ctype(const FieldDescriptor * field)
+  {
+    return field->type() == FieldDescriptor::TYPE_BYTES ? "cf_membuf" : cfctype(field);
+  }
+
+  string wire_type(const FieldDescriptor * field)
+  {
+    switch ( field->type() ) {
+    case FieldDescriptor::TYPE_FIXED32 :
+    case FieldDescriptor::TYPE_SFIXED32 :
+    case FieldDescriptor::TYPE_FLOAT :
+      return "PB_WT_32BIT";
+    case FieldDescriptor::TYPE_FIXED64 :
+    case FieldDescriptor::TYPE_SFIXED64 :
+    case FieldDescriptor::TYPE_DOUBLE :
+      return "PB_WT_64BIT";
+    case FieldDescriptor::TYPE_STRING :
+    case FieldDescriptor::TYPE_BYTES :
+    case FieldDescriptor::TYPE_GROUP :
+    case FieldDescriptor::TYPE_MESSAGE :
+      return "PB_WT_STRING";
+    default :
+      break;
+    }
+    return "PB_WT_VARINT";
+  }
+
+  // must match cf_pb_type_packable()
+  bool packable(const FieldDescriptor * field)
+  {
+    switch ( field->type() ) {
+    case FieldDescriptor::TYPE_FIXED32 :
+    case FieldDescriptor::TYPE_SFIXED32 :
+    case FieldDescriptor::TYPE_FIXED64 :
+    case FieldDescriptor::TYPE_SFIXED64 :
+    case FieldDescriptor::TYPE_INT32 :
+    case FieldDescriptor::TYPE_SINT32 :
+    case FieldDescriptor::TYPE_UINT32 :
+    case FieldDescriptor::TYPE_INT64 :
+    case FieldDescriptor::TYPE_SINT64 :
+    case FieldDescriptor::TYPE_UINT64 :
+      return true;
+    default :
+      break;
+    }
+    return false;
+  }
+
+  // condition writing the value at address pv in front of w
+  string put_value(const FieldDescriptor * field, const string & pv)
+  {
+    switch ( field->type() ) {
+    case FieldDescriptor::TYPE_INT32 :
+    case FieldDescriptor::TYPE_SINT32 :
+    case FieldDescriptor::TYPE_INT64 :
+    case FieldDescriptor::TYPE_SINT64 :
+      return "cf_pb_put_svarint(w, *" + pv + ")";
+    case FieldDescriptor::TYPE_UINT32 :
+    case FieldDescriptor::TYPE_UINT64 :
+    case FieldDescriptor::TYPE_BOOL :
+      return "cf_pb_put_varint(w, *" + pv + ")";
+    case FieldDescriptor::TYPE_ENUM :
+      return "cf_pb_put_varint(w, (uint64_t) (int64_t) *" + pv + ")";
+    case FieldDescriptor::TYPE_FIXED32 :
+    case FieldDescriptor::TYPE_SFIXED32 :
+    case FieldDescriptor::TYPE_FLOAT :
+      return "cf_pb_put_fixed32(w, " + pv + ")";
+    case FieldDescriptor::TYPE_FIXED64 :
+    case FieldDescriptor::TYPE_SFIXED64 :
+    case FieldDescriptor::TYPE_DOUBLE :
+      return "cf_pb_put_fixed64(w, " + pv + ")";
+    case FieldDescriptor::TYPE_STRING :
+      return "cf_pb_put_string(w, *" + pv + ")";
+    case FieldDescriptor::TYPE_BYTES :
+      return "cf_pb_put_bytes(w, (" + pv + ")->data, (" + pv + ")->size)";
+    default :
+      break;
+    }
+    return "BUG-HERE";
+  }
+
+  // condition reading the value from rb (cf_pb_rbuf *) to address pv
+  string get_value(const FieldDescriptor * field, const string & rb, const string & pv)
+  {
+    switch ( field->type() ) {
+    case FieldDescriptor::TYPE_INT32 :
+    case FieldDescriptor::TYPE_SINT32 :
+      return "cf_pb_get_int32(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_INT64 :
+    case FieldDescriptor::TYPE_SINT64 :
+      return "cf_pb_get_int64(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_UINT32 :
+      return "cf_pb_get_uint32(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_UINT64 :
+      return "cf_pb_get_uint64(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_BOOL :
+      return "cf_pb_get_bool(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_ENUM :
+      return "cf_pb_get_enum(" + rb + ", (int *) " + pv + ")";
+    case FieldDescriptor::TYPE_FIXED32 :
+    case FieldDescriptor::TYPE_SFIXED32 :
+    case FieldDescriptor::TYPE_FLOAT :
+      return "cf_pb_get_fixed32(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_FIXED64 :
+    case FieldDescriptor::TYPE_SFIXED64 :
+    case FieldDescriptor::TYPE_DOUBLE :
+      return "cf_pb_get_fixed64(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_STRING :
+      return "cf_pb_get_string(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_BYTES :
+      return "cf_pb_get_bytes(" + rb + ", " + pv + ")";
+    case FieldDescriptor::TYPE_GROUP :
+    case FieldDescriptor::TYPE_MESSAGE :
+      return "cf_pb_get_sub(" + rb + ", &sub) && cf_pb_read_" + full_name(field->message_type()) + "(&sub, " + pv + ")";
+    default :
+      break;
+    }
+    return "BUG-HERE";
+  }
+
+  bool is_message(const FieldDescriptor * field)
+  {
+    return field->type() == FieldDescriptor::TYPE_MESSAGE || field->type() == FieldDescriptor::TYPE_GROUP;
+  }
+
+
+  /* Fields and repeated items are written in reverse order back to front,
+   * which leaves the bytes in the same order as cf_pb_encode() writes them */
+  void generate_writer(const Descriptor * type, Printer * printer)
+  {
+    map<string, string> vars;
+    const FieldDescriptor * field;
+
+    vars["class_name"] = full_name(type);
+
     printer->Print(vars,
-        "bool cf_pb_unpack_$class_name$(struct $class_name$ * obj, const void * buf, size_t size) {\n"
-        "  return cf_pb_unpack(buf, size, $class_name$_fields, obj);\n"
-        "}\n\n\n");
+        "bool cf_pb_write_$class_name$(cf_pb_wbuf * w, const struct $class_name$ * obj) {\n");
+    printer->Indent();
+    printer->Print("size_t end;\n"
+        "(void) end;\n\n");
+
+    for ( int i = type->field_count() - 1; i >= 0; --i ) {
+
+      field = type->field(i);
+
+      vars["name"] = field_name(field);
+      vars["member"] = member(field);
+      vars["tag"] = t2s(field->number());
+      vars["wt"] = wire_type(field);
+      vars["ctype"] = item_ctype(field);
+      vars["put"] = put_value(field, field->is_repeated() ? "v" : "&" + member(field));
 
+      if ( is_message(field) ) {
+        vars["msgtype"] = full_name(field->message_type());
+      }
+
+      printer->Print(vars, "// $name$\n");
+
+      if ( lazy(field) ) {
+        vars["index"] = t2s(i);
+        vars["has"] = !field->is_repeated() && field->label() == FieldDescriptor::LABEL_OPTIONAL ?
+            "obj->has_" + field_name(field) + " && " : "";
+        printer->Print(vars,
+            "if ( $has$!cf_pb_put_lazy(w, &$class_name$_fields[$index$], &$member$) ) {\n"
+            "  return false;\n"
+            "}\n\n");
+        continue;
+      }
+
+      if ( field->is_repeated() ) {
+
+        if ( packable(field) ) {
+          printer->Print(vars,
+              "if ( ccarray_size(&$member$) > 0 ) {\n"
+              "  end = cf_pb_wbuf_size(w);\n"
+              "  for ( size_t i = ccarray_size(&$member$); i-- > 0; ) {\n"
+              "    const $ctype$ * v = ccarray_peek(&$member$, i);\n"
+              "    if ( !$put$ ) {\n"
+              "      return false;\n"
+              "    }\n"
+              "  }\n"
+              "  if ( !cf_pb_put_varint(w, cf_pb_wbuf_size(w) - end) || !cf_pb_put_tag(w, PB_WT_STRING, $tag$) ) {\n"
+              "    return false;\n"
+              "  }\n"
+              "}\n\n");
+        }
+        else if ( is_message(field) ) {
+          printer->Print(vars,
+              "for ( size_t i = ccarray_size(&$member$); i-- > 0; ) {\n"
+              "  const $ctype$ * v = ccarray_peek(&$member$, i);\n"
+              "  end = cf_pb_wbuf_size(w);\n"
+              "  if ( !cf_pb_write_$msgtype$(w, v) || !cf_pb_put_varint(w, cf_pb_wbuf_size(w) - end)\n"
+              "      || !cf_pb_put_tag(w, PB_WT_STRING, $tag$) ) {\n"
+              "    return false;\n"
+              "  }\n"
+              "}\n\n");
+        }
+        else {
+          printer->Print(vars,
+              "for ( size_t i = ccarray_size(&$member$); i-- > 0; ) {\n"
+              "  const $ctype$ * v = ccarray_peek(&$member$, i);\n"
+              "  if ( !$put$ || !cf_pb_put_tag(w, $wt$, $tag$) ) {\n"
+              "    return false;\n"
+              "  }\n"
+              "}\n\n");
+        }
+        continue;
+      }
+
+      if ( field->containing_oneof() ) {
+        vars["oneof"] = name(field->containing_oneof());
+        printer->Print(vars, "if ( obj->$oneof$.tag == $tag$ ) {\n");
+      }
+      else if ( field->label() == FieldDescriptor::LABEL_OPTIONAL ) {
+        printer->Print(vars, "if ( obj->has_$name$ ) {\n");
+      }
+      else {
+        printer->Print("{\n");
+      }
+
+      if ( is_message(field) ) {
+        printer->Print(vars,
+            "  end = cf_pb_wbuf_size(w);\n"
+            "  if ( !cf_pb_write_$msgtype$(w, &$member$) || !cf_pb_put_varint(w, cf_pb_wbuf_size(w) - end)\n"
+            "      || !cf_pb_put_tag(w, PB_WT_STRING, $tag$) ) {\n"
+            "    return false;\n"
+            "  }\n"
+            "}\n\n");
+      }
+      else {
+        printer->Print(vars,
+            "  if ( !$put$ || !cf_pb_put_tag(w, $wt$, $tag$) ) {\n"
+            "    return false;\n"
+            "  }\n"
+            "}\n\n");
+      }
+    }
+
+    printer->Print("return true;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
+  }
+
+
+  void generate_reader(const Descriptor * type, Printer * printer)
+  {
+    map<string, string> vars;
+    const FieldDescriptor * field;
+
+    vars["class_name"] = full_name(type);
+
+    bool has_lazy = false;
+
+    for ( int i = 0, n = type->field_count(); i < n; ++i ) {
+      has_lazy = has_lazy || lazy(type->field(i));
+    }
+
+    printer->Print(vars,
+        "bool cf_pb_read_$class_name$(cf_pb_rbuf * r, struct $class_name$ * obj) {\n");
+    printer->Indent();
+    printer->Print(
+        "cf_pb_rbuf sub;\n"
+        "pb_wire_type_t wt;\n"
+        "uint32_t tag;\n"
+        "(void) sub;\n");
+    if ( has_lazy ) {
+      printer->Print("const uint8_t * start; // the field record kept by lazy fields\n");
+    }
+    printer->Print(
+        "\n"
+        "while ( r->ptr < r->end ) {\n"
+        "\n");
+    if ( has_lazy ) {
+      printer->Print("  start = r->ptr;\n");
+    }
+    printer->Print(
+        "  if ( !cf_pb_get_tag(r, &tag, &wt) ) {\n"
+        "    return false;\n"
+        "  }\n"
+        "\n"
+        "  switch ( tag ) {\n");
+    printer->Indent();
+    printer->Indent();
+
+    for ( int i = 0, n = type->field_count(); i < n; ++i ) {
+
+      field = type->field(i);
+
+      vars["name"] = field_name(field);
+      vars["member"] = member(field);
+      vars["tag"] = t2s(field->number());
+      vars["wt"] = wire_type(field);
+      vars["ctype"] = item_ctype(field);
+
+      printer->Print(vars, "case $tag$ : { // $name$\n");
+
+      if ( lazy(field) ) {
+        vars["index"] = t2s(i);
+        printer->Print(vars,
+            "  if ( !cf_pb_get_lazy(r, &$class_name$_fields[$index$], &$member$, start, wt) ) {\n"
+            "    return false;\n"
+            "  }\n");
+        if ( !field->is_repeated() && field->label() == FieldDescriptor::LABEL_OPTIONAL ) {
+          printer->Print(vars, "  obj->has_$name$ = true;\n");
+        }
+      }
+      else if ( field->is_repeated() ) {
+
+        vars["get"] = get_value(field, "r", "item");
+        printer->Print(vars, "  $ctype$ * item;\n");
+
+        if ( packable(field) ) {
+          vars["subget"] = get_value(field, "&sub", "item");
+          printer->Print(vars,
+              "  if ( wt == PB_WT_STRING ) {\n"
+              "    if ( !cf_pb_get_sub(r, &sub) ) {\n"
+              "      return false;\n"
+              "    }\n"
+              "    while ( sub.ptr < sub.end ) {\n"
+              "      if ( !(item = cf_pb_array_push(r, &$member$, sizeof(*item))) || !$subget$ ) {\n"
+              "        return false;\n"
+              "      }\n"
+              "    }\n"
+              "  }\n"
+              "  else if ( wt != $wt$ || !(item = cf_pb_array_push(r, &$member$, sizeof(*item))) || !$get$ ) {\n"
+              "    return false;\n"
+              "  }\n");
+        }
+        else {
+          printer->Print(vars,
+              "  if ( wt != $wt$ || !(item = cf_pb_array_push(r, &$member$, sizeof(*item))) || !($get$) ) {\n"
+              "    return false;\n"
+              "  }\n");
+        }
+      }
+      else {
+
+        vars["get"] = get_value(field, "r", "&" + member(field));
+
+        if ( field->containing_oneof() ) { // the union holds other member, its value is not reused
+          vars["oneof"] = name(field->containing_oneof());
+          printer->Print(vars,
+              "  if ( obj->$oneof$.tag != $tag$ ) {\n"
+              "    memset(&$member$, 0, sizeof($member$));\n"
+              "  }\n");
+        }
+
+        printer->Print(vars,
+            "  if ( wt != $wt$ || !($get$) ) {\n"
+            "    return false;\n"
+            "  }\n");
+
+        if ( field->containing_oneof() ) {
+          vars["oneof"] = name(field->containing_oneof());
+          printer->Print(vars, "  obj->$oneof$.tag = $tag$;\n");
+        }
+        else if ( field->label() == FieldDescriptor::LABEL_OPTIONAL ) {
+          printer->Print(vars, "  obj->has_$name$ = true;\n");
+        }
+      }
+
+      printer->Print("  break;\n"
+          "}\n\n");
+    }
+
+    printer->Print(
+        "default :\n"
+        "  if ( !cf_pb_skip_field(r, wt) ) {\n"
+        "    return false;\n"
+        "  }\n"
+        "  break;\n");
+
+    printer->Outdent();
+    printer->Outdent();
+    printer->Print(
+        "  }\n"
+        "}\n"
+        "\n"
+        "return true;\n");
+    printer->Outdent();
+    printer->Print("}\n\n");
   }
 
 
@@ -911,7 +1481,9 @@ public:
         "\n");
 
 
+    generate_service_declarations(file, printer);
     generate_sendrecv_declarations(file, printer);
+    generate_call_declarations(file, printer);
 
 
     printer->Print(vars,
@@ -945,6 +1517,7 @@ public:
 
 
     generate_sendrecv_definitions(file, printer);
+    generate_call_definitions(file, printer);
   }
 
 
@@ -954,6 +1527,40 @@ public:
 
 
 
+  void generate_service_declarations(const FileDescriptor * file, Printer * printer)
+  {
+    for ( int i = 0, n = file->service_count(); i < n; ++i ) {
+      generate_service_declaration(file->service(i), printer);
+      printer->Print("\n");
+    }
+  }
+
+  void generate_service_declaration(const ServiceDescriptor * service, Printer * printer)
+  {
+    smap vars;
+    char id[16];
+
+    vars["service"] = full_name(service);
+    vars["service_name"] = service->name();
+
+    printer->Print(vars,
+        "/* service $service_name$ */\n"
+        "#define $service$_service_name \"$service_name$\"\n");
+
+    for ( int i = 0, n = service->method_count(); i < n; ++i ) {
+      const MethodDescriptor * method = service->method(i);
+
+      snprintf(id, sizeof(id), "0x%08X", crc32c(service->name() + "/" + method->name()));
+
+      vars["method"] = method->name();
+      vars["method_id"] = id;
+
+      printer->Print(vars,
+          "#define $service$_$method$_method_name \"$method$\"\n"
+          "#define $service$_$method$_method_id   $method_id$u // corpc_method_id(\"$service_name$\", \"$method$\")\n");
+    }
+  }
+
   void generate_sendrecv_declarations(const FileDescriptor * file, Printer * printer)
   {
     for ( int i = 0, n = file->message_type_count(); i < n; ++i ) {
@@ -1000,30 +1607,119 @@ public:
 
     vars["type"] = full_name(type);
 
+    if ( !codegen() ) {
+      printer->Print(vars,
+          "bool corpc_stream_write_$type$(corpc_stream * st, const struct $type$ * obj)\n"
+          "{\n"
+          "  return corpc_stream_write_pb(st, $type$_fields, obj);\n"
+          "}\n"
+          "\n");
+    }
+    else {
+      printer->Print(vars,
+          "static bool corpc_write_$type$(cf_pb_wbuf * w, const void * obj)\n"
+          "{\n"
+          "  return cf_pb_write_$type$(w, obj);\n"
+          "}\n"
+          "\n"
+          "bool corpc_stream_write_$type$(corpc_stream * st, const struct $type$ * obj)\n"
+          "{\n"
+          "  return corpc_stream_write_wbuf(st, corpc_write_$type$, obj);\n"
+          "}\n"
+          "\n");
+    }
+
     printer->Print(vars,
-        "static size_t corpc_pack_$type$(const void * obj, void ** buf)\n"
+        "static bool corpc_unpack_$type$(void * obj, const void * buf, size_t size)\n"
         "{\n"
-        "  return cf_pb_pack_$type$(obj, buf);\n"
+        "  memset(obj, 0, sizeof(struct $type$));\n"
+        "  return cf_pb_unpack_$type$(obj, buf, size);\n"
         "}\n"
         "\n"
-        "bool corpc_stream_write_$type$(corpc_stream * st, const struct $type$ * obj)\n"
+        "bool corpc_stream_read_$type$(corpc_stream * st, struct $type$ * obj)\n"
         "{\n"
-        "  return corpc_stream_write_msg(st, corpc_pack_$type$, obj);\n"
+        "  return corpc_stream_read_msg(st, corpc_unpack_$type$, obj);\n"
         "}\n"
         "\n"
-        "static bool corpc_unpack_$type$(void * obj, const void * buf, size_t size)\n"
+        "\n"
+        );
+  }
+
+  void generate_call_declarations(const FileDescriptor * file, Printer * printer)
+  {
+    for ( int i = 0, n = file->service_count(); i < n; ++i ) {
+      const ServiceDescriptor * service = file->service(i);
+      for ( int j = 0, m = service->method_count(); j < m; ++j ) {
+        generate_call_declaration(service->method(j), printer);
+      }
+      printer->Print("\n");
+    }
+  }
+
+  void generate_call_declaration(const MethodDescriptor * method, Printer * printer)
+  {
+    smap vars;
+
+    vars["service"] = full_name(method->service());
+    vars["method"] = method->name();
+    vars["input_type"] = full_name(method->input_type());
+    vars["output_type"] = full_name(method->output_type());
+
+    printer->Print(vars,
+        "bool corpc_call_$service$_$method$(corpc_channel * channel,\n"
+        "    const struct $input_type$ * request,\n"
+        "    struct $output_type$ * responce,\n"
+        "    int tmo);\n\n"
+        );
+  }
+
+  void generate_call_definitions(const FileDescriptor * file, Printer * printer)
+  {
+    for ( int i = 0, n = file->service_count(); i < n; ++i ) {
+      const ServiceDescriptor * service = file->service(i);
+      for ( int j = 0, m = service->method_count(); j < m; ++j ) {
+        generate_call_definition(service->method(j), printer);
+      }
+    }
+  }
+
+  void generate_call_definition(const MethodDescriptor * method, Printer * printer)
+  {
+    smap vars;
+
+    vars["service"] = full_name(method->service());
+    vars["method"] = method->name();
+    vars["input_type"] = full_name(method->input_type());
+    vars["output_type"] = full_name(method->output_type());
+
+    // input and output types may come from other files, their corpc_pack_/corpc_unpack_ are not visible here
+    printer->Print(vars,
+        "static size_t corpc_call_pack_$service$_$method$(const void * obj, void ** buf)\n"
         "{\n"
-        "  return cf_pb_unpack_$type$(obj, buf, size);\n"
+        "  return cf_pb_pack_$input_type$(obj, buf);\n"
         "}\n"
         "\n"
-        "bool corpc_stream_read_$type$(corpc_stream * st, struct $type$ * obj)\n"
+        "static bool corpc_call_unpack_$service$_$method$(void * obj, const void * buf, size_t size)\n"
         "{\n"
-        "  return corpc_stream_read_msg(st, corpc_unpack_$type$, obj);\n"
+        "  memset(obj, 0, sizeof(struct $output_type$));\n"
+        "  return cf_pb_unpack_$output_type$(obj, buf, size);\n"
+        "}\n"
+        "\n"
+        "bool corpc_call_$service$_$method$(corpc_channel * channel,\n"
+        "    const struct $input_type$ * request,\n"
+        "    struct $output_type$ * responce,\n"
+        "    int tmo)\n"
+        "{\n"
+        "  return corpc_call(channel, $service$_service_name, $service$_$method$_method_name,\n"
+        "      corpc_call_pack_$service$_$method$, request,\n"
+        "      corpc_call_unpack_$service$_$method$, responce,\n"
+        "      tmo);\n"
         "}\n"
         "\n"
         "\n"
         );
   }
+
   /*
    *         "bool cf_pb_unpack_$class_name$(struct $class_name$ * obj, const void * buf, size_t size) {\n"
         "  return cf_pb_unpack(buf, size, $class_name$_fields, obj);\n"
@@ -0,0 +1,54 @@
+/*
+ * arena.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Bump allocator: many small allocations, released all at once
+ */
+
+//#pragma once
+
+#ifndef __cuttle_arena_h__
+#define __cuttle_arena_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+struct cf_arena
+  cf_arena;
+
+#define CF_ARENA_DEFAULT_BLOCK_SIZE (16*1024)
+
+/* block_size = 0 selects CF_ARENA_DEFAULT_BLOCK_SIZE */
+cf_arena * cf_arena_create(size_t block_size);
+
+/* Releases every allocation and the arena itself */
+void cf_arena_destroy(cf_arena ** arena);
+
+/* Releases every allocation but keeps the first block for reuse */
+void cf_arena_reset(cf_arena * arena);
+
+/* Memory is aligned for any type and is not zeroed */
+void * cf_arena_alloc(cf_arena * arena, size_t size);
+
+/* Grows in place when ptr is the latest allocation and the block has room,
+ * otherwise copies into new space; the old space is only released with the arena */
+void * cf_arena_realloc(cf_arena * arena, void * ptr, size_t old_size, size_t new_size);
+
+/* Total bytes handed out since create / last reset */
+size_t cf_arena_used(const cf_arena * arena);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cuttle_arena_h__ */
@@ -55,6 +55,42 @@ static inline void ccfifo_cleanup(ccfifo * q)
 }
 
 
+/* Change capacity preserving queued items, fails if capacity < size */
+static inline bool ccfifo_realloc(ccfifo * q, size_t capacity)
+{
+  void * items;
+  size_t n;
+
+  if ( capacity < q->size ) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if ( !(items = malloc(capacity * q->item_size)) ) {
+    return false;
+  }
+
+  if ( q->size ) {
+    if ( q->first < q->last ) {
+      memcpy(items, ccfifo_item(q, q->first), q->size * q->item_size);
+    }
+    else {
+      n = q->capacity - q->first;
+      memcpy(items, ccfifo_item(q, q->first), n * q->item_size);
+      memcpy((uint8_t*) items + n * q->item_size, q->items, q->last * q->item_size);
+    }
+  }
+
+  free(q->items);
+  q->items = items;
+  q->capacity = capacity;
+  q->first = 0;
+  q->last = q->size < capacity ? q->size : 0;
+
+  return true;
+}
+
+
 static inline void * ccfifo_push_bytes(ccfifo * q, const void * item, size_t size)
 {
   void * itempos = NULL;
@@ -0,0 +1,73 @@
+/*
+ * corpc/channel-pool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+//#pragma once
+
+#ifndef __cuttle_corpc_channel_pool_h__
+#define __cuttle_corpc_channel_pool_h__
+
+#include <cuttle/corpc/channel.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+struct corpc_channel_pool
+  corpc_channel_pool;
+
+
+typedef
+struct corpc_endpoint {
+  const char * address;
+  uint16_t port;
+} corpc_endpoint;
+
+
+typedef
+struct corpc_channel_pool_opts {
+
+  /* Backend addresses, terminated by the entry with NULL address */
+  const struct corpc_endpoint * endpoints;
+
+  /* Channels kept open to each endpoint, zero selects 1 */
+  int channels_per_endpoint;
+
+  /* Period of background reconnects of broken channels, zero selects 1000 ms */
+  int reconnect_interval_ms;
+
+  /* Template for every channel of the pool, connect_address and connect_port are ignored */
+  struct corpc_channel_open_args channel_args;
+
+} corpc_channel_pool_opts;
+
+
+/* Connects all channels once, those failed are retried in background.
+ * Must be called from co-thread */
+corpc_channel_pool * corpc_channel_pool_new(const struct corpc_channel_pool_opts * opts);
+void corpc_channel_pool_destroy(corpc_channel_pool ** pool);
+
+/* Established channel having the fewest outstanding streams over all endpoints.
+ * The channel is addref'ed, release it with corpc_channel_release().
+ * Returns NULL with ENOTCONN if no channel is established */
+corpc_channel * corpc_channel_pool_get(corpc_channel_pool * pool);
+
+corpc_stream * corpc_channel_pool_open_stream(corpc_channel_pool * pool,
+    const corpc_open_stream_opts * opts);
+
+bool corpc_channel_pool_call(corpc_channel_pool * pool, const char * service, const char * method,
+    size_t (*pack)(const void * obj, void ** data), const void * request,
+    bool (*unpack)(void * obj, const void * data, size_t size), void * responce,
+    int tmo);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cuttle_corpc_channel_pool_h__ */
@@ -12,6 +12,7 @@
 
 #include <cuttle/cothread/ssl.h>
 #include <cuttle/corpc/service.h>
+#include <cuttle/pb/pb.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -65,6 +66,36 @@ const char * corpc_stream_state_string(
     enum corpc_stream_state state);
 
 
+/* Channel bandwidth is shared between waiting writers in proportion to
+ * the class weight: high 16, normal 4, low 1. Control frames always go first */
+typedef
+enum corpc_stream_priority {
+  corpc_stream_priority_normal = 0,
+  corpc_stream_priority_high = 1,
+  corpc_stream_priority_low = 2,
+  corpc_stream_priority_count
+} corpc_stream_priority;
+
+
+/* Per-message payload compression, negotiated per stream.
+ * Deflate is available only if the library is built with zlib */
+typedef
+enum corpc_compression {
+  corpc_compression_none = 0,
+  corpc_compression_deflate = 1,
+} corpc_compression;
+
+/* Channel-wide compression counters, times are thread CPU microseconds */
+typedef
+struct corpc_compression_stats {
+  uint64_t compressed_messages;
+  uint64_t incompressible_messages; // sent as is because compression didn't shrink them
+  uint64_t raw_bytes_out, compressed_bytes_out;
+  uint64_t raw_bytes_in, compressed_bytes_in;
+  uint64_t compress_us, decompress_us;
+} corpc_compression_stats;
+
+
 
 
 
@@ -72,10 +103,14 @@ const char * corpc_stream_state_string(
 typedef
 struct corpc_channel_open_args {
 
+  /* Host name or address, or "unix:/path/to/socket" for AF_UNIX socket,
+   * or "shm:/path/to/socket" for shared memory rings set up over AF_UNIX socket of
+   * a port with shm enabled. connect_port is ignored for the latter two */
   const char * connect_address;
   uint16_t connect_port;
   int connect_tmout_ms;
 
+  /* NULL for plain text channel, the listening port must have no ssl_ctx as well */
   SSL_CTX * ssl_ctx;
 
   const struct corpc_service **
@@ -84,6 +119,14 @@ struct corpc_channel_open_args {
   struct so_keepalive_opts
     keep_alive;
 
+  /* Initial and max channel receive window, bytes.
+   * Zero selects library defaults */
+  uint32_t chwnd, max_chwnd;
+
+  /* Don't compute per-message CRC32C when running over TLS or AF_UNIX socket,
+   * which already guarantee integrity. Used only if the peer agrees */
+  bool nocrc;
+
   bool (*onconnect)(const corpc_channel * channel);
 
   void (*onstatechanged)(corpc_channel * channel,
@@ -98,6 +141,33 @@ typedef
 struct corpc_open_stream_opts {
   const char * service;
   const char * method;
+
+  /* Initial and max stream receive window, bytes.
+   * The window grows up to max_rwnd while the reader keeps up with the sender.
+   * Zero selects library defaults */
+  uint32_t rwnd, max_rwnd;
+
+  /* Don't wait for the peer to accept the stream, return it in corpc_stream_opening state.
+   * Data written meanwhile follows the create request, open failure is reported by
+   * the first read or write and by corpc_get_stream_state().
+   * Falls back to the blocking open if the peer doesn't support it */
+  bool pipelined;
+
+  /* Stream deadline in milliseconds since open, zero for none.
+   * It is sent to the peer, reads and writes on both sides fail with ETIME after it,
+   * and closing the stream early cancels the server side */
+  uint32_t tmo;
+
+  /* Share of the channel bandwidth while other streams are writing too.
+   * Accepted side of the stream uses the same class */
+  enum corpc_stream_priority priority;
+
+  /* Compress messages of at least compression_threshold bytes written by corpc_stream_write().
+   * Falls back to corpc_compression_none if the peer doesn't support the algorithm.
+   * Zero threshold selects library default */
+  enum corpc_compression compression;
+  uint32_t compression_threshold;
+
   void (*onstatechanged)(corpc_stream * st,
       enum corpc_stream_state,
       int reason);
@@ -121,17 +191,63 @@ const SSL * corpc_channel_get_ssl(const corpc_channel * channel);
 bool corpc_channel_get_peername(const corpc_channel * channel, struct sockaddr * addrs, socklen_t * addrslen);
 bool corpc_channel_get_sockname(const corpc_channel * channel, struct sockaddr * addrs, socklen_t * addrslen);
 
+/* Handler pool counters of a service served over the channel.
+ * Accepted channels share the pools of their listening port */
+bool corpc_channel_get_service_stats(const corpc_channel * channel, const char * service,
+    struct corpc_service_stats * stats);
+
+bool corpc_channel_get_compression_stats(const corpc_channel * channel,
+    struct corpc_compression_stats * stats);
+
 
 corpc_stream * corpc_open_stream(corpc_channel * channel, const corpc_open_stream_opts * opts);
 void corpc_close_stream(corpc_stream ** stp);
 
+/* Milliseconds left until the stream deadline, 0 if it has passed, -1 if the stream has no deadline.
+ * Method procs use it to abandon work the caller will not wait for */
+int corpc_stream_get_remaining_time(const corpc_stream * st);
+
+/*
+ * Unary call: single request and single responce message without stream open / close handshake.
+ *  The server runs the method proc as for a stream whose first write is the responce.
+ *  Falls back to open, write, read and close if the peer doesn't support calls
+ *  (it is not known until the first stream of the channel) or the request doesn't fit one frame.
+ *  tmo is the call deadline in milliseconds, as corpc_open_stream_opts.tmo it is sent to the server.
+ *  Zero or -1 for none
+ */
+bool corpc_call(corpc_channel * channel, const char * service, const char * method,
+    size_t (*pack)(const void * obj, void ** data), const void * request,
+    bool (*unpack)(void * obj, const void * data, size_t size), void * responce,
+    int tmo);
+
 ssize_t corpc_stream_read(struct corpc_stream * st, void ** out);
 bool corpc_stream_write(struct corpc_stream * st, const void * data, size_t size);
 
+/*
+ * Send single message of arbitrary size read incrementally from the source,
+ *  read() returns number of bytes, 0 at end of message, -1 on error.
+ * Messages larger than one frame are fragmented, other streams interleave between fragments.
+ * Peers without fragmentation support accept only single-frame messages (errno=EMSGSIZE)
+ */
+bool corpc_stream_write_stream(struct corpc_stream * st, ssize_t (*read)(void * cookie, void * buf, size_t size),
+    void * cookie);
+
+/* Send size bytes (or up to EOF if size < 0) from fd as single message */
+bool corpc_stream_write_fd(struct corpc_stream * st, int fd, ssize_t size);
+
 
 bool corpc_stream_read_msg(struct corpc_stream * st, bool (*unpack)(void * obj, const void * data, size_t size), void * appmsg);
 bool corpc_stream_write_msg(struct corpc_stream * st, size_t (*pack)(const void * obj, void ** data), const void * appmsg);
 
+/* Encodes appmsg in place after the frame header in buffer reused by the stream,
+ *  single-frame messages then go out with one send, without per-message allocation */
+bool corpc_stream_write_pb(struct corpc_stream * st, const cf_pb_field_t fields[], const void * appmsg);
+
+/* The same for the writers generated with --c_opt=codegen, the frame header goes in front of what write() emits */
+struct cf_pb_wbuf;
+bool corpc_stream_write_wbuf(struct corpc_stream * st, bool (*write)(struct cf_pb_wbuf * w, const void * obj),
+    const void * appmsg);
+
 enum corpc_stream_state corpc_get_stream_state(const corpc_stream * stream);
 
 void * corpc_stream_get_channel_client_context(const corpc_stream * stream);
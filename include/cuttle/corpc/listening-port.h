@@ -20,7 +20,11 @@ extern "C" {
 typedef
 struct corpc_listening_port_opts {
 
+  /* AF_INET, AF_INET6 or AF_UNIX address.
+   * Stale AF_UNIX socket file is removed before bind */
   sockaddr_type listen_address;
+
+  /* NULL for plain text channels */
   SSL_CTX * ssl_ctx;
 
   const struct corpc_service **
@@ -29,6 +33,18 @@ struct corpc_listening_port_opts {
   struct so_keepalive_opts
     keep_alive;
 
+  /* Initial and max channel receive window for accepted channels, bytes.
+   * Zero selects library defaults */
+  uint32_t chwnd, max_chwnd;
+
+  /* Don't compute per-message CRC32C when running over TLS or AF_UNIX socket,
+   * which already guarantee integrity. Used only if the peer agrees */
+  bool nocrc;
+
+  /* AF_UNIX port only: move accepted channels to shared memory rings,
+   * clients connect with "shm:/path/to/socket" address. Requires no ssl_ctx */
+  bool shm;
+
   bool (*onaccept)(const corpc_channel * channel);
   void (*onaccepted)(corpc_channel * channel);
   void (*ondisconnected)(corpc_channel * channel);
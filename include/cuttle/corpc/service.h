@@ -10,6 +10,10 @@
 #ifndef __cuttle_corpc_service_h__
 #define __cuttle_corpc_service_h__
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -26,10 +30,60 @@ struct corpc_service_method {
 typedef
 struct corpc_service {
   const char * name;
+
+  /* Initial and max receive window for accepted streams, bytes.
+   * Zero selects library defaults */
+  uint32_t rwnd, max_rwnd;
+
+  /* Method procs of accepted streams run on a pool of reusable handler coroutines.
+   *  stack_size: handler coroutine stack size
+   *  min_handlers: handlers created in advance, more are added on demand
+   *  max_handlers: max number of concurrently running method procs
+   *  max_queued: streams waiting for a free handler, new streams are refused beyond it
+   * Zero selects library defaults */
+  size_t stack_size;
+  uint32_t min_handlers, max_handlers, max_queued;
+
+  /* Queue delay shedding (CoDel): if the shortest delay of queued streams during
+   * codel_interval exceeds codel_target, new streams which would have to wait are refused
+   * and queued ones waiting longer than 2 * codel_target are closed without running.
+   * Milliseconds, zero selects library defaults (5 and 100) */
+  uint32_t codel_target, codel_interval;
+
   const corpc_service_method methods[];
 } corpc_service;
 
 
+typedef
+struct corpc_service_stats {
+  uint32_t handlers;  // handler coroutines created
+  uint32_t idle;      // handlers waiting for streams
+  uint32_t busy;      // handlers running method procs
+  uint32_t queued;    // accepted streams waiting for a handler
+  uint64_t rejected;  // streams refused before allocation, sum of the following three
+  uint64_t rejected_queue_full; // max_queued was reached
+  uint64_t rejected_overload;   // queue delay was above codel_target
+  uint64_t rejected_limit;      // corpc_set_max_active_streams() limit was reached
+  uint64_t shed;      // queued streams closed without running because of overload
+  bool overloaded;    // queue delay is above codel_target now
+} corpc_service_stats;
+
+
+/*
+ * Process-wide limit of streams queued or running on handlers of all services,
+ *  new streams beyond it are refused with no_stream_resources. Zero (default) is unlimited
+ */
+void corpc_set_max_active_streams(uint32_t max_streams);
+
+
+/*
+ * Numeric method id sent instead of service and method names to peers supporting it.
+ *  It is CRC-32C of "service/method", corpc-pb-gen emits the same values as constants.
+ *  A channel or listening port refuses services of which two methods get the same id
+ */
+uint32_t corpc_method_id(const char * service, const char * method);
+
+
 
 #ifdef __cplusplus
 }
@@ -76,6 +76,8 @@ bool co_socket_set_sndrcv_tmouts(co_socket * cc, int snd_tmout_msec, int rcv_tmo
 bool co_socket_connect(co_socket * cc, const struct sockaddr *address, int tmo_ms);
 ssize_t co_socket_send(co_socket * cc, const void * buf, size_t size, int flags);
 ssize_t co_socket_recv(co_socket * cc, void * buf, size_t size, int flags);
+ssize_t co_socket_sendmsg(co_socket * cc, const struct msghdr * msg, int flags);
+ssize_t co_socket_recvmsg(co_socket * cc, struct msghdr * msg, int flags);
 
 
 
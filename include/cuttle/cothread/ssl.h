@@ -60,6 +60,12 @@ co_ssl_socket * co_ssl_socket_connect_new(const struct sockaddr * addrs, SSL_CTX
 void co_ssl_socket_close(co_ssl_socket * ssl_sock, bool abort_conn);
 void co_ssl_socket_destroy(co_ssl_socket ** ssl_sock, bool abort_conn);
 
+/* Move the data path of connected plain text AF_UNIX socket to a pair of shared memory rings,
+ *  the peer must call co_ssl_socket_shm_accept(). The socket is kept only to detect peer death.
+ *  ring_size is a power of 2, zero selects library default */
+bool co_ssl_socket_shm_connect(co_ssl_socket * ssl_sock, size_t ring_size);
+bool co_ssl_socket_shm_accept(co_ssl_socket * ssl_sock);
+
 
 bool co_ssl_socket_get_peername(const co_ssl_socket * cc, struct sockaddr * addrs, socklen_t * addrslen);
 bool co_ssl_socket_get_sockname(const co_ssl_socket * cc, struct sockaddr * addrs, socklen_t * addrslen);
@@ -14,6 +14,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 
 #ifdef __cplusplus
@@ -25,6 +26,24 @@ uint32_t cf_crc32_update(uint32_t crc, const void * buff, size_t length);
 uint32_t cf_crc32_update_s(uint32_t crc, const char * buff);
 uint32_t cf_crc32_finalize(uint32_t crc);
 
+
+/*
+ * cf_crc32_update() implementations.
+ *  By default the fastest one supported by the CPU is selected at first use.
+ *  Explicit selection is intended for tests and benchmarks
+ */
+enum cf_crc32_impl {
+  cf_crc32_impl_auto = 0,
+  cf_crc32_impl_table = 1,    // byte-at-a-time table
+  cf_crc32_impl_slice8 = 2,   // slicing-by-8 tables
+  cf_crc32_impl_sse42 = 3,    // x86_64 SSE4.2 crc32 instruction, 3-way interleaved
+  cf_crc32_impl_armv8 = 4,    // ARMv8 CRC32 extension
+};
+
+bool cf_crc32_set_impl(enum cf_crc32_impl impl);
+enum cf_crc32_impl cf_crc32_get_impl(void);
+const char * cf_crc32_impl_name(enum cf_crc32_impl impl);
+
 static inline uint32_t cf_crc32(const void * buf, size_t length) {
   return cf_crc32_finalize(cf_crc32_update(cf_crc32_begin(), buf, length));
 }
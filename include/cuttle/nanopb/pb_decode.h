@@ -105,6 +105,12 @@ void pb_release(const pb_field_t fields[], void *dest_struct);
  */
 pb_istream_t pb_istream_from_buffer(const pb_byte_t *buf, size_t bufsize);
 
+/* True for streams created with pb_istream_from_buffer() and their substreams.
+ * stream->state then points to the next unread byte and the remaining
+ * bytes_left bytes can be read in place.
+ */
+bool pb_istream_is_buffer(const pb_istream_t *stream);
+
 /* Function to read from a pb_istream_t. You can use this if you need to
  * read some custom header data, or to read data in field callbacks.
  */
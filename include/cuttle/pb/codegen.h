@@ -0,0 +1,326 @@
+/*
+ * cuttle/pb/codegen.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Runtime support for type-specialized encoders and decoders
+ *  emitted by corpc-pb-gen --c_opt=codegen
+ */
+
+//#pragma once
+
+#ifndef __cuttle_pb_codegen_h__
+#define __cuttle_pb_codegen_h__
+
+#include <cuttle/pb/pb.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*
+ * Output buffer filled back to front: the generated writers emit fields
+ * and repeated items in reverse order, so the length of each submessage
+ * is known right after it is written and no sizing pass is needed.
+ * The bytes end up in the same order as cf_pb_encode() produces.
+ */
+typedef
+struct cf_pb_wbuf {
+  uint8_t * base;
+  uint8_t * ptr;  // first written byte
+  uint8_t * end;
+} cf_pb_wbuf;
+
+#define CF_PB_WBUF_INITIALIZER \
+    { NULL, NULL, NULL }
+
+/* Makes room for at least n more bytes in front of ptr */
+bool cf_pb_wbuf_grow(cf_pb_wbuf * w, size_t n);
+void cf_pb_wbuf_cleanup(cf_pb_wbuf * w);
+
+/* Moves the encoded bytes to the start of malloc()-ed buffer and hands it over to caller */
+size_t cf_pb_wbuf_detach(cf_pb_wbuf * w, void ** buf);
+
+static inline size_t cf_pb_wbuf_size(const cf_pb_wbuf * w)
+{
+  return w->end - w->ptr;
+}
+
+static inline bool cf_pb_wbuf_reserve(cf_pb_wbuf * w, size_t n)
+{
+  return (size_t) (w->ptr - w->base) >= n || cf_pb_wbuf_grow(w, n);
+}
+
+static inline size_t cf_pb_varint_size(uint64_t v)
+{
+  size_t n = 1;
+  while ( v >= 0x80 ) {
+    v >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+static inline uint64_t cf_pb_zigzag(int64_t v)
+{
+  return v < 0 ? ~((uint64_t) v << 1) : (uint64_t) v << 1;
+}
+
+static inline int64_t cf_pb_unzigzag(uint64_t v)
+{
+  return v & 1 ? (int64_t) ~(v >> 1) : (int64_t) (v >> 1);
+}
+
+static inline bool cf_pb_put_varint(cf_pb_wbuf * w, uint64_t v)
+{
+  size_t n = cf_pb_varint_size(v);
+  uint8_t * p;
+
+  if ( !cf_pb_wbuf_reserve(w, n) ) {
+    return false;
+  }
+
+  p = (w->ptr -= n);
+  while ( v >= 0x80 ) {
+    *p++ = (uint8_t) (v | 0x80);
+    v >>= 7;
+  }
+  *p = (uint8_t) v;
+
+  return true;
+}
+
+static inline bool cf_pb_put_svarint(cf_pb_wbuf * w, int64_t v)
+{
+  return cf_pb_put_varint(w, cf_pb_zigzag(v));
+}
+
+static inline bool cf_pb_put_tag(cf_pb_wbuf * w, pb_wire_type_t wt, uint32_t tag)
+{
+  return cf_pb_put_varint(w, ((uint64_t) tag << 3) | wt);
+}
+
+static inline bool cf_pb_put_fixed32(cf_pb_wbuf * w, const void * value)
+{
+  uint32_t v;
+  if ( !cf_pb_wbuf_reserve(w, 4) ) {
+    return false;
+  }
+  memcpy(&v, value, 4);
+  w->ptr -= 4;
+  w->ptr[0] = (uint8_t) v;
+  w->ptr[1] = (uint8_t) (v >> 8);
+  w->ptr[2] = (uint8_t) (v >> 16);
+  w->ptr[3] = (uint8_t) (v >> 24);
+  return true;
+}
+
+static inline bool cf_pb_put_fixed64(cf_pb_wbuf * w, const void * value)
+{
+  uint64_t v;
+  if ( !cf_pb_wbuf_reserve(w, 8) ) {
+    return false;
+  }
+  memcpy(&v, value, 8);
+  w->ptr -= 8;
+  for ( int i = 0; i < 8; ++i, v >>= 8 ) {
+    w->ptr[i] = (uint8_t) v;
+  }
+  return true;
+}
+
+/* Length-delimited value: bytes first, then the length in front of them */
+static inline bool cf_pb_put_bytes(cf_pb_wbuf * w, const void * data, size_t size)
+{
+  if ( !cf_pb_wbuf_reserve(w, size) ) {
+    return false;
+  }
+  w->ptr -= size;
+  if ( size ) {
+    memcpy(w->ptr, data, size);
+  }
+  return cf_pb_put_varint(w, size);
+}
+
+static inline bool cf_pb_put_string(cf_pb_wbuf * w, const char * s)
+{
+  return cf_pb_put_bytes(w, s, s ? strlen(s) : 0);
+}
+
+
+
+/*
+ * cf_pb_unpack_views_<type>() state shared by nested buffers, see cf_pb_unpack_views()
+ */
+typedef
+struct cf_pb_views {
+  const uint8_t * end;  // end of input
+  uint8_t * term;       // string view waiting for its null terminator
+} cf_pb_views;
+
+/*
+ * Input buffer consumed front to back.
+ *  Strings, bytes and repeated arrays are allocated from arena if it is set, with malloc() otherwise.
+ *  With views set strings and bytes point into the input instead.
+ *  With reuse set (heap only) the buffers left in the message by cf_pb_reset() are reused.
+ */
+typedef
+struct cf_pb_rbuf {
+  const uint8_t * ptr;
+  const uint8_t * end;
+  cf_arena * arena;
+  cf_pb_views * views;
+  bool reuse;
+} cf_pb_rbuf;
+
+
+bool cf_pb_get_varint_slow(cf_pb_rbuf * r, uint64_t * v);
+
+static inline bool cf_pb_get_varint(cf_pb_rbuf * r, uint64_t * v)
+{
+  if ( r->ptr < r->end && !(*r->ptr & 0x80) ) {
+    *v = *r->ptr++;
+    return true;
+  }
+  return cf_pb_get_varint_slow(r, v);
+}
+
+static inline bool cf_pb_get_tag(cf_pb_rbuf * r, uint32_t * tag, pb_wire_type_t * wt)
+{
+  uint64_t v;
+  if ( !cf_pb_get_varint(r, &v) || (v >> 3) == 0 || (v >> 3) > UINT32_MAX ) {
+    return false;
+  }
+  *tag = (uint32_t) (v >> 3);
+  *wt = (pb_wire_type_t) (v & 7);
+  if ( r->views && r->views->term ) { /* the tag byte after string view is consumed now */
+    *r->views->term = 0, r->views->term = NULL;
+  }
+  return true;
+}
+
+static inline bool cf_pb_get_int32(cf_pb_rbuf * r, int32_t * value)
+{
+  uint64_t v;
+  int64_t sv;
+  if ( !cf_pb_get_varint(r, &v) || (sv = cf_pb_unzigzag(v)) < INT32_MIN || sv > INT32_MAX ) {
+    return false;
+  }
+  *value = (int32_t) sv;
+  return true;
+}
+
+static inline bool cf_pb_get_uint32(cf_pb_rbuf * r, uint32_t * value)
+{
+  uint64_t v;
+  if ( !cf_pb_get_varint(r, &v) || v > UINT32_MAX ) {
+    return false;
+  }
+  *value = (uint32_t) v;
+  return true;
+}
+
+static inline bool cf_pb_get_int64(cf_pb_rbuf * r, int64_t * value)
+{
+  uint64_t v;
+  if ( !cf_pb_get_varint(r, &v) ) {
+    return false;
+  }
+  *value = cf_pb_unzigzag(v);
+  return true;
+}
+
+static inline bool cf_pb_get_uint64(cf_pb_rbuf * r, uint64_t * value)
+{
+  return cf_pb_get_varint(r, value);
+}
+
+static inline bool cf_pb_get_bool(cf_pb_rbuf * r, bool * value)
+{
+  uint64_t v;
+  if ( !cf_pb_get_varint(r, &v) ) {
+    return false;
+  }
+  *value = v != 0;
+  return true;
+}
+
+static inline bool cf_pb_get_enum(cf_pb_rbuf * r, int * value)
+{
+  uint64_t v;
+  if ( !cf_pb_get_varint(r, &v) ) {
+    return false;
+  }
+  *value = (int) (int64_t) v;
+  return true;
+}
+
+static inline bool cf_pb_get_fixed32(cf_pb_rbuf * r, void * value)
+{
+  uint32_t v;
+  if ( r->end - r->ptr < 4 ) {
+    return false;
+  }
+  v = (uint32_t) r->ptr[0] | ((uint32_t) r->ptr[1] << 8) | ((uint32_t) r->ptr[2] << 16) | ((uint32_t) r->ptr[3] << 24);
+  memcpy(value, &v, 4);
+  r->ptr += 4;
+  return true;
+}
+
+static inline bool cf_pb_get_fixed64(cf_pb_rbuf * r, void * value)
+{
+  uint64_t v = 0;
+  if ( r->end - r->ptr < 8 ) {
+    return false;
+  }
+  for ( int i = 7; i >= 0; --i ) {
+    v = (v << 8) | r->ptr[i];
+  }
+  memcpy(value, &v, 8);
+  r->ptr += 8;
+  return true;
+}
+
+/* Splits off the length-delimited value at ptr as sub buffer */
+static inline bool cf_pb_get_sub(cf_pb_rbuf * r, cf_pb_rbuf * sub)
+{
+  uint64_t size;
+  if ( !cf_pb_get_varint(r, &size) || size > (uint64_t) (r->end - r->ptr) ) {
+    return false;
+  }
+  sub->ptr = r->ptr;
+  sub->end = (r->ptr += size);
+  sub->arena = r->arena;
+  sub->views = r->views;
+  sub->reuse = r->reuse;
+  return true;
+}
+
+/* Allocated copies or views. With r->reuse the heap buffer of previous value is reused, see cf_pb_reset() */
+bool cf_pb_get_string(cf_pb_rbuf * r, char ** value);
+bool cf_pb_get_bytes(cf_pb_rbuf * r, cf_membuf * value);
+
+bool cf_pb_skip_field(cf_pb_rbuf * r, pb_wire_type_t wt);
+
+/* realloc() which keeps ptr when its heap block already fits size */
+void * cf_pb_realloc(void * ptr, size_t size);
+
+/* Lazy fields go through the table runtime, see cf_pb_lazy.
+ *  start points to the tag of the field record being read, wt is its wire type */
+bool cf_pb_get_lazy(cf_pb_rbuf * r, const cf_pb_field_t * field, cf_pb_lazy * lazy, const uint8_t * start,
+    pb_wire_type_t wt);
+bool cf_pb_put_lazy(cf_pb_wbuf * w, const cf_pb_field_t * field, const cf_pb_lazy * lazy);
+
+/* Appends item to the repeated field, initializing the array on first use.
+ * The item is zeroed or left by cf_pb_reset() */
+void * cf_pb_array_push(cf_pb_rbuf * r, ccarray_t * array, size_t item_size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cuttle_pb_codegen_h__ */
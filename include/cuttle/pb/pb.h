@@ -12,6 +12,7 @@
 
 #include <cuttle/membuf.h>
 #include <cuttle/ccarray.h>
+#include <cuttle/arena.h>
 #include <cuttle/nanopb/pb_encode.h>
 #include <cuttle/nanopb/pb_decode.h>
 
@@ -44,6 +45,7 @@ enum cf_pb_field_alloc_type {
   CF_PB_SCALAR,
   CF_PB_ARRAY,
   CF_PB_ONEOF,
+  CF_PB_LAZY = 0x80,  // flag ORed with CF_PB_SCALAR or CF_PB_ARRAY, the member is cf_pb_lazy
 } cf_pb_field_alloc_type;
 
 typedef
@@ -70,14 +72,94 @@ struct cf_pb_field_t {
 #define CF_PB_LAST_FIELD \
     {0}
 
+/*
+ * Ends field table with the array of its field indexes (uint16_t) sorted by tag, the decoder
+ * binary searches there the tags which arrive out of table order instead of scanning the table.
+ * corpc-pb-gen emits it, hand-written tables may end with plain CF_PB_LAST_FIELD.
+ */
+#define CF_PB_LAST_FIELD_INDEXED(order) \
+    {0, 0, 0, sizeof(order) / sizeof((order)[0]), 0, 0, order}
+
+
+/*
+ * Lazy field ([lazy = true] in .proto): the decoder keeps the encoded field records as they are
+ * and cf_pb_lazy_value() decodes them on first access, so the messages which are only forwarded
+ * or partially inspected don't pay for decoding of such fields. Encoding writes the decoded value
+ * (if accessed) followed by the records not decoded yet.
+ *  Arena and views decoding, and decoding from non-buffer streams, decode lazy fields right away.
+ */
+typedef
+struct cf_pb_lazy {
+  cf_membuf data;   // encoded field records, not decoded yet
+  void * value;     // decoded value: the message for CF_PB_SCALAR, ccarray_t for CF_PB_ARRAY
+} cf_pb_lazy;
+
+/*
+ * Decodes pending records of lazy field, the value is allocated with malloc() on first access.
+ * Returns NULL if the field has no data or it can't be decoded, the records are kept then.
+ * Not thread safe even for const-like use, the generated cf_pb_get_<type>_<field>() accessors call it.
+ */
+void * cf_pb_lazy_value(const cf_pb_field_t * field, cf_pb_lazy * lazy);
+
+/*
+ * Replaces value and pending records of lazy field with malloc()'ed value (ccarray_t for repeated
+ * fields) which the message owns then, NULL clears the field. Required singular lazy field
+ * without value fails encoding. The generated cf_pb_set_<type>_<field>() setters call it.
+ */
+void cf_pb_lazy_set(const cf_pb_field_t * field, cf_pb_lazy * lazy, void * value);
+
 
 bool cf_pb_get_encoded_size(size_t * size, const cf_pb_field_t fields[], const void * msg);
 bool cf_pb_encode(pb_ostream_t * ostream, const cf_pb_field_t fields[], const void * msg);
+
+/*
+ * The destination message must be zeroed: repeated and lazy fields are appended to what they hold.
+ * Strings and bytes are always allocated fresh, the pointers found in the message are overwritten.
+ */
 bool cf_pb_decode(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg);
 
 size_t cf_pb_pack(const void * message, const cf_pb_field_t fields[], void ** buf);
 bool cf_pb_unpack(const void * buf, size_t size, const cf_pb_field_t fields[], void * message);
 
+/*
+ * Encodes into caller's reusable heap buffer at buf->data + headroom, buf->size is its capacity
+ * and grows with realloc() when the message does not fit. The headroom is left for framing.
+ */
+bool cf_pb_pack_membuf(const void * message, const cf_pb_field_t fields[], cf_membuf * buf, size_t headroom,
+    size_t * size);
+
+/*
+ * Strings, bytes and repeated arrays of the decoded message are placed in the arena instead
+ * of individual malloc()-s. Such message is released with cf_arena_reset() / cf_arena_destroy()
+ * and must never be passed to free() or ccarray_cleanup(), nor grown with ccarray_push_back().
+ */
+bool cf_pb_decode_arena(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg, cf_arena * arena);
+bool cf_pb_unpack_arena(const void * buf, size_t size, const cf_pb_field_t fields[], void * message, cf_arena * arena);
+
+/*
+ * Zero-copy variant of cf_pb_unpack_arena(): strings and bytes point into buf, only arrays
+ * (and a string ending the buffer) go to the arena. Strings are null-terminated in place,
+ * so buf is modified and can't be decoded again. The message is valid while both buf and
+ * arena are alive; release them, never the fields.
+ */
+bool cf_pb_unpack_views(void * buf, size_t size, const cf_pb_field_t fields[], void * message, cf_arena * arena);
+
+/*
+ * Message reuse for messages decoded with cf_pb_decode() / cf_pb_unpack(), not arena or views.
+ *  cf_pb_reset() empties the message but keeps its heap memory: the array storage, string and bytes
+ *  buffers, submessages and array items with their own buffers. cf_pb_decode_reuse() /
+ *  cf_pb_unpack_reuse() into such message fill them again, so steady-state decoding of similar
+ *  messages does not allocate. The message passed to them must be zeroed or reset, never one
+ *  with dangling pointers.
+ *  Only the active oneof member is released since its union is shared with other members.
+ *  cf_pb_cleanup() frees all memory of the message including the one kept by cf_pb_reset(),
+ *  and leaves it zeroed.
+ */
+void cf_pb_reset(const cf_pb_field_t fields[], void * msg);
+void cf_pb_cleanup(const cf_pb_field_t fields[], void * msg);
+bool cf_pb_decode_reuse(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg);
+bool cf_pb_unpack_reuse(const void * buf, size_t size, const cf_pb_field_t fields[], void * message);
+
 
 #ifdef __cplusplus
 }
@@ -11,4 +11,10 @@ CFLAGS = -Wall -Wextra -Wno-missing-field-initializers -O2 -g3 -Wno-implicit-fal
 SUBDIRS += src/pg
 CFLAGS += -I/usr/include/postgresql -I/usr/local/include/postgresql
 
+# corpc payload compression is built with 'make WITH_ZLIB=1', link applications with -lz then
+ifeq ($(WITH_ZLIB),1)
+CFLAGS += -DHAVE_ZLIB
+LIBS_PRIVATE += -lz
+endif
+
 ARFLAGS = rvU
@@ -0,0 +1,151 @@
+/*
+ * arena.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cuttle/arena.h>
+#include <cuttle/debug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#define CF_ARENA_ALIGN  16
+
+struct arena_block {
+  struct arena_block * next;
+  size_t size;
+  size_t pos;
+  uint8_t data[] __attribute__((aligned(CF_ARENA_ALIGN)));
+};
+
+struct cf_arena {
+  struct arena_block * head; // current block, the first one is at the end of list
+  size_t block_size;
+  size_t used;
+  void * last; // latest allocation, may grow in place
+};
+
+
+static inline size_t align_up(size_t size)
+{
+  return (size + CF_ARENA_ALIGN - 1) & ~(size_t) (CF_ARENA_ALIGN - 1);
+}
+
+static struct arena_block * new_block(cf_arena * arena, size_t size)
+{
+  struct arena_block * block;
+
+  if ( size < arena->block_size ) {
+    size = arena->block_size;
+  }
+
+  if ( !(block = malloc(sizeof(*block) + size)) ) {
+    CF_FATAL("malloc(%zu) fails: %s", sizeof(*block) + size, strerror(errno));
+    return NULL;
+  }
+
+  block->size = size;
+  block->pos = 0;
+  block->next = arena->head;
+  arena->head = block;
+
+  return block;
+}
+
+
+cf_arena * cf_arena_create(size_t block_size)
+{
+  cf_arena * arena;
+
+  if ( !(arena = calloc(1, sizeof(*arena))) ) {
+    CF_FATAL("calloc(arena) fails: %s", strerror(errno));
+    return NULL;
+  }
+
+  arena->block_size = align_up(block_size ? block_size : CF_ARENA_DEFAULT_BLOCK_SIZE);
+
+  return arena;
+}
+
+void cf_arena_destroy(cf_arena ** arena)
+{
+  struct arena_block * block;
+
+  if ( arena && *arena ) {
+    while ( (block = (*arena)->head) ) {
+      (*arena)->head = block->next;
+      free(block);
+    }
+    free(*arena), *arena = NULL;
+  }
+}
+
+void cf_arena_reset(cf_arena * arena)
+{
+  struct arena_block * block;
+
+  while ( (block = arena->head) && block->next ) {
+    arena->head = block->next;
+    free(block);
+  }
+
+  if ( block ) {
+    block->pos = 0;
+  }
+
+  arena->used = 0;
+  arena->last = NULL;
+}
+
+void * cf_arena_alloc(cf_arena * arena, size_t size)
+{
+  struct arena_block * block = arena->head;
+  void * ptr;
+
+  size = align_up(size ? size : 1);
+
+  if ( !block || block->size - block->pos < size ) {
+    if ( !(block = new_block(arena, size)) ) {
+      return NULL;
+    }
+  }
+
+  ptr = block->data + block->pos;
+  block->pos += size;
+  arena->used += size;
+  arena->last = ptr;
+
+  return ptr;
+}
+
+void * cf_arena_realloc(cf_arena * arena, void * ptr, size_t old_size, size_t new_size)
+{
+  struct arena_block * block = arena->head;
+  void * new_ptr;
+
+  if ( !ptr ) {
+    return cf_arena_alloc(arena, new_size);
+  }
+
+  if ( ptr == arena->last ) {
+    size_t start = (uint8_t *) ptr - block->data;
+    if ( align_up(new_size) <= block->size - start ) {
+      arena->used += align_up(new_size) - (block->pos - start);
+      block->pos = start + align_up(new_size);
+      return ptr;
+    }
+  }
+
+  if ( (new_ptr = cf_arena_alloc(arena, new_size)) ) {
+    memcpy(new_ptr, ptr, old_size < new_size ? old_size : new_size);
+  }
+
+  return new_ptr;
+}
+
+size_t cf_arena_used(const cf_arena * arena)
+{
+  return arena->used;
+}
@@ -0,0 +1,306 @@
+/*
+ * corpc-channel-pool.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cuttle/debug.h>
+#include <cuttle/corpc/channel-pool.h>
+#include <cuttle/cothread/scheduler.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "corpc-channel.h"
+
+#define CORPC_POOL_THREAD_STACK_SIZE            (256*1024)
+#define CORPC_POOL_DEFAULT_RECONNECT_INTERVAL   1000
+
+
+struct pool_slot {
+  char * address;
+  uint16_t port;
+  corpc_channel * channel;
+};
+
+struct corpc_channel_pool {
+  co_thread_lock_t lock;
+  struct corpc_channel_open_args channel_args;
+  struct pool_slot * slots;
+  size_t nb_slots;
+  size_t next;  // rotates the choice between equally loaded channels
+  int reconnect_interval;
+  bool maintenance_running;
+  bool shutdown;
+};
+
+
+
+static void pool_lock(corpc_channel_pool * pool)
+{
+  if ( !co_thread_lock(&pool->lock) ) {
+    CF_FATAL("co_thread_lock() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_unlock(corpc_channel_pool * pool)
+{
+  if ( !co_thread_unlock(&pool->lock) ) {
+    CF_FATAL("co_thread_unlock() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_wait(corpc_channel_pool * pool, int tmo)
+{
+  if ( co_thread_wait(&pool->lock, tmo) < 0 ) {
+    CF_FATAL("co_thread_wait() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_signal(corpc_channel_pool * pool)
+{
+  if ( co_thread_broadcast(&pool->lock) < 0 ) {
+    CF_FATAL("co_thread_broadcast() fails: %s", strerror(errno));
+  }
+}
+
+
+// must be locked, the lock is released while connecting
+static void reconnect_broken_channels(corpc_channel_pool * pool)
+{
+  struct corpc_channel_open_args args;
+  corpc_channel * channel;
+
+  for ( size_t i = 0; i < pool->nb_slots && !pool->shutdown; ++i ) {
+
+    struct pool_slot * slot = &pool->slots[i];
+
+    if ( slot->channel && !corpc_channel_established(slot->channel) ) {
+      CF_NOTICE("channel to %s:%u is %s", slot->address, slot->port,
+          corpc_channel_state_string(corpc_get_channel_state(slot->channel)));
+      corpc_channel_close(&slot->channel);
+    }
+
+    if ( !slot->channel ) {
+
+      args = pool->channel_args;
+      args.connect_address = slot->address;
+      args.connect_port = slot->port;
+
+      pool_unlock(pool);
+      if ( !(channel = corpc_channel_open(&args)) ) {
+        CF_CRITICAL("corpc_channel_open(%s:%u) fails: %s", slot->address, slot->port, strerror(errno));
+      }
+      pool_lock(pool);
+
+      if ( channel && pool->shutdown ) {
+        corpc_channel_close(&channel);
+      }
+
+      slot->channel = channel;
+    }
+  }
+}
+
+
+static void maintenance_thread(void * arg)
+{
+  corpc_channel_pool * pool = arg;
+
+  pool_lock(pool);
+
+  while ( !pool->shutdown ) {
+    pool_wait(pool, pool->reconnect_interval);
+    reconnect_broken_channels(pool);
+  }
+
+  pool->maintenance_running = false;
+  pool_signal(pool);
+  pool_unlock(pool);
+}
+
+
+static void pool_cleanup(corpc_channel_pool * pool)
+{
+  if ( pool->slots ) {
+    for ( size_t i = 0; i < pool->nb_slots; ++i ) {
+      corpc_channel_close(&pool->slots[i].channel);
+      free(pool->slots[i].address);
+    }
+    free(pool->slots);
+  }
+
+  if ( pool->lock ) {
+    co_thread_lock_destroy(&pool->lock);
+  }
+}
+
+
+corpc_channel_pool * corpc_channel_pool_new(const struct corpc_channel_pool_opts * opts)
+{
+  corpc_channel_pool * pool = NULL;
+  size_t nb_endpoints = 0;
+  int per_endpoint;
+  bool fok = false;
+
+  if ( !opts || !opts->endpoints ) {
+    errno = EINVAL;
+    goto end;
+  }
+
+  while ( opts->endpoints[nb_endpoints].address ) {
+    ++nb_endpoints;
+  }
+
+  if ( !nb_endpoints ) {
+    CF_CRITICAL("No endpoints specified");
+    errno = EINVAL;
+    goto end;
+  }
+
+  if ( !(pool = calloc(1, sizeof(*pool))) ) {
+    CF_CRITICAL("calloc(corpc_channel_pool) fails: %s", strerror(errno));
+    goto end;
+  }
+
+  per_endpoint = opts->channels_per_endpoint > 0 ? opts->channels_per_endpoint : 1;
+
+  pool->channel_args = opts->channel_args;
+  pool->reconnect_interval = opts->reconnect_interval_ms > 0 ? opts->reconnect_interval_ms :
+      CORPC_POOL_DEFAULT_RECONNECT_INTERVAL;
+
+  if ( !co_thread_lock_init(&pool->lock) ) {
+    CF_CRITICAL("co_thread_lock_init() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( !(pool->slots = calloc(nb_endpoints * per_endpoint, sizeof(*pool->slots))) ) {
+    CF_CRITICAL("calloc(slots) fails: %s", strerror(errno));
+    goto end;
+  }
+
+  // interleave endpoints so that equally loaded channels are taken from different backends in turn
+  for ( int j = 0; j < per_endpoint; ++j ) {
+    for ( size_t i = 0; i < nb_endpoints; ++i ) {
+      struct pool_slot * slot = &pool->slots[pool->nb_slots++];
+      if ( !(slot->address = strdup(opts->endpoints[i].address)) ) {
+        CF_CRITICAL("strdup(address) fails: %s", strerror(errno));
+        goto end;
+      }
+      slot->port = opts->endpoints[i].port;
+    }
+  }
+
+  pool_lock(pool);
+  reconnect_broken_channels(pool);
+  pool->maintenance_running = true;
+  pool_unlock(pool);
+
+  if ( !co_schedule(maintenance_thread, pool, CORPC_POOL_THREAD_STACK_SIZE) ) {
+    CF_CRITICAL("co_schedule(maintenance_thread) fails: %s", strerror(errno));
+    pool->maintenance_running = false;
+    goto end;
+  }
+
+  fok = true;
+
+end:
+
+  if ( !fok && pool ) {
+    pool_cleanup(pool);
+    free(pool);
+    pool = NULL;
+  }
+
+  return pool;
+}
+
+
+void corpc_channel_pool_destroy(corpc_channel_pool ** pool)
+{
+  if ( pool && *pool ) {
+
+    pool_lock(*pool);
+
+    (*pool)->shutdown = true;
+    pool_signal(*pool);
+
+    while ( (*pool)->maintenance_running ) {
+      pool_wait(*pool, -1);
+    }
+
+    pool_unlock(*pool);
+
+    pool_cleanup(*pool);
+    free(*pool);
+    *pool = NULL;
+  }
+}
+
+
+corpc_channel * corpc_channel_pool_get(corpc_channel_pool * pool)
+{
+  corpc_channel * channel = NULL;
+  size_t nb_streams, min_streams = SIZE_MAX;
+  size_t i, n;
+
+  pool_lock(pool);
+
+  for ( n = 0; n < pool->nb_slots; ++n ) {
+
+    i = (pool->next + n) % pool->nb_slots;
+
+    if ( pool->slots[i].channel && corpc_channel_established(pool->slots[i].channel) ) {
+      if ( (nb_streams = corpc_channel_get_nb_streams(pool->slots[i].channel)) < min_streams ) {
+        min_streams = nb_streams;
+        channel = pool->slots[i].channel;
+      }
+    }
+  }
+
+  if ( channel ) {
+    corpc_channel_addref(channel);
+    pool->next = (pool->next + 1) % pool->nb_slots;
+  }
+  else {
+    pool_signal(pool); // reconnect without waiting for the interval
+    errno = ENOTCONN;
+  }
+
+  pool_unlock(pool);
+
+  return channel;
+}
+
+
+corpc_stream * corpc_channel_pool_open_stream(corpc_channel_pool * pool,
+    const corpc_open_stream_opts * opts)
+{
+  corpc_channel * channel;
+  corpc_stream * st = NULL;
+
+  // the stream keeps the channel alive
+  if ( (channel = corpc_channel_pool_get(pool)) ) {
+    st = corpc_open_stream(channel, opts);
+    corpc_channel_release(&channel);
+  }
+
+  return st;
+}
+
+
+bool corpc_channel_pool_call(corpc_channel_pool * pool, const char * service, const char * method,
+    size_t (*pack)(const void *, void **), const void * request,
+    bool (*unpack)(void *, const void *, size_t), void * responce,
+    int tmo)
+{
+  corpc_channel * channel;
+  bool fok = false;
+
+  if ( (channel = corpc_channel_pool_get(pool)) ) {
+    fok = corpc_call(channel, service, method, pack, request, unpack, responce, tmo);
+    corpc_channel_release(&channel);
+  }
+
+  return fok;
+}
@@ -13,15 +13,30 @@
 #include "corpc-channel.h"
 #include "corpc-listening-port.h"
 #include "corpc-proto.h"
+#include "corpc-methods.h"
+#include "corpc-handler-pool.h"
+#include "corpc-compress.h"
+#include <cuttle/pb/codegen.h>
 #include <errno.h>
+#include <time.h>
 
 #define CORPC_CHANNEL_THREAD_STACK_SIZE   (8*256*1024)
-#define CORPC_STREAM_DEFAULT_QUEUE_SIZE   8
 
-#define CORPC_STREAM_DEFAULT_STACK_SIZE   (8*1024*1024)
+#define CORPC_UNIX_ADDRESS_PREFIX   "unix:"
+#define CORPC_SHM_ADDRESS_PREFIX    "shm:"
+#define CORPC_STREAM_DEFAULT_QUEUE_SIZE   8
 
 #define CORPC_ON_ACCEPTED_DEFAULT_STACK_SIZE  (8*1024*1024)
 
+// byte windows, must be large enough to keep few max-sized messages in flight
+#define CORPC_MIN_RWND                    (4*CORPC_MAX_MSG_SIZE)
+#define CORPC_STREAM_DEFAULT_RWND         (256*1024)
+#define CORPC_STREAM_DEFAULT_MAX_RWND     (16*1024*1024)
+#define CORPC_CHANNEL_DEFAULT_RWND        (4*1024*1024)
+#define CORPC_CHANNEL_DEFAULT_MAX_RWND    (64*1024*1024)
+
+#define CORPC_DEFAULT_COMPRESSION_THRESHOLD 1024
+
 
 
 const char * corpc_channel_state_string(enum corpc_channel_state state)
@@ -112,9 +127,181 @@ struct write_lock {
   bool locked;
 } write_lock;
 
-static bool acquire_write_lock(corpc_stream * st, corpc_channel * channel, int tmo, write_lock * wlock)
+/*
+ * Writers waiting for channel->write_lock.
+ *  Control frames (st == NULL) are granted first in arrival order,
+ *  stream frames by the smallest virtual finish tag among those having send credit.
+ *  Tags grow by frame size over the weight of the stream priority class,
+ *  so bulk streams can't starve the others however many frames they queue.
+ */
+struct write_waiter {
+  struct write_waiter * next;
+  corpc_stream * st;
+  uint64_t tag;
+  size_t size;
+  bool granted;
+  bool rejected;  // the stream or the channel can't be written anymore
+};
+
+#define CORPC_WFQ_SCALE   64
+
+static const uint32_t priority_weights[] = {
+  [corpc_stream_priority_normal] = 4,
+  [corpc_stream_priority_high] = 16,
+  [corpc_stream_priority_low] = 1,
+};
+
+static uint32_t local_caps(const corpc_channel * channel)
+{
+  uint32_t caps = CORPC_LOCAL_CAPS;
+
+  // TLS record MAC or the local kernel transport already protects the data
+  if ( channel->nocrc && (channel->ssl_ctx || channel->local) ) {
+    caps |= corpc_cap_nocrc;
+  }
+
+  if ( corpc_compression_supported(corpc_compression_deflate) ) {
+    caps |= corpc_cap_deflate;
+  }
+
+  return caps & ~channel->disabled_caps;
+}
+
+static inline bool byte_window(const corpc_stream * st)
+{
+  return (st->caps & corpc_cap_byte_window) != 0;
+}
+
+static inline size_t max_fragment_size(const corpc_stream * st)
+{
+  return st->unary ? CORPC_MAX_CALL_RESPONCE_SIZE : CORPC_MAX_PAYLOAD_SIZE;
+}
+
+// must be locked
+static bool have_send_credit(const corpc_stream * st, size_t size)
+{
+  if ( st->unary ) {
+    // call responces are not flow controlled, the caller waits for them anyway
+    return true;
+  }
+  if ( !byte_window(st) ) {
+    return st->rwnd > 0;
+  }
+  return st->rwnd >= size && st->channel->swnd >= size;
+}
+
+static int64_t make_deadline(uint32_t tmo)
+{
+  return tmo ? cf_get_monotic_ms() + tmo : 0;
+}
+
+// ms left until the stream deadline, -1 if it has none
+static int stream_tmo(const corpc_stream * st)
+{
+  int64_t ct;
+
+  if ( !st->deadline ) {
+    return -1;
+  }
+
+  return (ct = cf_get_monotic_ms()) < st->deadline ? (int) (st->deadline - ct) : 0;
+}
+
+// deadline as sent to the peer, 0 if none
+static uint32_t wire_deadline(const corpc_stream * st)
+{
+  int tmo = stream_tmo(st);
+  return tmo < 0 ? 0 : tmo > 0 ? tmo : 1;
+}
+
+// must be locked
+// stream frames may go only after create_stream_resp, or as early data of the opening stream
+static bool can_write(const corpc_channel * channel, const corpc_stream * st)
+{
+  return corpc_channel_established(channel) && (!st || st->state == corpc_stream_established
+      || (st->early && st->state == corpc_stream_opening));
+}
+
+// must be locked
+static void grant_write_lock(corpc_channel * channel)
+{
+  struct write_waiter * w, * best = NULL;
+  bool rejected = false;
+
+  for ( w = channel->wq; w; w = w->next ) {
+    if ( !w->rejected && !can_write(channel, w->st) ) {
+      w->rejected = rejected = true;
+    }
+  }
+
+  if ( rejected ) {
+    channel_state_signal();
+  }
+
+  if ( channel->write_lock ) {
+    return;
+  }
+
+  for ( w = channel->wq; w; w = w->next ) {
+    if ( w->rejected ) {
+      continue;
+    }
+    if ( !w->st ) {
+      best = w;
+      break;
+    }
+    if ( have_send_credit(w->st, w->size) && (!best || w->tag < best->tag) ) {
+      best = w;
+    }
+  }
+
+  if ( best ) {
+    if ( best->st ) {
+      best->st->vtime = best->tag;
+      channel->vclock = best->tag;
+    }
+    best->granted = channel->write_lock = true;
+    channel_state_signal();
+  }
+}
+
+// must be locked
+static void enqueue_write_waiter(corpc_channel * channel, struct write_waiter * w)
+{
+  struct write_waiter ** pp = &channel->wq;
+
+  if ( w->st ) {
+    w->tag = (w->st->vtime > channel->vclock ? w->st->vtime : channel->vclock)
+        + (uint64_t) (w->size + sizeof(comsghdr)) * CORPC_WFQ_SCALE / priority_weights[w->st->priority];
+  }
+
+  while ( *pp ) {
+    pp = &(*pp)->next;
+  }
+  *pp = w;
+}
+
+// must be locked
+static void dequeue_write_waiter(corpc_channel * channel, struct write_waiter * w)
+{
+  struct write_waiter ** pp = &channel->wq;
+
+  while ( *pp && *pp != w ) {
+    pp = &(*pp)->next;
+  }
+  if ( *pp ) {
+    *pp = w->next;
+  }
+}
+
+static bool acquire_write_lock(corpc_stream * st, corpc_channel * channel, size_t size, int tmo, write_lock * wlock)
 {
-  int64_t ct, et;
+  struct write_waiter w = {
+    .st = st,
+    .size = size,
+  };
+
+  int64_t ct, et = 0;
 
   wlock->locked = false;
 
@@ -124,19 +311,22 @@ static bool acquire_write_lock(corpc_stream * st, corpc_channel * channel, int t
 
   channel_state_lock();
 
-  while ( 42 ) {
+  if ( !can_write(channel, st) ) {
+    channel_state_unlock();
+    errno = ENOTCONN;
+    return false;
+  }
 
-    if ( !corpc_channel_established(channel) || (st && st->state != corpc_stream_established) ) {
-      errno = ENOTCONN;
-      break;
-    }
+  enqueue_write_waiter(channel, &w);
+  grant_write_lock(channel);
+
+  while ( !w.granted ) {
 
-    if ( !channel->write_lock && (!st || st->rwnd > 0) ) {
-      channel->write_lock = wlock->locked = true;
+    if ( w.rejected || !can_write(channel, st) ) {
+      errno = ENOTCONN;
       break;
     }
 
-
     if ( tmo >= 0 && (ct = cf_get_monotic_ms()) >= et ) {
       errno = ETIME;
       break;
@@ -145,6 +335,9 @@ static bool acquire_write_lock(corpc_stream * st, corpc_channel * channel, int t
     channel_state_wait(tmo < 0 ? -1 : (int) (et - ct));
   }
 
+  dequeue_write_waiter(channel, &w);
+  wlock->locked = w.granted;
+
   channel_state_unlock();
 
   return wlock->locked;
@@ -156,12 +349,79 @@ static void release_write_lock(corpc_channel * channel, write_lock * wlock)
   if ( wlock->locked ) {
     channel_state_lock();
     wlock->locked = channel->write_lock = false;
+    grant_write_lock(channel);
     channel_state_signal();
     channel_state_unlock();
   }
 }
 
 
+static void rxwnd_init(corpc_rxwnd * w, uint32_t size, uint32_t max, uint32_t defsize, uint32_t defmax)
+{
+  if ( !size ) {
+    size = defsize;
+  }
+  if ( size < CORPC_MIN_RWND ) {
+    size = CORPC_MIN_RWND;
+  }
+  if ( !max ) {
+    max = defmax;
+  }
+  if ( max < size ) {
+    max = size;
+  }
+
+  memset(w, 0, sizeof(*w));
+  w->size = size;
+  w->max = max;
+}
+
+// must be locked, returns false if the peer has overrun the window
+static bool rxwnd_receive(corpc_rxwnd * w, uint32_t size)
+{
+  if ( size > w->size - w->inflight ) {
+    return false;
+  }
+  if ( (w->inflight += size) > w->size - w->size / 4 ) {
+    w->low = true;
+  }
+  return true;
+}
+
+// must be locked
+static void rxwnd_consume(corpc_rxwnd * w, uint32_t size)
+{
+  w->unacked += size;
+}
+
+/* must be locked
+ *  Return consumed bytes to the peer as credit, batching small updates.
+ *  If the peer nearly exhausted the window while the reader drained everything it got,
+ *  the stream is limited by the window rather than by the reader, so grow the window */
+static uint32_t rxwnd_take_credit(corpc_rxwnd * w, bool force)
+{
+  uint32_t credit = 0;
+  uint32_t grow;
+
+  if ( w->unacked && (force || w->unacked >= w->size / 4) ) {
+
+    credit = w->unacked;
+
+    if ( w->low && w->unacked == w->inflight && w->size < w->max ) {
+      grow = w->max - w->size < w->size ? w->max - w->size : w->size;
+      w->size += grow;
+      credit += grow;
+    }
+
+    w->inflight -= w->unacked;
+    w->unacked = 0;
+    w->low = false;
+  }
+
+  return credit;
+}
+
+
 // must be locked
 void set_channel_state(corpc_channel * channel, enum corpc_channel_state state, int reason, bool lock)
 {
@@ -189,6 +449,13 @@ void set_channel_state(corpc_channel * channel, enum corpc_channel_state state,
 void corpc_channel_cleanup(struct corpc_channel * channel)
 {
   free(channel->connect_opts.connect_address), channel->connect_opts.connect_address = NULL;
+  corpc_method_table_release(&channel->methods);
+
+  while ( channel->zctx ) {
+    corpc_zctx * next = channel->zctx->next;
+    corpc_zctx_destroy(channel->zctx);
+    channel->zctx = next;
+  }
 
   CF_NOTICE("NB_STREAMS=%zu", ccarray_size(&channel->streams));
   ccarray_cleanup(&channel->streams);
@@ -204,6 +471,10 @@ bool corpc_channel_init(struct corpc_channel * channel, const struct corpc_chann
   channel->state = corpc_channel_state_idle;
   channel->refs = 1;
 
+  rxwnd_init(&channel->rx, opts ? opts->chwnd : 0, opts ? opts->max_chwnd : 0,
+      CORPC_CHANNEL_DEFAULT_RWND,
+      CORPC_CHANNEL_DEFAULT_MAX_RWND);
+
   if ( !ccarray_init(&channel->streams, 256, sizeof(struct corpc_stream*)) ) {
     CF_SSL_ERR(CF_SSL_ERR_APP, "ccarray_init(streams) fails: %s", strerror(errno));
     goto end;
@@ -224,7 +495,13 @@ bool corpc_channel_init(struct corpc_channel * channel, const struct corpc_chann
 
     channel->services = opts->services;
     channel->ssl_ctx = opts->ssl_ctx;
+
+    if ( opts->services && !(channel->methods = corpc_method_table_new(opts->services)) ) {
+      CF_SSL_ERR(CF_SSL_ERR_APP, "corpc_method_table_new() fails: %s", strerror(errno));
+      goto end;
+    }
     channel->keep_alive = opts->keep_alive;
+    channel->nocrc = opts->nocrc;
   }
 
   fok  = true;
@@ -313,8 +590,6 @@ void corpc_channel_close_internal(corpc_channel ** chp, bool lock)
 ///////////////////////////////////////////////////////////////////////////////////
 
 
-
-
 // channel must be locked
 static uint16_t gensid(void)
 {
@@ -322,7 +597,9 @@ static uint16_t gensid(void)
   uint16_t sid;
 
   //lock_channel();
-  sid = ++gsid;
+  if ( !(sid = ++gsid) ) { // 0 means unknown did
+    sid = ++gsid;
+  }
   //unlock_channel();
 
   return sid;
@@ -334,55 +611,76 @@ static inline uint16_t srwnd(const corpc_stream * st)
   return st ? ccfifo_capacity(&st->rxq) - ccfifo_size(&st->rxq) : 0;
 }
 
-static bool send_create_stream_request(corpc_stream * st, const char * service, const char * method)
+static bool send_create_stream_request(corpc_stream * st, const char * service, const char * method,
+    enum corpc_compression compression)
 {
   corpc_channel * channel = st->channel;
+  uint32_t method_id = 0;
   write_lock wlock;
   bool fok = false;
 
-  if ( acquire_write_lock(NULL, channel, -1, &wlock) ) {
-    fok = corpc_proto_send_create_stream_request(channel->ssl_sock, st->sid, srwnd(st), service, method);
+  if ( channel->peer_caps & corpc_cap_method_id ) {
+    method_id = corpc_method_id(service, method);
+    service = method = "";
+  }
+
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
+    fok = corpc_proto_send_create_stream_request(channel->ssl_sock, st->sid, srwnd(st), service, method,
+        &(comsg_stream_ext ) {
+              .caps = local_caps(channel),
+              .rwnd = st->rx.size,
+              .chwnd = channel->rx.size,
+              .method_id = method_id,
+              .deadline = wire_deadline(st),
+              .priority = st->priority,
+              .compression = compression,
+            });
     release_write_lock(channel, &wlock);
   }
 
   return fok;
 }
 
-static bool send_create_stream_responce(corpc_channel * channel, uint16_t sid, uint16_t did, uint16_t rwnd, uint16_t status)
+static bool send_create_stream_responce(corpc_channel * channel, uint16_t sid, uint16_t did, uint16_t rwnd, uint16_t status,
+    const comsg_stream_ext * ext)
 {
   write_lock wlock;
   bool fok = false;
 
-  if ( acquire_write_lock(NULL, channel, -1, &wlock) ) {
-    fok = corpc_proto_send_create_stream_responce(channel->ssl_sock, sid, did, rwnd, status);
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
+    fok = corpc_proto_send_create_stream_responce(channel->ssl_sock, sid, did, rwnd, status, ext);
     release_write_lock(channel, &wlock);
   }
 
   return fok;
 }
 
-static bool send_close_stream_notify(corpc_stream * st)
+static bool send_close_notify(corpc_channel * channel, uint16_t sid, uint16_t did)
 {
-  corpc_channel * channel = st->channel;
   write_lock wlock;
   bool fok = false;
 
-  if ( acquire_write_lock(NULL, channel, -1, &wlock) ) {
-    fok = corpc_proto_send_close_stream(channel->ssl_sock, st->sid, st->did, 0);
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
+    fok = corpc_proto_send_close_stream(channel->ssl_sock, sid, did, 0);
     release_write_lock(channel, &wlock);
   }
 
-
   return fok;
 }
 
+// with did = 0 it cancels a call or a stream which is not yet accepted
+static bool send_close_stream_notify(corpc_stream * st)
+{
+  return send_close_notify(st->channel, st->sid, st->did);
+}
+
 static bool send_data_ack(corpc_stream * st)
 {
   corpc_channel * channel = st->channel;
   write_lock wlock;
   bool fok = false;
 
-  if ( acquire_write_lock(NULL, channel, -1, &wlock) ) {
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
     fok = corpc_proto_send_data_ack(channel->ssl_sock, st->sid, st->did);
     release_write_lock(st->channel, &wlock);
   }
@@ -391,114 +689,440 @@ static bool send_data_ack(corpc_stream * st)
   return fok;
 }
 
-static bool send_data(corpc_stream * st, const void * data, size_t size)
+// return channel credit for data of a stream which was not accepted or is already closed
+static bool send_channel_credit(corpc_channel * channel, uint16_t did, uint32_t chcredit)
 {
-  corpc_channel * channel = st->channel;
   write_lock wlock;
   bool fok = false;
 
-  if ( acquire_write_lock(st, channel, -1, &wlock) ) {
-    if ( (fok = corpc_proto_send_data(channel->ssl_sock, st->sid, st->did, data, size)) ) {
-      channel_state_lock();
-      --st->rwnd;
-      channel_state_unlock();
-    }
-    release_write_lock(st->channel, &wlock);
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
+    fok = corpc_proto_send_window_update(channel->ssl_sock, 0, did, 0, chcredit);
+    release_write_lock(channel, &wlock);
   }
 
   return fok;
 }
 
-void corpc_stream_cleanup(struct corpc_stream * st)
+static bool send_window_update(corpc_stream * st, uint32_t credit, uint32_t chcredit)
 {
-  ccfifo_cleanup(&st->rxq);
-  memset(st, 0, sizeof(*st));
+  corpc_channel * channel = st->channel;
+  write_lock wlock;
+  bool fok = false;
+
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
+    fok = corpc_proto_send_window_update(channel->ssl_sock, st->sid, st->did, credit, chcredit);
+    release_write_lock(channel, &wlock);
+  }
+
+  return fok;
 }
 
-bool corpc_stream_init(struct corpc_stream * st, const corpc_stream_opts * args)
+static bool send_call_request(corpc_stream * st, uint32_t method_id, const void * data, size_t size)
 {
+  corpc_channel * channel = st->channel;
+  uint16_t flags = 0;
+  write_lock wlock;
   bool fok = false;
 
-  memset(st, 0, sizeof(*st));
+  if ( st->caps & corpc_cap_nocrc ) {
+    flags |= comsg_flag_nocrc;
+  }
 
-  if ( ccfifo_init(&st->rxq, CORPC_STREAM_DEFAULT_QUEUE_SIZE, sizeof(comsg*)) ) {
-    st->channel = args->channel;
-    st->sid = args->sid;
-    st->did = args->did;
-    st->rwnd = args->rwnd;
-    st->state = args->state;
-    fok = true;
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
+    fok = corpc_proto_send_call_request(channel->ssl_sock, st->sid, flags, method_id, wire_deadline(st),
+        data, size);
+    release_write_lock(channel, &wlock);
   }
 
   return fok;
 }
 
-void corpc_stream_destroy(corpc_stream ** st)
+static bool send_call_status(corpc_channel * channel, uint16_t did, uint16_t status)
 {
-  if ( st && *st ) {
-    corpc_stream_cleanup(*st);
-    free(*st);
-    *st = NULL;
+  write_lock wlock;
+  bool fok = false;
+
+  if ( acquire_write_lock(NULL, channel, 0, -1, &wlock) ) {
+    fok = corpc_proto_send_call_responce(channel->ssl_sock, did, 0, status, NULL, 0);
+    release_write_lock(channel, &wlock);
   }
+
+  return fok;
 }
 
-corpc_stream * corpc_stream_new(const corpc_stream_opts * args)
+// the last fragment completes the call, nothing can be written after it
+static bool send_call_responce(corpc_stream * st, uint16_t flags, const void * data, size_t size)
 {
-  corpc_stream * st = NULL;
+  corpc_channel * channel = st->channel;
+  write_lock wlock;
   bool fok = false;
 
-  if ( !(st = malloc(sizeof(*st))) ) {
-    goto end;
+  if ( acquire_write_lock(st, channel, size, stream_tmo(st), &wlock) ) {
+
+    if ( (fok = corpc_proto_send_call_responce(channel->ssl_sock, st->did, flags, create_stream_responce_ok,
+        data, size)) && !(flags & comsg_flag_more) ) {
+      channel_state_lock();
+      corpc_set_stream_state(st, corpc_stream_closed);
+      channel_state_unlock();
+    }
+
+    release_write_lock(channel, &wlock);
   }
 
-  if ( !corpc_stream_init(st, args) ) {
-    goto end;
+  return fok;
+}
+
+// frame, if not NULL, has the header space in front of data
+static bool send_data_frame(corpc_stream * st, uint16_t flags, void * frame, const void * data, size_t size)
+{
+  corpc_channel * channel = st->channel;
+  write_lock wlock;
+  uint16_t did;
+  bool fok = false;
+
+  if ( st->caps & corpc_cap_nocrc ) {
+    flags |= comsg_flag_nocrc;
   }
 
-  fok = true;
+  if ( stream_tmo(st) == 0 ) {
+    errno = ETIME;
+    return false;
+  }
 
-end:
+  if ( st->unary ) {
+    return send_call_responce(st, flags, data, size);
+  }
 
-  if ( !fok && st ) {
-    corpc_stream_destroy(&st);
+  if ( acquire_write_lock(st, channel, size, stream_tmo(st), &wlock) ) {
+
+    channel_state_lock();
+    if ( st->state == corpc_stream_opening ) {
+      flags |= comsg_flag_early;
+    }
+    did = st->did;
+    channel_state_unlock();
+
+    fok = frame ? corpc_proto_send_data_frame(channel->ssl_sock, st->sid, did, flags, frame, size) :
+        corpc_proto_send_data(channel->ssl_sock, st->sid, did, flags, data, size);
+
+    if ( fok ) {
+      channel_state_lock();
+      if ( !byte_window(st) ) {
+        --st->rwnd;
+      }
+      else {
+        st->rwnd -= size;
+        channel->swnd -= size;
+      }
+      channel_state_unlock();
+    }
+    release_write_lock(st->channel, &wlock);
   }
 
-  return st;
+  return fok;
 }
 
-enum corpc_stream_state corpc_get_stream_state(const corpc_stream * st)
+static bool send_data(corpc_stream * st, uint16_t flags, const void * data, size_t size)
 {
-  return st->state;
+  return send_data_frame(st, flags, NULL, data, size);
 }
 
-void corpc_set_stream_state(struct corpc_stream * st, corpc_stream_state state)
+/* Fragments of one message must not interleave with other messages of the same stream,
+ * but the channel write lock is released between fragments to let other streams go */
+static bool acquire_message_lock(corpc_stream * st)
 {
-  corpc_stream_state oldstate = st->state;
-  CF_NOTICE("%s -> %s", corpc_stream_state_string(oldstate), corpc_stream_state_string(state));
-  st->state = state;
-  channel_state_signal();
-}
+  bool fok = false;
+  int tmo;
 
-void * corpc_stream_get_channel_client_context(const corpc_stream * stream)
-{
-  return corpc_channel_get_client_context(stream->channel);
-}
+  channel_state_lock();
 
+  while ( st->wmsg_lock && corpc_channel_established(st->channel) && st->state == corpc_stream_established
+      && (tmo = stream_tmo(st)) != 0 ) {
+    channel_state_wait(tmo);
+  }
 
+  if ( !st->wmsg_lock ) {
+    fok = st->wmsg_lock = true;
+  }
+  else {
+    errno = stream_tmo(st) == 0 ? ETIME : ENOTCONN;
+  }
 
+  channel_state_unlock();
 
+  return fok;
+}
 
-enum corpc_channel_state corpc_get_channel_state(const corpc_channel * channel)
+static void release_message_lock(corpc_stream * st)
 {
-  return channel->state;
+  channel_state_lock();
+  st->wmsg_lock = false;
+  channel_state_signal();
+  channel_state_unlock();
 }
 
-
+// the peer holds an incomplete message, the stream is unusable
+static void abort_message(corpc_stream * st)
+{
+  channel_state_lock();
+  if ( st->state == corpc_stream_established ) {
+    corpc_set_stream_state(st, corpc_stream_local_internal_error);
+  }
+  channel_state_unlock();
+}
+
+static int64_t thread_cpu_us(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return (int64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static corpc_zctx * take_zctx(corpc_channel * channel)
+{
+  corpc_zctx * ctx;
+
+  channel_state_lock();
+  if ( (ctx = channel->zctx) ) {
+    channel->zctx = ctx->next;
+  }
+  channel_state_unlock();
+
+  return ctx ? ctx : corpc_zctx_new();
+}
+
+static void put_zctx(corpc_channel * channel, corpc_zctx * ctx)
+{
+  channel_state_lock();
+  ctx->next = channel->zctx;
+  channel->zctx = ctx;
+  channel_state_unlock();
+}
+
+// returns 0 if the message is better sent as is, -1 on zlib or malloc failure
+static ssize_t compress_message(corpc_stream * st, const void * data, size_t size, void ** out)
+{
+  corpc_channel * channel = st->channel;
+  corpc_zctx * ctx;
+  ssize_t outsize = -1;
+  int64_t t0, t1;
+
+  *out = NULL;
+
+  if ( !(ctx = take_zctx(channel)) ) {
+    return -1;
+  }
+
+  t0 = thread_cpu_us();
+  outsize = corpc_zctx_compress(ctx, st->compression, data, size, out);
+  t1 = thread_cpu_us();
+
+  put_zctx(channel, ctx);
+
+  channel_state_lock();
+  channel->zstats.compress_us += t1 - t0;
+  if ( outsize > 0 ) {
+    ++channel->zstats.compressed_messages;
+    channel->zstats.raw_bytes_out += size;
+    channel->zstats.compressed_bytes_out += outsize;
+  }
+  else if ( outsize == 0 ) {
+    ++channel->zstats.incompressible_messages;
+  }
+  channel_state_unlock();
+
+  return outsize;
+}
+
+static ssize_t decompress_message(corpc_stream * st, const void * data, size_t size, void ** out)
+{
+  corpc_channel * channel = st->channel;
+  corpc_zctx * ctx;
+  ssize_t outsize = -1;
+  int64_t t0, t1;
+
+  *out = NULL;
+
+  if ( !(ctx = take_zctx(channel)) ) {
+    return -1;
+  }
+
+  t0 = thread_cpu_us();
+  outsize = corpc_zctx_decompress(ctx, st->compression, data, size, out);
+  t1 = thread_cpu_us();
+
+  put_zctx(channel, ctx);
+
+  channel_state_lock();
+  channel->zstats.decompress_us += t1 - t0;
+  if ( outsize >= 0 ) {
+    channel->zstats.compressed_bytes_in += size;
+    channel->zstats.raw_bytes_in += outsize;
+  }
+  channel_state_unlock();
+
+  if ( outsize < 0 ) {
+    CF_CRITICAL("decompress_message(sid=%u) fails", st->sid);
+    abort_message(st);
+  }
+
+  return outsize;
+}
+
+// message lock must be acquired, comsg_flag_compressed goes on the first fragment only
+static bool send_message(corpc_stream * st, uint16_t flags, const void * data, size_t size)
+{
+  const size_t fragsize = max_fragment_size(st);
+  const uint8_t * p = data;
+  size_t n;
+
+  while ( size > fragsize ) {
+    if ( !send_data(st, flags | comsg_flag_more, p, n = fragsize) ) {
+      if ( p != data ) {
+        abort_message(st);
+      }
+      return false;
+    }
+    flags &= ~comsg_flag_compressed;
+    p += n, size -= n;
+  }
+
+  if ( !send_data(st, flags, p, size) ) {
+    if ( p != data ) {
+      abort_message(st);
+    }
+    return false;
+  }
+
+  return true;
+}
+
+void corpc_stream_cleanup(struct corpc_stream * st)
+{
+  comsg * msg;
+  while ( ccfifo_pop(&st->rxq, &msg) ) {
+    free(msg);
+  }
+  ccfifo_cleanup(&st->rxq);
+  free(st->wbuf.data);
+  memset(st, 0, sizeof(*st));
+}
+
+bool corpc_stream_init(struct corpc_stream * st, const corpc_stream_opts * args)
+{
+  bool fok = false;
+
+  memset(st, 0, sizeof(*st));
+
+  if ( ccfifo_init(&st->rxq, CORPC_STREAM_DEFAULT_QUEUE_SIZE, sizeof(comsg*)) ) {
+    st->channel = args->channel;
+    st->sid = args->sid;
+    st->did = args->did;
+    st->rwnd = args->rwnd;
+    st->caps = args->caps;
+    st->early = args->early;
+    st->unary = args->unary;
+    st->priority = args->priority;
+    st->compression = args->compression;
+    st->compression_threshold = args->compression_threshold ? args->compression_threshold :
+        CORPC_DEFAULT_COMPRESSION_THRESHOLD;
+    st->state = args->state;
+    rxwnd_init(&st->rx, args->rxwnd, args->max_rxwnd,
+        CORPC_STREAM_DEFAULT_RWND,
+        CORPC_STREAM_DEFAULT_MAX_RWND);
+    fok = true;
+  }
+
+  return fok;
+}
+
+void corpc_stream_destroy(corpc_stream ** st)
+{
+  if ( st && *st ) {
+    corpc_stream_cleanup(*st);
+    free(*st);
+    *st = NULL;
+  }
+}
+
+corpc_stream * corpc_stream_new(const corpc_stream_opts * args)
+{
+  corpc_stream * st = NULL;
+  bool fok = false;
+
+  if ( !(st = malloc(sizeof(*st))) ) {
+    goto end;
+  }
+
+  if ( !corpc_stream_init(st, args) ) {
+    goto end;
+  }
+
+  fok = true;
+
+end:
+
+  if ( !fok && st ) {
+    corpc_stream_destroy(&st);
+  }
+
+  return st;
+}
+
+enum corpc_stream_state corpc_get_stream_state(const corpc_stream * st)
+{
+  return st->state;
+}
+
+int corpc_stream_get_remaining_time(const corpc_stream * st)
+{
+  return stream_tmo(st);
+}
+
+void corpc_set_stream_state(struct corpc_stream * st, corpc_stream_state state)
+{
+  corpc_stream_state oldstate = st->state;
+  CF_NOTICE("%s -> %s", corpc_stream_state_string(oldstate), corpc_stream_state_string(state));
+  st->state = state;
+  channel_state_signal();
+}
+
+void * corpc_stream_get_channel_client_context(const corpc_stream * stream)
+{
+  return corpc_channel_get_client_context(stream->channel);
+}
+
+
+
+
+
+enum corpc_channel_state corpc_get_channel_state(const corpc_channel * channel)
+{
+  return channel->state;
+}
+
+
 bool corpc_channel_established(const corpc_channel * channel)
 {
   return (channel->state == corpc_channel_state_established);
 }
 
+size_t corpc_channel_get_nb_streams(const corpc_channel * channel)
+{
+  size_t n;
+  channel_state_lock();
+  n = ccarray_size(&channel->streams);
+  channel_state_unlock();
+  return n;
+}
+
+void corpc_channel_disable_caps(corpc_channel * channel, uint32_t caps)
+{
+  channel_state_lock();
+  channel->disabled_caps |= caps;
+  channel_state_unlock();
+}
+
 static corpc_stream * find_stream_by_sid(const struct corpc_channel * channel, uint16_t sid)
 {
   for ( size_t i = 0, n = ccarray_size(&channel->streams); i < n; ++i ) {
@@ -510,8 +1134,19 @@ static corpc_stream * find_stream_by_sid(const struct corpc_channel * channel, u
   return NULL;
 }
 
-static corpc_stream * accept_stream(corpc_channel * channel, uint16_t did, uint16_t rwnd,
-    create_stream_responce_code * status)
+static corpc_stream * find_stream_by_did(const struct corpc_channel * channel, uint16_t did)
+{
+  for ( size_t i = 0, n = ccarray_size(&channel->streams); i < n; ++i ) {
+    corpc_stream * st = ccarray_ppeek(&channel->streams, i);
+    if ( st->did == did ) {
+      return st;
+    }
+  }
+  return NULL;
+}
+
+static corpc_stream * accept_stream(corpc_channel * channel, const struct corpc_service * service,
+    uint16_t did, uint16_t rwnd, const comsg_stream_ext * ext, create_stream_responce_code * status)
 {
   corpc_stream * st = NULL;
 
@@ -528,7 +1163,15 @@ static corpc_stream * accept_stream(corpc_channel * channel, uint16_t did, uint1
         .state = corpc_stream_opening,
         .sid = gensid(),
         .did = did,
-        .rwnd = rwnd,
+        .rwnd = ext ? ext->rwnd : rwnd,
+        .caps = ext ? ext->caps & local_caps(channel) : 0,
+        .rxwnd = service->rwnd,
+        .max_rxwnd = service->max_rwnd,
+        .priority = ext && ext->priority < corpc_stream_priority_count ? ext->priority :
+            corpc_stream_priority_normal,
+        .compression = ext && (ext->caps & local_caps(channel) & corpc_cap_deflate)
+            && corpc_compression_supported(ext->compression) ?
+            ext->compression : corpc_compression_none,
       });
 
   if ( !st ) {
@@ -537,6 +1180,10 @@ static corpc_stream * accept_stream(corpc_channel * channel, uint16_t did, uint1
     goto end;
   }
 
+  if ( ext ) {
+    st->deadline = make_deadline(ext->deadline);
+  }
+
   ccarray_ppush_back(&channel->streams, st);
 
 end :
@@ -547,49 +1194,14 @@ end :
 }
 
 
-struct service_method_wrapper_thread_arg {
-  corpc_stream * st;
-  const struct corpc_service * service;
-  const struct corpc_service_method * method;
-};
-
-static void service_method_wrapper_thread(void * arg)
-{
-  struct service_method_wrapper_thread_arg * myarg = arg;
-  corpc_stream * st = myarg->st;
-  const struct corpc_service * service = myarg->service;
-  const struct corpc_service_method * method = myarg->method;
-  free(arg);
-
-  CF_DEBUG("C %s/%s()", service->name, method->name);
-  method->proc(st);
-  CF_DEBUG("R %s/%s()", service->name, method->name);
-
-  corpc_close_stream(&st);
-
-  CF_DEBUG("FINISHED");
-}
-
-static bool start_service_method_thread(corpc_stream * st, const struct corpc_service * service,
-    const struct corpc_service_method * method)
+static bool start_service_method_thread(corpc_stream * st, const corpc_method_entry * entry)
 {
-  struct service_method_wrapper_thread_arg * arg;
-  bool fok = false;
-
-  if ( !(arg = malloc(sizeof(*arg))) ) {
-    CF_CRITICAL("malloc(service_method_wrapper_thread_arg) fails: %s", strerror(errno));
-  }
-  else {
-    arg->st = st;
-    arg->service = service;
-    arg->method = method;
-    if ( !(fok = co_schedule(service_method_wrapper_thread, arg, CORPC_STREAM_DEFAULT_STACK_SIZE)) ) {
-      CF_CRITICAL("co_schedule(service_method_wrapper_thread) fails: %s", strerror(errno));
-      free(arg);
-    }
+  if ( !corpc_handler_pool_submit(entry->pool, st, entry->method) ) {
+    CF_CRITICAL("corpc_handler_pool_submit(%s/%s) fails: %s", entry->service->name, entry->method->name,
+        strerror(errno));
+    return false;
   }
-
-  return fok;
+  return true;
 }
 
 
@@ -619,12 +1231,13 @@ static bool on_create_stream_request(corpc_channel * channel, comsg ** msgp)
   uint16_t rwnd = rc->details.rwnd;
   uint16_t service_name_length = rc->details.service_name_length;
   uint16_t method_name_length = rc->details.method_name_length;
+  const char * service_name = (const char *) rc->details.pack;
+  const char * method_name = (const char *) rc->details.pack + service_name_length;
+  comsg_stream_ext extbuf;
+  const comsg_stream_ext * ext = corpc_proto_get_create_stream_request_ext(rc, &extbuf) ? &extbuf : NULL;
 
-  char service_name[service_name_length + 1];
-  char method_name[method_name_length + 1];
-
+  const corpc_method_entry * entry = NULL;
   const struct corpc_service * service = NULL;
-  const struct corpc_service_method * method = NULL;
   corpc_stream * st = NULL;
 
   bool fok = true;
@@ -633,54 +1246,59 @@ static bool on_create_stream_request(corpc_channel * channel, comsg ** msgp)
         create_stream_responce_internal_error;
 
 
-  if( !channel->services ) {
-    status = create_stream_responce_no_service;
-    goto end;
-  }
-
-
-  memcpy(service_name, rc->details.pack + 0, service_name_length);
-  memcpy(method_name, rc->details.pack + service_name_length, method_name_length);
-
-  service_name[service_name_length] = 0;
-  method_name[method_name_length] = 0;
-
-
-  for ( int i = 0; channel->services[i] != NULL; ++i ) {
-    if ( strcmp(service_name, channel->services[i]->name) == 0 ) {
-      service = channel->services[i];
-      break;
+  // a peer without byte windows knows no extension, nor does the local side then
+  if ( ext && (ext->caps & local_caps(channel) & corpc_cap_byte_window) ) {
+    channel_state_lock();
+    if ( !channel->peer_caps ) {
+      channel->peer_caps = ext->caps;
+      channel->swnd = ext->chwnd;
     }
+    channel_state_unlock();
+  }
+  else {
+    ext = NULL;
   }
 
-  if ( !service ) {
-    CF_CRITICAL("Requested service '%s' not found", service_name);
+  if( !channel->methods ) {
     status = create_stream_responce_no_service;
     goto end;
   }
 
 
-  for ( int i = 0; service->methods[i].name != NULL; ++i ) {
-    if ( strcmp(method_name, service->methods[i].name) == 0 ) {
-      method = &service->methods[i];
-      break;
+  if ( ext && ext->method_id ) {
+    if ( !(entry = corpc_method_table_find(channel->methods, ext->method_id)) ) {
+      CF_CRITICAL("Requested method id 0x%08X not found", ext->method_id);
+      status = create_stream_responce_no_method;
+      goto end;
     }
   }
+  else if ( !(entry = corpc_method_table_find_by_name(channel->methods, service_name, service_name_length,
+      method_name, method_name_length)) ) {
+
+    if ( !corpc_method_table_find_service(channel->methods, service_name, service_name_length) ) {
+      CF_CRITICAL("Requested service '%.*s' not found", service_name_length, service_name);
+      status = create_stream_responce_no_service;
+    }
+    else {
+      CF_CRITICAL("Requested method '%.*s' on service '%.*s' not found", method_name_length, method_name,
+          service_name_length, service_name);
+      status = create_stream_responce_no_method;
+    }
 
-  if ( !method ) {
-    CF_CRITICAL("Requested method '%s' on service '%s' not found", method_name, service_name);
-    status = create_stream_responce_no_method;
     goto end;
   }
 
-  if ( !(st = accept_stream(channel, did, rwnd, &status)) ) {
-    CF_CRITICAL("accept_stream(did=%u) fails", did);
+  service = entry->service;
+
+  if ( !corpc_handler_pool_admit(entry->pool) ) {
+    CF_CRITICAL("%s/%s: new stream refused: %s", service->name, entry->method->name, strerror(errno));
+    status = errno == EBUSY ? create_stream_responce_no_stream_resources :
+        create_stream_responce_internal_error;
     goto end;
   }
 
-  if ( !start_service_method_thread(st, service, method) ) {
-    CF_CRITICAL("start_service_method_thread(%s/%s) fails", service->name, method->name);
-    status = create_stream_responce_internal_error;
+  if ( !(st = accept_stream(channel, service, did, rwnd, ext, &status)) ) {
+    CF_CRITICAL("accept_stream(did=%u) fails", did);
     goto end;
   }
 
@@ -689,8 +1307,15 @@ static bool on_create_stream_request(corpc_channel * channel, comsg ** msgp)
 
 end:
 
-  if ( !send_create_stream_responce(channel, sid, did, srwnd(st), status) ) {
+  if ( !send_create_stream_responce(channel, sid, did, srwnd(st), status,
+      !ext ? NULL : &(comsg_stream_ext ) {
+            .caps = local_caps(channel),
+            .rwnd = st ? st->rx.size : 0,
+            .chwnd = channel->rx.size,
+            .compression = st ? st->compression : corpc_compression_none,
+          }) ) {
     CF_CRITICAL("send_create_stream_responce() fails");
+    status = create_stream_responce_internal_error;
   }
 
   if ( st ) {
@@ -708,14 +1333,46 @@ end:
     channel_state_unlock();
   }
 
+  // the handler starts after create_stream_resp went out, so its frames can't overtake it
+  if ( st && !start_service_method_thread(st, entry) ) {
+
+    if ( !send_close_notify(channel, sid, did) ) {
+      CF_CRITICAL("send_close_notify() fails");
+    }
+
+    channel_state_lock();
+    ccarray_erase_item(&channel->streams, &st);
+    corpc_stream_destroy(&st);
+    channel_state_unlock();
+  }
+
   return fok;
 }
 
 
+static corpc_stream_state responce_stream_state(uint16_t status)
+{
+  switch ( status ) {
+    case create_stream_responce_ok :
+      return corpc_stream_established;
+    case create_stream_responce_no_stream_resources :
+      return corpc_stream_too_many_streams;
+    case create_stream_responce_no_service :
+      return corpc_stream_no_such_service;
+    case create_stream_responce_no_method :
+      return corpc_stream_no_such_method;
+    case create_stream_responce_internal_error :
+      return corpc_stream_remote_internal_error;
+  }
+  return corpc_stream_protocol_error;
+}
+
 static bool on_create_stream_responce(corpc_channel * channel, comsg ** msgp)
 {
   corpc_stream * st;
   const comsg_create_stream_responce * resp = &(*msgp)->create_stream_responce;
+  comsg_stream_ext extbuf;
+  const comsg_stream_ext * ext = corpc_proto_get_create_stream_responce_ext(resp, &extbuf) ? &extbuf : NULL;
   corpc_stream_state state;
 
   uint16_t sid = resp->hdr.did;
@@ -723,41 +1380,58 @@ static bool on_create_stream_responce(corpc_channel * channel, comsg ** msgp)
 
   channel_state_lock();
 
+  if ( ext && !(ext->caps & local_caps(channel) & corpc_cap_byte_window) ) {
+    ext = NULL;
+  }
+
+  if ( ext && !channel->peer_caps ) {
+    channel->peer_caps = ext->caps;
+    channel->swnd = ext->chwnd;
+  }
+
   if ( !(st = find_stream_by_sid(channel, sid)) ) {
-    CF_CRITICAL("find_stream_by_sid(sid=%u) fails", sid);
-    fok = false;
-    errno = EPROTO;
+    // the opener has given up, let the peer free the stream
+    CF_NOTICE("No stream for create_stream_resp sid=%u", sid);
+    if ( resp->details.status == create_stream_responce_ok ) {
+      channel_state_unlock();
+      send_close_notify(channel, sid, resp->hdr.sid);
+      return true;
+    }
   }
   else if ( st->state != corpc_stream_opening ) {
     CF_CRITICAL("BUG: Invalid stream state : sid=%u state=%s", sid, corpc_stream_state_string(st->state));
   }
   else {
 
-    switch ( resp->details.status ) {
-      case create_stream_responce_ok :
-        state = corpc_stream_established;
+    switch ( state = responce_stream_state(resp->details.status) ) {
+      case corpc_stream_established :
         st->did = resp->hdr.sid;
-        st->rwnd = resp->details.rwnd;
-        CF_NOTICE("SET st->rwnd=%u", st->rwnd);
-      break;
-      case create_stream_responce_no_stream_resources :
-        state = corpc_stream_too_many_streams;
+        if ( !ext ) {
+          st->rwnd = resp->details.rwnd;
+        }
+        else if ( st->early ) {
+          // early data was sent against the minimal window, credits may have come already.
+          // Peers never announce less, don't let a broken one wrap the window
+          st->caps = ext->caps & local_caps(channel);
+          if ( ext->rwnd > CORPC_MIN_RWND ) {
+            st->rwnd += ext->rwnd - CORPC_MIN_RWND;
+          }
+        }
+        else {
+          st->caps = ext->caps & local_caps(channel);
+          st->rwnd = ext->rwnd;
+        }
+        if ( ext && corpc_compression_supported(ext->compression) ) {
+          st->compression = ext->compression;
+        }
+        CF_NOTICE("SET st->rwnd=%u caps=0x%X", st->rwnd, st->caps);
       break;
-      case create_stream_responce_no_service :
-        state = corpc_stream_no_such_service;
-      break;
-      case create_stream_responce_no_method :
-        state = corpc_stream_no_such_method;
-      break;
-      case create_stream_responce_internal_error :
-        state = corpc_stream_remote_internal_error;
-      break;
-      case create_stream_responce_protocol_error :
-        default :
-        state = corpc_stream_protocol_error;
+      case corpc_stream_protocol_error :
         fok = false;
         errno = EPROTO;
       break;
+      default :
+      break;
     }
 
     if ( state != corpc_stream_established ) {
@@ -778,7 +1452,15 @@ static bool on_close_stream_notify(corpc_channel * channel, comsg ** msgp)
 
   channel_state_lock();
 
-  if ( (st = find_stream_by_sid(channel, (*msgp)->hdr.did)) ) {
+  if ( !(*msgp)->hdr.did ) {
+    // cancel of a call or of a stream whose create_stream_resp the peer hasn't got yet
+    st = find_stream_by_did(channel, (*msgp)->hdr.sid);
+  }
+  else {
+    st = find_stream_by_sid(channel, (*msgp)->hdr.did);
+  }
+
+  if ( st ) {
     corpc_set_stream_state(st, corpc_stream_closed_by_remote_party);
   }
 
@@ -789,16 +1471,66 @@ static bool on_close_stream_notify(corpc_channel * channel, comsg ** msgp)
 static bool on_data_message(corpc_channel * channel, comsg ** msgp)
 {
   corpc_stream * st;
+  const bool early = (comsg_flags(&(*msgp)->hdr) & comsg_flag_early) != 0;
+  uint16_t size = (*msgp)->hdr.pldsize;
   bool fok = true;
 
   channel_state_lock();
 
-
-  if ( !(st = find_stream_by_sid(channel, (*msgp)->hdr.did)) ) {
-    CF_CRITICAL("find_stream_by_sid(did=%u) fails", (*msgp)->hdr.did);
-    corpc_set_stream_state(st, corpc_stream_protocol_error);
+  if ( early && !(st = find_stream_by_did(channel, (*msgp)->hdr.sid)) ) {
+    // the stream was not accepted, the sender learns it from create_stream_resp
+    channel_state_unlock();
+    if ( !send_channel_credit(channel, (*msgp)->hdr.sid, size) ) {
+      CF_CRITICAL("send_channel_credit() fails");
+    }
+    return true;
+  }
+
+  if ( !early && !(st = find_stream_by_sid(channel, (*msgp)->hdr.did)) ) {
+    // the stream is already closed here while the peer was still sending, drop the frame
+    channel_state_unlock();
+    CF_DEBUG("Drop data for closed stream sid=%u", (*msgp)->hdr.did);
+    if ( !send_channel_credit(channel, (*msgp)->hdr.sid, size) ) {
+      CF_CRITICAL("send_channel_credit() fails");
+    }
+    return true;
+  }
+
+  if ( (comsg_flags(&(*msgp)->hdr) & comsg_flag_nocrc) && !(st->caps & corpc_cap_nocrc) ) {
+    CF_CRITICAL("Unexpected data without crc for sid=%u", st->sid);
+    corpc_set_stream_state(st, corpc_stream_protocol_error);
     fok = false, errno = EPROTO;
   }
+  else if ( (comsg_flags(&(*msgp)->hdr) & comsg_flag_compressed) && !st->compression ) {
+    CF_CRITICAL("Unexpected compressed data for sid=%u", st->sid);
+    corpc_set_stream_state(st, corpc_stream_protocol_error);
+    fok = false, errno = EPROTO;
+  }
+  else if ( byte_window(st) ) {
+
+    comsg * msg;
+
+    if ( !rxwnd_receive(&st->rx, size) || !rxwnd_receive(&channel->rx, size) ) {
+      CF_CRITICAL("Receive window overrun for sid=%u: size=%u stream inflight=%u/%u channel inflight=%u/%u",
+          st->sid, size, st->rx.inflight, st->rx.size, channel->rx.inflight, channel->rx.size);
+      corpc_set_stream_state(st, corpc_stream_protocol_error);
+      fok = false, errno = EPROTO;
+    }
+    else if ( ccfifo_is_full(&st->rxq) && !ccfifo_realloc(&st->rxq, 2 * ccfifo_capacity(&st->rxq)) ) {
+      CF_CRITICAL("ccfifo_realloc(rxq) fails for sid=%u: %s", st->sid, strerror(errno));
+      corpc_set_stream_state(st, corpc_stream_local_internal_error);
+      fok = false;
+    }
+    else {
+      // the window may hold many small messages, don't keep max-sized buffers for them
+      if ( (msg = realloc(*msgp, sizeof(msg->hdr) + size)) ) {
+        *msgp = msg;
+      }
+      ccfifo_push(&st->rxq, msgp);
+      *msgp = NULL;
+      channel_state_signal();
+    }
+  }
   else if ( ccfifo_is_full(&st->rxq) ) {
     // app or party bug
     CF_FATAL("BUG BUG BUG: ccfifo is full for sid=%u", st->sid);
@@ -824,6 +1556,7 @@ static bool on_data_ack(corpc_channel * channel, comsg ** msgp)
 
   if ( (st = find_stream_by_sid(channel, msg->hdr.did)) ) {
     ++st->rwnd;
+    grant_write_lock(channel);
     channel_state_signal();
   }
 
@@ -831,6 +1564,162 @@ static bool on_data_ack(corpc_channel * channel, comsg ** msgp)
   return true;
 }
 
+static bool on_window_update(corpc_channel * channel, comsg ** msgp)
+{
+  corpc_stream * st;
+  const comsg_window_update * msg = &(*msgp)->window_update;
+
+  channel_state_lock();
+
+  // stream may be already closed, the channel credit still counts
+  if ( (st = find_stream_by_sid(channel, msg->hdr.did)) && byte_window(st) ) {
+    st->rwnd += msg->details.credit;
+  }
+
+  channel->swnd += msg->details.chcredit;
+  grant_write_lock(channel);
+  channel_state_signal();
+
+  channel_state_unlock();
+  return true;
+}
+
+
+
+static bool on_call_request(corpc_channel * channel, comsg ** msgp)
+{
+  const comsg_call_request * rq = &(*msgp)->call_request;
+  const uint16_t did = rq->hdr.sid;
+  const uint16_t size = rq->hdr.pldsize - offsetof(struct comsg_call_request, details.bits) + sizeof(rq->hdr);
+  const uint32_t deadline = rq->details.deadline;
+  const corpc_method_entry * entry;
+  corpc_stream * st = NULL;
+
+  create_stream_responce_code status =
+      create_stream_responce_internal_error;
+
+  if ( (comsg_flags(&rq->hdr) & comsg_flag_nocrc) && !(local_caps(channel) & corpc_cap_nocrc) ) {
+    CF_CRITICAL("Unexpected call without crc from sid=%u", did);
+    errno = EPROTO;
+    return false;
+  }
+
+  if ( !(entry = corpc_method_table_find(channel->methods, rq->details.method_id)) ) {
+    CF_CRITICAL("Requested method id 0x%08X not found", rq->details.method_id);
+    status = create_stream_responce_no_method;
+    goto end;
+  }
+
+  if ( !corpc_handler_pool_admit(entry->pool) ) {
+    CF_CRITICAL("%s/%s: call refused: %s", entry->service->name, entry->method->name, strerror(errno));
+    status = errno == EBUSY ? create_stream_responce_no_stream_resources :
+        create_stream_responce_internal_error;
+    goto end;
+  }
+
+  channel_state_lock();
+
+  if ( ccarray_size(&channel->streams) >= ccarray_capacity(&channel->streams) ) {
+    CF_CRITICAL("Too many streams");
+    status = create_stream_responce_no_stream_resources;
+  }
+  else if ( !(st = corpc_stream_new(&(struct corpc_stream_opts ) {
+        .channel = channel,
+        .state = corpc_stream_established,
+        .sid = gensid(),
+        .did = did,
+        .caps = channel->peer_caps & local_caps(channel) & (corpc_cap_fragments | corpc_cap_nocrc),
+        .rxwnd = entry->service->rwnd,
+        .max_rxwnd = entry->service->max_rwnd,
+        .unary = true,
+      })) ) {
+    CF_CRITICAL("corpc_stream_new() fails");
+  }
+  else {
+    st->deadline = make_deadline(deadline);
+    // the request becomes the only data message of the stream
+    memmove((*msgp)->data.details.bits, (*msgp)->call_request.details.bits, size);
+    (*msgp)->hdr.code = co_msg_data;
+    (*msgp)->hdr.pldsize = size;
+    ccfifo_push(&st->rxq, msgp);
+    *msgp = NULL;
+    ccarray_ppush_back(&channel->streams, st);
+  }
+
+  channel_state_unlock();
+
+  if ( !st ) {
+    goto end;
+  }
+
+  if ( !start_service_method_thread(st, entry) ) {
+    status = errno == EBUSY ? create_stream_responce_no_stream_resources :
+        create_stream_responce_internal_error;
+    channel_state_lock();
+    ccarray_erase_item(&channel->streams, &st);
+    channel_state_unlock();
+    free(ccfifo_ppop(&st->rxq));
+    corpc_stream_destroy(&st);
+    goto end;
+  }
+
+  status = create_stream_responce_ok;
+
+end:
+
+  if ( status != create_stream_responce_ok && !send_call_status(channel, did, status) ) {
+    CF_CRITICAL("send_call_status() fails");
+  }
+
+  return true;
+}
+
+static bool on_call_responce(corpc_channel * channel, comsg ** msgp)
+{
+  const comsg_call_responce * resp = &(*msgp)->call_responce;
+  const uint16_t flags = comsg_flags(&resp->hdr);
+  const uint16_t size = resp->hdr.pldsize - sizeof(resp->details.status);
+  corpc_stream_state state;
+  corpc_stream * st;
+  bool fok = true;
+
+  channel_state_lock();
+
+  if ( !(st = find_stream_by_sid(channel, resp->hdr.did)) || !st->unary ) {
+    // the caller has given up already
+    CF_DEBUG("Drop call responce for sid=%u", resp->hdr.did);
+  }
+  else if ( (flags & comsg_flag_nocrc) && !(st->caps & corpc_cap_nocrc) ) {
+    CF_CRITICAL("Unexpected call responce without crc for sid=%u", st->sid);
+    corpc_set_stream_state(st, corpc_stream_protocol_error);
+    fok = false, errno = EPROTO;
+  }
+  else if ( (state = responce_stream_state(resp->details.status)) != corpc_stream_established ) {
+    CF_CRITICAL("Call %u fails: %s", st->sid, corpc_stream_state_string(state));
+    corpc_set_stream_state(st, state);
+  }
+  else if ( ccfifo_is_full(&st->rxq) && !ccfifo_realloc(&st->rxq, 2 * ccfifo_capacity(&st->rxq)) ) {
+    CF_CRITICAL("ccfifo_realloc(rxq) fails for sid=%u: %s", st->sid, strerror(errno));
+    corpc_set_stream_state(st, corpc_stream_local_internal_error);
+  }
+  else {
+    memmove((*msgp)->data.details.bits, (*msgp)->call_responce.details.bits, size);
+    (*msgp)->hdr.code = co_msg_data | (flags & comsg_flag_more);
+    (*msgp)->hdr.pldsize = size;
+    ccfifo_push(&st->rxq, msgp);
+    *msgp = NULL;
+    if ( flags & comsg_flag_more ) {
+      channel_state_signal();
+    }
+    else {
+      // complete responce is queued, nothing to cancel on close
+      corpc_set_stream_state(st, corpc_stream_closed);
+    }
+  }
+
+  channel_state_unlock();
+  return fok;
+}
 
 
 
@@ -855,6 +1744,9 @@ static void corpc_channel_thread(void * arg)
     if ( !(fok = co_ssl_accept(channel->ssl_sock)) ) {
       CF_CRITICAL("co_ssl_socket_accept() fails");
     }
+    else if ( channel->shm && !(fok = co_ssl_socket_shm_accept(channel->ssl_sock)) ) {
+      CF_CRITICAL("co_ssl_socket_shm_accept() fails");
+    }
     else if ( channel->onaccept && !(fok = channel->onaccept(channel)) ) {
       CF_CRITICAL("channel->onaccept() fails");
     }
@@ -886,7 +1778,7 @@ static void corpc_channel_thread(void * arg)
 
   while ( corpc_proto_recv_msg(channel->ssl_sock, msg) ) {
 
-    switch ( msg->hdr.code ) {
+    switch ( comsg_code(&msg->hdr) ) {
 
       case co_msg_create_stream_req :
         fok = on_create_stream_request(channel, &msg);
@@ -908,6 +1800,18 @@ static void corpc_channel_thread(void * arg)
         fok = on_data_ack(channel, &msg);
       break;
 
+      case co_msg_window_update :
+        fok = on_window_update(channel, &msg);
+      break;
+
+      case co_msg_call_req :
+        fok = on_call_request(channel, &msg);
+      break;
+
+      case co_msg_call_resp :
+        fok = on_call_responce(channel, &msg);
+      break;
+
       default :
         CF_CRITICAL("Unknown message code received: %u", msg->hdr.code);
         fok = false;
@@ -1038,27 +1942,102 @@ bool corpc_channel_get_sockname(const corpc_channel * channel, struct sockaddr *
   return co_ssl_socket_get_sockname(channel->ssl_sock, addrs, addrslen);
 }
 
+bool corpc_channel_get_service_stats(const corpc_channel * channel, const char * service,
+    struct corpc_service_stats * stats)
+{
+  const corpc_method_entry * e;
+
+  if ( !channel || !service || !stats ) {
+    errno = EINVAL;
+    return false;
+  }
+
+  if ( !(e = corpc_method_table_find_service(channel->methods, service, strlen(service))) ) {
+    errno = ENOENT;
+    return false;
+  }
+
+  corpc_handler_pool_get_stats(e->pool, stats);
+
+  return true;
+}
+
+bool corpc_channel_get_compression_stats(const corpc_channel * channel,
+    struct corpc_compression_stats * stats)
+{
+  if ( !channel || !stats ) {
+    errno = EINVAL;
+    return false;
+  }
+
+  channel_state_lock();
+  *stats = channel->zstats;
+  channel_state_unlock();
+
+  return true;
+}
+
+
+// "unix:/path/to/socket" or "shm:/path/to/socket"
+static bool get_unix_address(const char * address, struct sockaddr_un * sun, bool * shm)
+{
+  size_t prefix;
+
+  if ( !address ) {
+    return false;
+  }
+
+  if ( strncmp(address, CORPC_UNIX_ADDRESS_PREFIX, prefix = sizeof(CORPC_UNIX_ADDRESS_PREFIX) - 1) == 0 ) {
+    *shm = false;
+  }
+  else if ( strncmp(address, CORPC_SHM_ADDRESS_PREFIX, prefix = sizeof(CORPC_SHM_ADDRESS_PREFIX) - 1) == 0 ) {
+    *shm = true;
+  }
+  else {
+    return false;
+  }
+
+  memset(sun, 0, sizeof(*sun));
+  sun->sun_family = AF_UNIX;
+  strncpy(sun->sun_path, address + prefix, sizeof(sun->sun_path) - 1);
+
+  return true;
+}
 
 static bool ssl_server_connect(corpc_channel * channel)
 {
   struct addrinfo * ai = NULL;
+  sockaddr_type un;
+  const struct sockaddr * addrs;
   co_ssl_socket * ssl_sock = NULL;
+  bool shm = false;
   bool fok = false;
 
-  set_channel_state(channel, corpc_channel_state_resolving, 0, true);
-
-  if ( !co_server_resolve(&ai, channel->connect_opts.connect_address, channel->connect_opts.connect_port,
-      channel->connect_opts.connect_tmout_ms) ) {
-    CF_CRITICAL("co_server_resolve() fails: %s", strerror(errno));
-    goto end;
+  if ( get_unix_address(channel->connect_opts.connect_address, &un.un, &shm) ) {
+    addrs = &un.sa;
   }
+  else {
+
+    set_channel_state(channel, corpc_channel_state_resolving, 0, true);
+
+    if ( !co_server_resolve(&ai, channel->connect_opts.connect_address, channel->connect_opts.connect_port,
+        channel->connect_opts.connect_tmout_ms) ) {
+      CF_CRITICAL("co_server_resolve() fails: %s", strerror(errno));
+      goto end;
+    }
 
-  CF_DEBUG("ai->ai_family=%d", ai->ai_family);
-  if ( ai->ai_family == AF_INET ) {
-    CF_DEBUG("resolved to %s", inet_ntoa(((struct sockaddr_in* )ai->ai_addr)->sin_addr));
+    CF_DEBUG("ai->ai_family=%d", ai->ai_family);
+    if ( ai->ai_family == AF_INET ) {
+      CF_DEBUG("resolved to %s", inet_ntoa(((struct sockaddr_in* )ai->ai_addr)->sin_addr));
+    }
+
+    addrs = ai->ai_addr;
   }
 
-  if ( !(ssl_sock = co_ssl_socket_create_new(ai->ai_family, SOCK_STREAM, IPPROTO_TCP, channel->ssl_ctx)) ) {
+  channel->local = addrs->sa_family == AF_UNIX;
+
+  if ( !(ssl_sock = co_ssl_socket_create_new(addrs->sa_family, SOCK_STREAM, channel->local ? 0 : IPPROTO_TCP,
+      channel->ssl_ctx)) ) {
     CF_CRITICAL("co_ssl_socket_create_new() fails : %s ", strerror(errno));
     goto end;
   }
@@ -1068,11 +2047,16 @@ static bool ssl_server_connect(corpc_channel * channel)
   set_channel_state(channel, corpc_channel_state_connecting, 0, false);
   channel_state_unlock();
 
-  if ( !co_ssl_socket_connect(channel->ssl_sock, ai->ai_addr, channel->connect_opts.connect_tmout_ms) ) {
+  if ( !co_ssl_socket_connect(channel->ssl_sock, addrs, channel->connect_opts.connect_tmout_ms) ) {
     CF_CRITICAL("co_ssl_connect() fails");
     goto end;
   }
 
+  if ( shm && !co_ssl_socket_shm_connect(channel->ssl_sock, 0) ) {
+    CF_CRITICAL("co_ssl_socket_shm_connect() fails");
+    goto end;
+  }
+
   if ( channel->onconnect && !channel->onconnect(channel) )  {
     CF_CRITICAL("channel->onconnect() returns false");
     goto end;
@@ -1138,8 +2122,16 @@ bool corpc_channel_accept(corpc_listening_port * clp, co_ssl_socket * accepted_s
     channel->state = corpc_channel_state_accepting;
     channel->ssl_sock = accepted_sock;
     channel->services = clp->services;
+    channel->methods = clp->methods;
+    corpc_method_table_addref(channel->methods);
     channel->keep_alive = clp->keep_alive;
     channel->ssl_ctx = clp->base.ssl_ctx;
+    channel->nocrc = clp->nocrc;
+    channel->local = clp->base.listen_address.sa.sa_family == AF_UNIX;
+    channel->shm = channel->local && clp->shm;
+    rxwnd_init(&channel->rx, clp->chwnd, clp->max_chwnd,
+        CORPC_CHANNEL_DEFAULT_RWND,
+        CORPC_CHANNEL_DEFAULT_MAX_RWND);
     channel->onaccept = clp->onaccept;
     channel->onaccepted = clp->onaccepted;
     channel->ondisconnected = clp->ondisconnected;
@@ -1155,9 +2147,10 @@ bool corpc_channel_accept(corpc_listening_port * clp, co_ssl_socket * accepted_s
 
 
 
-static corpc_stream * create_new_stream(corpc_channel * channel)
+static corpc_stream * create_new_stream(corpc_channel * channel, const corpc_open_stream_opts * opts)
 {
   corpc_stream * st = NULL;
+  bool early;
 
   channel_state_lock();
 
@@ -1167,11 +2160,23 @@ static corpc_stream * create_new_stream(corpc_channel * channel)
     goto end;
   }
 
+  early = opts->pipelined && (channel->peer_caps & corpc_cap_early_data)
+      && (channel->peer_caps & corpc_cap_byte_window);
+
+  // until create_stream_resp is received the peer window is assumed to be minimal
   st = corpc_stream_new(&(corpc_stream_opts ) {
         .channel = channel,
         .state = corpc_stream_opening,
         .sid = gensid(),
         .did = 0,
+        .rwnd = early ? CORPC_MIN_RWND : 0,
+        .caps = early ? channel->peer_caps & local_caps(channel) : 0,
+        .rxwnd = opts->rwnd,
+        .max_rxwnd = opts->max_rwnd,
+        .early = early,
+        .priority = opts->priority < corpc_stream_priority_count ? opts->priority :
+            corpc_stream_priority_normal,
+        .compression_threshold = opts->compression_threshold,
       });
 
   if ( !st ) {
@@ -1179,6 +2184,8 @@ static corpc_stream * create_new_stream(corpc_channel * channel)
     goto end;
   }
 
+  st->deadline = make_deadline(opts->tmo);
+
   ccarray_ppush_back(&channel->streams, st);
 
 end:
@@ -1198,19 +2205,27 @@ corpc_stream * corpc_open_stream(corpc_channel * channel, const corpc_open_strea
     CF_CRITICAL("Invalid channel state: %s", corpc_channel_state_string(channel->state));
     errno = ENOTCONN;
   }
-  else if ( !(st = create_new_stream(channel)) ) {
+  else if ( !(st = create_new_stream(channel, opts)) ) {
     CF_CRITICAL("create_new_stream() fails");
   }
-  else if ( !send_create_stream_request(st, opts->service, opts->method) ) {
+  else if ( !send_create_stream_request(st, opts->service, opts->method,
+      corpc_compression_supported(opts->compression) ? opts->compression : corpc_compression_none) ) {
     CF_CRITICAL("send_create_stream_request() fails");
   }
+  else if ( st->early ) {
+    fok = true;
+  }
   else {
+    int tmo = -1;
     channel_state_lock();
-    while ( corpc_channel_established(channel) && st->state == corpc_stream_opening ) {
-      channel_state_wait(-1);
+    while ( corpc_channel_established(channel) && st->state == corpc_stream_opening && (tmo = stream_tmo(st)) ) {
+      channel_state_wait(tmo);
     }
     if ( !(fok = (st->state == corpc_stream_established)) ) {
-      CF_CRITICAL("NOT ESTABLISHED: %s", corpc_stream_state_string(st->state));
+      CF_CRITICAL("NOT ESTABLISHED: %s", tmo ? corpc_stream_state_string(st->state) : "timeout");
+      if ( !tmo ) {
+        errno = ETIME;
+      }
     }
     channel_state_unlock();
   }
@@ -1227,10 +2242,123 @@ corpc_stream * corpc_open_stream(corpc_channel * channel, const corpc_open_strea
 
 
 
+static bool peer_supports_calls(corpc_channel * channel)
+{
+  bool fok;
+  channel_state_lock();
+  fok = (channel->peer_caps & corpc_cap_unary) && (channel->peer_caps & corpc_cap_method_id);
+  channel_state_unlock();
+  return fok;
+}
+
+// corpc_call() timeout as stream deadline, 0 and -1 both mean none
+static uint32_t call_tmo(int tmo)
+{
+  return tmo > 0 ? tmo : 0;
+}
+
+static corpc_stream * create_call_stream(corpc_channel * channel, int tmo)
+{
+  corpc_stream * st = NULL;
+
+  channel_state_lock();
+
+  if ( ccarray_size(&channel->streams) >= ccarray_capacity(&channel->streams) ) {
+    CF_CRITICAL("NO STREAM RESOURCES");
+    errno = ENOSR;
+  }
+  else if ( !(st = corpc_stream_new(&(corpc_stream_opts ) {
+        .channel = channel,
+        .state = corpc_stream_opening,
+        .sid = gensid(),
+        .did = 0,
+        .caps = channel->peer_caps & local_caps(channel) & (corpc_cap_fragments | corpc_cap_nocrc),
+        .unary = true,
+      })) ) {
+    CF_CRITICAL("corpc_stream_new() fails");
+  }
+  else {
+    st->deadline = make_deadline(call_tmo(tmo));
+    ccarray_ppush_back(&channel->streams, st);
+  }
+
+  channel_state_unlock();
+
+  return st;
+}
+
+static bool call_over_stream(corpc_channel * channel, const char * service, const char * method,
+    const void * data, size_t size, bool (*unpack)(void *, const void *, size_t), void * responce,
+    int tmo)
+{
+  corpc_stream * st;
+  bool fok = false;
+
+  st = corpc_open_stream(channel, &(corpc_open_stream_opts ) {
+        .service = service,
+        .method = method,
+        .tmo = call_tmo(tmo),
+      });
+
+  if ( !st ) {
+    CF_CRITICAL("corpc_open_stream(%s/%s) fails", service, method);
+    return false;
+  }
+
+  if ( corpc_stream_write(st, data, size) ) {
+    fok = corpc_stream_read_msg(st, unpack, responce);
+  }
+
+  corpc_close_stream(&st);
+
+  return fok;
+}
+
+bool corpc_call(corpc_channel * channel, const char * service, const char * method,
+    size_t (*pack)(const void *, void **), const void * request,
+    bool (*unpack)(void *, const void *, size_t), void * responce,
+    int tmo)
+{
+  corpc_stream * st = NULL;
+  void * data = NULL;
+  size_t size;
+  bool fok = false;
+
+  if ( !corpc_channel_established(channel) ) {
+    CF_CRITICAL("Invalid channel state: %s", corpc_channel_state_string(channel->state));
+    errno = ENOTCONN;
+  }
+  else if ( !(size = pack(request, &data)) ) {
+    CF_CRITICAL("pack(%s/%s request) fails", service, method);
+  }
+  else if ( size > CORPC_MAX_CALL_REQUEST_SIZE || !peer_supports_calls(channel) ) {
+    fok = call_over_stream(channel, service, method, data, size, unpack, responce, tmo);
+  }
+  else if ( !(st = create_call_stream(channel, tmo)) ) {
+    CF_CRITICAL("create_call_stream() fails");
+  }
+  else if ( !send_call_request(st, corpc_method_id(service, method), data, size) ) {
+    CF_CRITICAL("send_call_request() fails");
+  }
+  else {
+    if ( !(fok = corpc_stream_read_msg(st, unpack, responce)) ) {
+      CF_CRITICAL("%s/%s call fails: %s", service, method, corpc_stream_state_string(st->state));
+    }
+  }
+
+  corpc_close_stream(&st);
+  free(data);
+
+  return fok;
+}
+
+
 static bool corpc_stream_read_internal(struct corpc_stream * st, struct comsg ** out)
 {
   corpc_channel * channel = st->channel;
+  uint32_t credit = 0, chcredit = 0;
   bool is_connected;
+  int64_t ct = 0;
 
   *out = NULL;
 
@@ -1238,45 +2366,135 @@ static bool corpc_stream_read_internal(struct corpc_stream * st, struct comsg **
 
   while ( ccfifo_is_empty(&st->rxq) && corpc_channel_established(channel)
       && (st->state == corpc_stream_established || st->state == corpc_stream_opening) ) {
-    channel_state_wait(-1);
+
+    if ( st->deadline && (ct = cf_get_monotic_ms()) >= st->deadline ) {
+      errno = ETIME;
+      break;
+    }
+
+    channel_state_wait(st->deadline ? (int) (st->deadline - ct) : -1);
   }
 
   *out = ccfifo_ppop(&st->rxq);
-  is_connected = corpc_channel_established(channel) && (st->state == corpc_stream_established);
+  // accepted stream may be read while its create_stream_resp is not yet sent
+  is_connected = corpc_channel_established(channel)
+      && (st->state == corpc_stream_established || (st->state == corpc_stream_opening && st->did));
+
+  if ( *out && byte_window(st) ) {
+    rxwnd_consume(&st->rx, (*out)->hdr.pldsize);
+    rxwnd_consume(&channel->rx, (*out)->hdr.pldsize);
+    credit = rxwnd_take_credit(&st->rx, false);
+    chcredit = rxwnd_take_credit(&channel->rx, false);
+  }
 
   channel_state_unlock();
 
 
   if ( *out ) {
-    if ( (*out)->hdr.code != co_msg_data ) {
+    if ( comsg_code(&(*out)->hdr) != co_msg_data ) {
       CF_CRITICAL("invalid message code %u when expected co_msg_data=%u st=%d", (*out)->hdr.code, co_msg_data, st->sid);
       free(*out), *out = NULL;
     }
-    else if ( is_connected && !send_data_ack(st) ) {
-      CF_CRITICAL("send_data_ack() fails");
+    else if ( !is_connected || st->unary ) {
+      // peer doesn't need credit anymore, or never did
+    }
+    else if ( !byte_window(st) ) {
+      if ( !send_data_ack(st) ) {
+        CF_CRITICAL("send_data_ack() fails");
+      }
+    }
+    else if ( (credit || chcredit) && !send_window_update(st, credit, chcredit) ) {
+      CF_CRITICAL("send_window_update() fails");
     }
   }
 
   return *out != NULL;
 }
 
-ssize_t corpc_stream_read(struct corpc_stream * st, void ** out)
+// collect the first and all following fragments of a message into single malloc'ed buffer
+static ssize_t corpc_stream_reassemble(struct corpc_stream * st, struct comsg * comsg, void ** out)
 {
-  struct comsg * comsg = NULL;
-  ssize_t size = -1;
+  uint8_t * data = NULL, * tmp;
+  size_t size = 0, capacity = 0;
+  bool more = true;
 
   *out = NULL;
 
-  if ( corpc_stream_read_internal(st, &comsg) ) {
+  while ( comsg ) {
+
+    more = (comsg_flags(&comsg->hdr) & comsg_flag_more) != 0;
 
-    if ( !(*out = malloc(comsg->data.hdr.pldsize)) ) {
-      CF_CRITICAL("malloc(ccmsg->data) fails: %s", strerror(errno));
+    if ( data && (comsg_flags(&comsg->hdr) & comsg_flag_compressed) ) {
+      CF_CRITICAL("Unexpected compressed flag on continuation fragment for sid=%u", st->sid);
+      channel_state_lock();
+      corpc_set_stream_state(st, corpc_stream_protocol_error);
+      channel_state_unlock();
+      errno = EPROTO;
+      more = true;
+      break;
     }
-    else {
-      memcpy(*out, comsg->data.details.bits, size = comsg->data.hdr.pldsize);
+
+    if ( !data || size + comsg->hdr.pldsize > capacity ) {
+
+      capacity = more ? 2 * (size + comsg->hdr.pldsize) : size + comsg->hdr.pldsize;
+
+      if ( !(tmp = realloc(data, capacity)) ) {
+        CF_CRITICAL("realloc(data, %zu) fails: %s", capacity, strerror(errno));
+        abort_message(st);
+        more = true;
+        break;
+      }
+
+      data = tmp;
+    }
+
+    memcpy(data + size, comsg->data.details.bits, comsg->hdr.pldsize);
+    size += comsg->hdr.pldsize;
+    free(comsg), comsg = NULL;
+
+    if ( more && !corpc_stream_read_internal(st, &comsg) ) {
+      CF_CRITICAL("corpc_stream_read_internal() fails after %zu bytes of fragmented message", size);
     }
+  }
 
-    free(comsg);
+  free(comsg);
+
+  if ( more ) {
+    free(data);
+    return -1;
+  }
+
+  *out = data;
+  return size;
+}
+
+// reassemble the message and inflate it if the first fragment was flagged as compressed
+static ssize_t corpc_stream_extract(struct corpc_stream * st, struct comsg * comsg, void ** out)
+{
+  const bool compressed = (comsg_flags(&comsg->hdr) & comsg_flag_compressed) != 0;
+  void * data = NULL;
+  ssize_t size;
+
+  if ( (size = corpc_stream_reassemble(st, comsg, &data)) >= 0 && compressed ) {
+    size = decompress_message(st, data, size, out);
+    free(data);
+  }
+  else {
+    *out = data;
+  }
+
+  return size;
+}
+
+ssize_t corpc_stream_read(struct corpc_stream * st, void ** out)
+{
+  struct comsg * comsg = NULL;
+  ssize_t size = -1;
+
+  *out = NULL;
+
+  if ( corpc_stream_read_internal(st, &comsg) ) {
+    size = corpc_stream_extract(st, comsg, out);
   }
 
   return size;
@@ -1285,20 +2503,56 @@ ssize_t corpc_stream_read(struct corpc_stream * st, void ** out)
 bool corpc_stream_read_msg(struct corpc_stream * st, bool (*unpack)(void *, const void *, size_t), void * appmsg)
 {
   struct comsg * comsg = NULL;
+  void * data = NULL;
+  ssize_t size;
   bool fok = false;
 
   if ( corpc_stream_read_internal(st, &comsg) ) {
-    fok = unpack(appmsg, comsg->data.details.bits, comsg->hdr.pldsize);
+
+    if ( !(comsg_flags(&comsg->hdr) & (comsg_flag_more | comsg_flag_compressed)) ) {
+      fok = unpack(appmsg, comsg->data.details.bits, comsg->hdr.pldsize);
+      free(comsg);
+    }
+    else if ( (size = corpc_stream_extract(st, comsg, &data)) >= 0 ) {
+      fok = unpack(appmsg, data, size);
+      free(data);
+    }
   }
 
-  free(comsg);
   return fok;
 }
 
 
 bool corpc_stream_write(struct corpc_stream * st, const void * data, size_t size)
 {
-  return send_data(st, data, size);
+  bool fok = false;
+
+  if ( size > max_fragment_size(st) && !(st->caps & corpc_cap_fragments) ) {
+    CF_CRITICAL("message size %zu is too large for the peer", size);
+    errno = EMSGSIZE;
+  }
+  else if ( st->compression && size >= st->compression_threshold ) {
+
+    void * zdata = NULL;
+    ssize_t zsize;
+
+    // incompressible data or compressor failure, send it as is
+    zsize = compress_message(st, data, size, &zdata);
+
+    if ( acquire_message_lock(st) ) {
+      fok = zsize > 0 ? send_message(st, comsg_flag_compressed, zdata, zsize) :
+          send_message(st, 0, data, size);
+      release_message_lock(st);
+    }
+
+    free(zdata);
+  }
+  else if ( acquire_message_lock(st) ) {
+    fok = send_message(st, 0, data, size);
+    release_message_lock(st);
+  }
+
+  return fok;
 }
 
 bool corpc_stream_write_msg(struct corpc_stream * st, size_t (*pack)(const void *, void **), const void * appmsg)
@@ -1307,12 +2561,211 @@ bool corpc_stream_write_msg(struct corpc_stream * st, size_t (*pack)(const void
   size_t size;
   bool fok = false;
   if ( (size = pack(appmsg, &data)) > 0 ) {
-    fok = send_data(st, data, size);
+    fok = corpc_stream_write(st, data, size);
   }
   free(data);
   return fok;
 }
 
+// the buffer is taken out of the stream while in use, concurrent writers get their own
+static void take_wbuf(corpc_stream * st, cf_membuf * buf)
+{
+  channel_state_lock();
+  *buf = st->wbuf;
+  st->wbuf = (cf_membuf) CF_MEMBUF_INITIALIZER;
+  channel_state_unlock();
+}
+
+static void put_wbuf(corpc_stream * st, cf_membuf * buf)
+{
+  if ( buf->size <= CORPC_MAX_MSG_SIZE ) { // larger messages are fragmented anyway, don't pin them
+    channel_state_lock();
+    if ( !st->wbuf.data ) {
+      st->wbuf = *buf;
+      buf->data = NULL;
+    }
+    channel_state_unlock();
+  }
+
+  free(buf->data);
+}
+
+// frame is the header space in front of data
+static bool write_frame(corpc_stream * st, void * frame, const void * data, size_t size)
+{
+  bool fok = false;
+
+  if ( size > max_fragment_size(st) || (st->compression && size >= st->compression_threshold) ) {
+    fok = corpc_stream_write(st, data, size);
+  }
+  else if ( acquire_message_lock(st) ) {
+    fok = send_data_frame(st, 0, frame, data, size);
+    release_message_lock(st);
+  }
+
+  return fok;
+}
+
+bool corpc_stream_write_pb(struct corpc_stream * st, const cf_pb_field_t fields[], const void * appmsg)
+{
+  const size_t hdrsize = sizeof(struct comsghdr);
+  cf_membuf buf;
+  size_t size;
+  bool fok = false;
+
+  take_wbuf(st, &buf);
+
+  if ( !cf_pb_pack_membuf(appmsg, fields, &buf, hdrsize, &size) ) {
+    CF_CRITICAL("cf_pb_pack_membuf() fails");
+  }
+  else {
+    fok = write_frame(st, buf.data, (uint8_t *) buf.data + hdrsize, size);
+  }
+
+  put_wbuf(st, &buf);
+
+  return fok;
+}
+
+bool corpc_stream_write_wbuf(struct corpc_stream * st, bool (*write)(cf_pb_wbuf * w, const void * obj),
+    const void * appmsg)
+{
+  const size_t hdrsize = sizeof(struct comsghdr);
+  cf_membuf buf;
+  cf_pb_wbuf w;
+  size_t size;
+  bool fok = false;
+
+  take_wbuf(st, &buf);
+
+  w.base = buf.data;
+  w.ptr = w.end = (uint8_t *) buf.data + buf.size;
+
+  if ( !write(&w, appmsg) || !cf_pb_wbuf_reserve(&w, hdrsize) ) {
+    CF_CRITICAL("write(appmsg) fails");
+  }
+  else {
+    size = cf_pb_wbuf_size(&w);
+    fok = write_frame(st, w.ptr - hdrsize, w.ptr, size);
+  }
+
+  buf.data = w.base;
+  buf.size = w.end - w.base;
+
+  put_wbuf(st, &buf);
+
+  return fok;
+}
+
+bool corpc_stream_write_stream(struct corpc_stream * st, ssize_t (*read)(void * cookie, void * buf, size_t size),
+    void * cookie)
+{
+  const size_t fragsize = max_fragment_size(st);
+  uint8_t * buf = NULL;
+  size_t size = 0;
+  ssize_t cb;
+  bool eof = false;
+  bool sent = false;
+  bool fok = false;
+
+  // one byte more than a fragment to know if this fragment is the last one
+  if ( !(buf = malloc(fragsize + 1)) ) {
+    CF_CRITICAL("malloc(buf) fails: %s", strerror(errno));
+    return false;
+  }
+
+  if ( !acquire_message_lock(st) ) {
+    free(buf);
+    return false;
+  }
+
+  while ( 42 ) {
+
+    while ( !eof && size <= fragsize ) {
+      if ( (cb = read(cookie, buf + size, fragsize + 1 - size)) < 0 ) {
+        CF_CRITICAL("read() fails: %s", strerror(errno));
+        goto end;
+      }
+      if ( cb == 0 ) {
+        eof = true;
+      }
+      else {
+        size += cb;
+      }
+    }
+
+    if ( eof ) {
+      fok = send_data(st, 0, buf, size);
+      break;
+    }
+
+    if ( !(st->caps & corpc_cap_fragments) ) {
+      CF_CRITICAL("message is too large for the peer");
+      errno = EMSGSIZE;
+      goto end;
+    }
+
+    if ( !send_data(st, comsg_flag_more, buf, fragsize) ) {
+      goto end;
+    }
+
+    sent = true;
+    buf[0] = buf[fragsize];
+    size = 1;
+  }
+
+end:
+
+  if ( !fok && sent ) {
+    abort_message(st);
+  }
+
+  release_message_lock(st);
+  free(buf);
+
+  return fok;
+}
+
+
+struct fd_source {
+  int fd;
+  ssize_t remaining;
+};
+
+static ssize_t fd_source_read(void * cookie, void * buf, size_t size)
+{
+  struct fd_source * src = cookie;
+  ssize_t cb;
+
+  if ( src->remaining >= 0 && (size_t) src->remaining < size ) {
+    size = src->remaining;
+  }
+
+  if ( !size ) {
+    return 0;
+  }
+
+  if ( (cb = co_read(src->fd, buf, size)) == 0 && src->remaining > 0 ) {
+    errno = ENODATA;
+    return -1;
+  }
+
+  if ( cb > 0 && src->remaining >= 0 ) {
+    src->remaining -= cb;
+  }
+
+  return cb;
+}
+
+bool corpc_stream_write_fd(struct corpc_stream * st, int fd, ssize_t size)
+{
+  return corpc_stream_write_stream(st, fd_source_read,
+      &(struct fd_source ) {
+            .fd = fd,
+            .remaining = size,
+          });
+}
+
 bool corpc_stream_get_peername(const corpc_stream * stream , struct sockaddr * addrs, socklen_t * addrslen)
 {
   if ( !stream || !stream->channel || !stream->channel->ssl_sock ) {
@@ -1357,7 +2810,36 @@ void corpc_close_stream(corpc_stream ** stp)
 
     if ( (channel = st->channel) ) {
 
-      send_close_stream_notify(st);
+      uint32_t chcredit = 0;
+
+      if ( !st->unary ) {
+        // pipelined stream still opening is cancelled by its sid without waiting for create_stream_resp,
+        // the late responce finds no stream and is answered by close notify
+        if ( st->did || (st->early && corpc_channel_established(channel)) ) {
+          send_close_stream_notify(st);
+        }
+      }
+      else if ( !st->did && st->state == corpc_stream_opening && corpc_channel_established(channel) ) {
+        // the call is abandoned before its responce came, stop the server side
+        send_close_stream_notify(st);
+      }
+      else if ( st->did && st->state != corpc_stream_closed && corpc_channel_established(channel) ) {
+        // accepted call is finished without complete responce
+        send_call_status(channel, st->did, create_stream_responce_internal_error);
+      }
+
+      if ( byte_window(st) ) {
+        // return channel credit held by unread messages of this stream
+        channel_state_lock();
+        rxwnd_consume(&channel->rx, st->rx.inflight - st->rx.unacked);
+        st->rx.unacked = st->rx.inflight;
+        chcredit = rxwnd_take_credit(&channel->rx, true);
+        channel_state_unlock();
+
+        if ( chcredit && corpc_channel_established(channel) && !send_window_update(st, 0, chcredit) ) {
+          CF_CRITICAL("send_window_update() fails");
+        }
+      }
 
       channel_state_lock();
       ccarray_erase_item(&channel->streams, stp);
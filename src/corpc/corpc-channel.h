@@ -14,19 +14,48 @@
 #include <cuttle/ccarray.h>
 #include <cuttle/ccfifo.h>
 #include "corpc-listening-port.h"
+#include "corpc-methods.h"
+#include "corpc-compress.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/*
+ * Receive window accounting, bytes.
+ *  inflight: received from the peer and not yet returned as credit
+ *  unacked: consumed by the reader, subset of inflight
+ *  low: the peer nearly exhausted the window since the last credit
+ */
+typedef
+struct corpc_rxwnd {
+  uint32_t size;
+  uint32_t max;
+  uint32_t inflight;
+  uint32_t unacked;
+  bool low;
+} corpc_rxwnd;
+
+
 struct corpc_stream {
   corpc_channel * channel;
   ccfifo rxq;
   corpc_stream_state state;
   uint16_t sid;
   uint16_t did;
-  uint16_t rwnd;
+  uint32_t rwnd;  // send credit: bytes if corpc_cap_byte_window is set in caps, messages otherwise
+  uint32_t caps;  // negotiated corpc_cap_* bits
+  corpc_rxwnd rx;
+  bool wmsg_lock; // a message is being written, possibly in several fragments
+  bool early;     // opened without waiting for create_stream_resp
+  bool unary;     // carries a single corpc_call(), data go in call_req / call_resp frames
+  int64_t deadline; // cf_get_monotic_ms() after which reads fail with ETIME, 0 if none
+  enum corpc_stream_priority priority;
+  uint64_t vtime;   // virtual finish tag of the last frame granted the write lock
+  enum corpc_compression compression; // negotiated algorithm
+  uint32_t compression_threshold;     // smaller messages are sent as is
+  cf_membuf wbuf; // frame buffer reused by corpc_stream_write_pb()
 };
 
 typedef
@@ -35,7 +64,14 @@ struct corpc_stream_opts {
   corpc_stream_state state;
   uint16_t sid;
   uint16_t did;
-  uint16_t rwnd;
+  uint32_t rwnd;
+  uint32_t caps;
+  uint32_t rxwnd, max_rxwnd;
+  bool early;
+  bool unary;
+  enum corpc_stream_priority priority;
+  enum corpc_compression compression;
+  uint32_t compression_threshold;
 } corpc_stream_opts;
 
 
@@ -49,6 +85,7 @@ struct corpc_channel {
   ccarray_t streams; // <corpc_stream*>
 
   const struct corpc_service ** services;
+  corpc_method_table * methods;
   SSL_CTX * ssl_ctx;
 
   int refs;
@@ -74,6 +111,20 @@ struct corpc_channel {
 
   struct so_keepalive_opts
     keep_alive;
+
+  bool nocrc;         // skip data crc over TLS or AF_UNIX if the peer agrees
+  bool local;         // connected over AF_UNIX socket
+  bool shm;           // accepted channel switches to shared memory rings
+  uint32_t peer_caps; // nonzero once the peer has sent the stream handshake extension
+  uint32_t disabled_caps; // local caps not announced, see corpc_channel_disable_caps()
+  uint32_t swnd;      // channel send credit, bytes
+  corpc_rxwnd rx;     // channel receive window
+
+  struct write_waiter * wq; // writers waiting for write_lock
+  uint64_t vclock;          // virtual time of fair queueing, tag of the last granted stream frame
+
+  corpc_zctx * zctx;        // idle compression contexts
+  struct corpc_compression_stats zstats;
 };
 
 corpc_channel * corpc_channel_new(const struct corpc_channel_open_args * opts);
@@ -85,6 +136,13 @@ void corpc_channel_relase(corpc_channel ** chp);
 enum corpc_channel_state corpc_get_channel_state(const corpc_channel * channel);
 bool corpc_channel_established(const corpc_channel * channel);
 
+/* Streams and calls in progress, used for load balancing */
+size_t corpc_channel_get_nb_streams(const corpc_channel * channel);
+
+/* Stop announcing corpc_cap_* bits, so the channel behaves as a peer built without them.
+ * Must be called before the first stream, tests use it to emulate legacy peers */
+void corpc_channel_disable_caps(corpc_channel * channel, uint32_t caps);
+
 
 bool corpc_stream_init(struct corpc_stream * st, const corpc_stream_opts * args);
 corpc_stream * corpc_stream_new(const corpc_stream_opts * args);
@@ -0,0 +1,288 @@
+/*
+ * corpc-compress.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cuttle/debug.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include "corpc-compress.h"
+
+#ifdef HAVE_ZLIB
+# include <zlib.h>
+#endif
+
+#define CORPC_DEFLATE_LEVEL       1   // favor speed, protobuf payloads still shrink well
+#define CORPC_DEFLATE_WINDOW_BITS (-15) // raw deflate, no zlib header and adler32
+#define CORPC_INFLATE_INITIAL_SIZE (64*1024) // the declared size is trusted only as far as inflate() gets
+
+
+bool corpc_compression_supported(enum corpc_compression alg)
+{
+  switch ( alg ) {
+    case corpc_compression_none :
+      return true;
+#ifdef HAVE_ZLIB
+    case corpc_compression_deflate :
+      return true;
+#endif
+    default :
+      break;
+  }
+  return false;
+}
+
+corpc_zctx * corpc_zctx_new(void)
+{
+  corpc_zctx * ctx;
+  if ( !(ctx = calloc(1, sizeof(*ctx))) ) {
+    CF_CRITICAL("calloc(corpc_zctx) fails: %s", strerror(errno));
+  }
+  return ctx;
+}
+
+
+#ifdef HAVE_ZLIB
+
+void corpc_zctx_destroy(corpc_zctx * ctx)
+{
+  if ( ctx ) {
+    if ( ctx->deflate ) {
+      deflateEnd(ctx->deflate);
+      free(ctx->deflate);
+    }
+    if ( ctx->inflate ) {
+      inflateEnd(ctx->inflate);
+      free(ctx->inflate);
+    }
+    free(ctx);
+  }
+}
+
+static z_stream * get_deflate(corpc_zctx * ctx)
+{
+  z_stream * zs = ctx->deflate;
+  int status;
+
+  if ( zs ) {
+    if ( (status = deflateReset(zs)) != Z_OK ) {
+      CF_CRITICAL("deflateReset() fails: %d", status);
+      return NULL;
+    }
+    return zs;
+  }
+
+  if ( !(zs = calloc(1, sizeof(*zs))) ) {
+    CF_CRITICAL("calloc(z_stream) fails: %s", strerror(errno));
+    return NULL;
+  }
+
+  if ( (status = deflateInit2(zs, CORPC_DEFLATE_LEVEL, Z_DEFLATED, CORPC_DEFLATE_WINDOW_BITS, 8,
+      Z_DEFAULT_STRATEGY)) != Z_OK ) {
+    CF_CRITICAL("deflateInit2() fails: %d", status);
+    free(zs);
+    return NULL;
+  }
+
+  return ctx->deflate = zs;
+}
+
+static z_stream * get_inflate(corpc_zctx * ctx)
+{
+  z_stream * zs = ctx->inflate;
+  int status;
+
+  if ( zs ) {
+    if ( (status = inflateReset(zs)) != Z_OK ) {
+      CF_CRITICAL("inflateReset() fails: %d", status);
+      return NULL;
+    }
+    return zs;
+  }
+
+  if ( !(zs = calloc(1, sizeof(*zs))) ) {
+    CF_CRITICAL("calloc(z_stream) fails: %s", strerror(errno));
+    return NULL;
+  }
+
+  if ( (status = inflateInit2(zs, CORPC_DEFLATE_WINDOW_BITS)) != Z_OK ) {
+    CF_CRITICAL("inflateInit2() fails: %d", status);
+    free(zs);
+    return NULL;
+  }
+
+  return ctx->inflate = zs;
+}
+
+ssize_t corpc_zctx_compress(corpc_zctx * ctx, enum corpc_compression alg,
+    const void * data, size_t size, void ** out)
+{
+  z_stream * zs;
+  uint8_t * buf = NULL;
+  uint32_t hdr;
+  size_t bound;
+  ssize_t outsize = -1;
+  int status;
+
+  *out = NULL;
+
+  if ( alg != corpc_compression_deflate || size > CORPC_MAX_DECOMPRESSED_SIZE ) {
+    errno = EINVAL;
+    goto end;
+  }
+
+  if ( size <= sizeof(hdr) + 1 ) {
+    outsize = 0;
+    goto end;
+  }
+
+  if ( !(zs = get_deflate(ctx)) ) {
+    goto end;
+  }
+
+  // the output together with the size header must be smaller than the input
+  bound = size - 1;
+
+  if ( !(buf = malloc(bound)) ) {
+    CF_CRITICAL("malloc(%zu) fails: %s", bound, strerror(errno));
+    goto end;
+  }
+
+  hdr = htonl(size);
+  memcpy(buf, &hdr, sizeof(hdr));
+
+  zs->next_in = (Bytef *) data;
+  zs->avail_in = size;
+  zs->next_out = buf + sizeof(hdr);
+  zs->avail_out = bound - sizeof(hdr);
+
+  if ( (status = deflate(zs, Z_FINISH)) == Z_STREAM_END ) {
+    outsize = bound - zs->avail_out;
+  }
+  else if ( status == Z_OK || status == Z_BUF_ERROR ) {
+    outsize = 0; // doesn't shrink
+  }
+  else {
+    CF_CRITICAL("deflate() fails: %d", status);
+    errno = EINVAL;
+  }
+
+end:
+
+  if ( outsize > 0 ) {
+    *out = buf;
+  }
+  else {
+    free(buf);
+  }
+
+  return outsize;
+}
+
+ssize_t corpc_zctx_decompress(corpc_zctx * ctx, enum corpc_compression alg,
+    const void * data, size_t size, void ** out)
+{
+  z_stream * zs;
+  uint8_t * buf = NULL, * tmp;
+  uint32_t hdr;
+  size_t capacity, newcapacity;
+  ssize_t outsize = -1;
+  int status;
+
+  *out = NULL;
+
+  if ( alg != corpc_compression_deflate || size < sizeof(hdr) ) {
+    errno = EPROTO;
+    goto end;
+  }
+
+  memcpy(&hdr, data, sizeof(hdr));
+
+  if ( (hdr = ntohl(hdr)) > CORPC_MAX_DECOMPRESSED_SIZE ) {
+    CF_CRITICAL("decompressed size %u is too large", hdr);
+    errno = EPROTO;
+    goto end;
+  }
+
+  if ( !(zs = get_inflate(ctx)) ) {
+    goto end;
+  }
+
+  // a tiny frame may declare huge size, grow the buffer only while inflate() fills it
+  capacity = hdr < CORPC_INFLATE_INITIAL_SIZE ? hdr : CORPC_INFLATE_INITIAL_SIZE;
+
+  if ( !(buf = malloc(capacity ? capacity : 1)) ) {
+    CF_CRITICAL("malloc(%zu) fails: %s", capacity, strerror(errno));
+    goto end;
+  }
+
+  zs->next_in = (Bytef *) data + sizeof(hdr);
+  zs->avail_in = size - sizeof(hdr);
+  zs->next_out = buf;
+  zs->avail_out = capacity;
+
+  while ( (status = inflate(zs, Z_NO_FLUSH)) == Z_OK && zs->avail_out == 0 && capacity < hdr ) {
+
+    newcapacity = 2 * capacity < hdr ? 2 * capacity : hdr;
+
+    if ( !(tmp = realloc(buf, newcapacity)) ) {
+      CF_CRITICAL("realloc(%zu) fails: %s", newcapacity, strerror(errno));
+      goto end;
+    }
+
+    buf = tmp;
+    zs->next_out = buf + capacity;
+    zs->avail_out = newcapacity - capacity;
+    capacity = newcapacity;
+  }
+
+  if ( status != Z_STREAM_END || zs->total_out != hdr ) {
+    CF_CRITICAL("inflate() fails: status=%d total_out=%lu declared=%u", status, zs->total_out, hdr);
+    errno = EPROTO;
+    goto end;
+  }
+
+  outsize = hdr;
+
+end:
+
+  if ( outsize >= 0 ) {
+    *out = buf;
+  }
+  else {
+    free(buf);
+  }
+
+  return outsize;
+}
+
+#else
+
+void corpc_zctx_destroy(corpc_zctx * ctx)
+{
+  free(ctx);
+}
+
+ssize_t corpc_zctx_compress(corpc_zctx * ctx, enum corpc_compression alg,
+    const void * data, size_t size, void ** out)
+{
+  (void) ctx, (void) alg, (void) data, (void) size;
+  *out = NULL;
+  errno = ENOTSUP;
+  return -1;
+}
+
+ssize_t corpc_zctx_decompress(corpc_zctx * ctx, enum corpc_compression alg,
+    const void * data, size_t size, void ** out)
+{
+  (void) ctx, (void) alg, (void) data, (void) size;
+  *out = NULL;
+  errno = ENOTSUP;
+  return -1;
+}
+
+#endif /* HAVE_ZLIB */
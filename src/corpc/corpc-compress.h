@@ -0,0 +1,57 @@
+/*
+ * corpc-compress.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Payload compression of corpc messages
+ */
+
+//#pragma once
+
+#ifndef __cuttle_corpc_compress_h__
+#define __cuttle_corpc_compress_h__
+
+#include <cuttle/corpc/channel.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* Compressed message is the original size as big endian uint32 followed by raw deflate stream */
+#define CORPC_MAX_DECOMPRESSED_SIZE   (256*1024*1024)
+
+
+/* Compression state reused by messages of one channel, one coroutine at a time */
+typedef
+struct corpc_zctx {
+  struct corpc_zctx * next;
+  void * deflate;
+  void * inflate;
+} corpc_zctx;
+
+
+/* Algorithms supported by this build */
+bool corpc_compression_supported(enum corpc_compression alg);
+
+corpc_zctx * corpc_zctx_new(void);
+void corpc_zctx_destroy(corpc_zctx * ctx);
+
+/* Returns compressed size, always less than size, 0 if the data don't shrink, -1 on error */
+ssize_t corpc_zctx_compress(corpc_zctx * ctx, enum corpc_compression alg,
+    const void * data, size_t size, void ** out);
+
+/* Returns decompressed size or -1 on error */
+ssize_t corpc_zctx_decompress(corpc_zctx * ctx, enum corpc_compression alg,
+    const void * data, size_t size, void ** out);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cuttle_corpc_compress_h__ */
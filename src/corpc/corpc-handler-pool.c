@@ -0,0 +1,465 @@
+/*
+ * corpc-handler-pool.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cuttle/debug.h>
+#include <cuttle/time.h>
+#include <cuttle/ccfifo.h>
+#include <cuttle/cothread/scheduler.h>
+#include <cuttle/corpc/channel.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include "corpc-handler-pool.h"
+
+#define CORPC_HANDLER_DEFAULT_STACK_SIZE    (8*1024*1024)
+#define CORPC_HANDLER_DEFAULT_MAX_HANDLERS  256
+#define CORPC_HANDLER_DEFAULT_MAX_QUEUED    256
+#define CORPC_HANDLER_DEFAULT_CODEL_TARGET   5    // ms
+#define CORPC_HANDLER_DEFAULT_CODEL_INTERVAL 100  // ms
+#define CORPC_HANDLER_SHED_LOG_INTERVAL      1000 // ms, sheds are logged as one summary per interval
+
+
+struct handler_job {
+  struct corpc_stream * st;
+  const struct corpc_service_method * method;
+  int64_t enqueued;   // cf_get_monotic_us()
+};
+
+/* Process-wide limit of streams queued or running on all pools, 0 if unlimited */
+static uint32_t g_max_active_streams;
+static uint32_t g_active_streams;
+
+/*
+ * Handlers are spawned on demand up to max_handlers (min_handlers are pre-created)
+ * and then kept waiting for next streams instead of exiting.
+ * The pool is freed by the last of its owner and handlers.
+ */
+struct corpc_handler_pool {
+  const struct corpc_service * service;
+  co_thread_lock_t lock;
+  ccfifo queue;       // struct handler_job
+
+  size_t stack_size;
+  uint32_t max_handlers;
+  uint32_t max_queued;
+
+  uint32_t handlers;  // spawned handler coroutines
+  uint32_t idle;      // handlers waiting for a job, including just spawned ones
+  uint32_t busy;      // handlers running method procs
+
+  /* CoDel on queue delay: the pool is overloaded if even the shortest
+   * delay seen during the last interval exceeded the target */
+  int64_t codel_target;     // us
+  int64_t codel_interval;   // us
+  int64_t interval_end;     // us
+  int64_t min_delay;        // us, -1 at interval start
+  bool overloaded;
+
+  uint64_t rejected_queue_full;
+  uint64_t rejected_overload;
+  uint64_t rejected_limit;
+  uint64_t shed;
+  uint64_t shed_logged;     // shed count at the last summary
+  int64_t shed_log_time;    // us, next summary is not logged before
+
+  int refs;           // owner + handlers
+  bool shutdown;
+};
+
+
+
+static void pool_lock(corpc_handler_pool * pool)
+{
+  if ( !co_thread_lock(&pool->lock) ) {
+    CF_FATAL("co_thread_lock() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_unlock(corpc_handler_pool * pool)
+{
+  if ( !co_thread_unlock(&pool->lock) ) {
+    CF_FATAL("co_thread_unlock() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_wait(corpc_handler_pool * pool)
+{
+  if ( co_thread_wait(&pool->lock, -1) < 0 ) {
+    CF_FATAL("co_thread_wait() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_signal(corpc_handler_pool * pool)
+{
+  if ( co_thread_signal(&pool->lock) < 0 ) {
+    CF_FATAL("co_thread_signal() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_broadcast(corpc_handler_pool * pool)
+{
+  if ( co_thread_broadcast(&pool->lock) < 0 ) {
+    CF_FATAL("co_thread_broadcast() fails: %s", strerror(errno));
+  }
+}
+
+static void pool_destroy(corpc_handler_pool * pool)
+{
+  co_thread_lock_destroy(&pool->lock);
+  ccfifo_cleanup(&pool->queue);
+  free(pool);
+}
+
+// must be locked
+static bool pool_unref(corpc_handler_pool * pool)
+{
+  return --pool->refs == 0;
+}
+
+
+
+static bool acquire_active_stream(void)
+{
+  uint32_t max = __atomic_load_n(&g_max_active_streams, __ATOMIC_RELAXED);
+
+  if ( !max ) {
+    __atomic_add_fetch(&g_active_streams, 1, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  uint32_t n = __atomic_load_n(&g_active_streams, __ATOMIC_RELAXED);
+  do {
+    if ( n >= max ) {
+      return false;
+    }
+  } while ( !__atomic_compare_exchange_n(&g_active_streams, &n, n + 1, true,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED) );
+
+  return true;
+}
+
+static void release_active_stream(void)
+{
+  __atomic_sub_fetch(&g_active_streams, 1, __ATOMIC_RELAXED);
+}
+
+static bool global_limit_reached(void)
+{
+  uint32_t max = __atomic_load_n(&g_max_active_streams, __ATOMIC_RELAXED);
+  return max && __atomic_load_n(&g_active_streams, __ATOMIC_RELAXED) >= max;
+}
+
+
+// must be locked
+static bool queue_full(const corpc_handler_pool * pool)
+{
+  return ccfifo_size(&pool->queue) >= pool->idle + pool->max_queued
+      && pool->handlers >= pool->max_handlers;
+}
+
+// must be locked, true if the new stream would wait in the queue
+static bool must_wait(const corpc_handler_pool * pool)
+{
+  return ccfifo_size(&pool->queue) >= pool->idle && pool->handlers >= pool->max_handlers;
+}
+
+/* must be locked, called on each dequeue with the job queue delay.
+ *  Returns true if the job must be shed instead of running */
+static bool codel_update(corpc_handler_pool * pool, int64_t now, int64_t delay)
+{
+  if ( now >= pool->interval_end ) {
+    pool->overloaded = pool->min_delay > pool->codel_target;
+    pool->interval_end = now + pool->codel_interval;
+    pool->min_delay = delay;
+  }
+  else if ( delay < pool->min_delay || pool->min_delay < 0 ) {
+    pool->min_delay = delay;
+  }
+
+  return pool->overloaded && delay > 2 * pool->codel_target;
+}
+
+
+
+static void handler_thread(void * arg)
+{
+  corpc_handler_pool * pool = arg;
+  struct handler_job job;
+  int64_t now;
+  uint64_t nshed;
+  bool shed;
+  bool last;
+
+  pool_lock(pool);
+
+  while ( 42 ) {
+
+    if ( ccfifo_pop(&pool->queue, &job) ) {
+
+      --pool->idle;
+      ++pool->busy;
+
+      now = cf_get_monotic_us();
+      nshed = 0;
+      if ( (shed = codel_update(pool, now, now - job.enqueued)) ) {
+        ++pool->shed;
+        if ( now >= pool->shed_log_time ) {
+          nshed = pool->shed - pool->shed_logged;
+          pool->shed_logged = pool->shed;
+          pool->shed_log_time = now + CORPC_HANDLER_SHED_LOG_INTERVAL * 1000;
+        }
+      }
+
+      pool_unlock(pool);
+
+      if ( shed ) {
+        if ( nshed ) {
+          CF_WARNING("%s: %" PRIu64 " streams shed in overloaded queue, last %s after %" PRId64 " ms",
+              pool->service->name, nshed, job.method->name, (now - job.enqueued) / 1000);
+        }
+      }
+      else if ( corpc_stream_get_remaining_time(job.st) == 0 ) {
+        CF_CRITICAL("%s/%s: deadline passed while queued", pool->service->name, job.method->name);
+      }
+      else {
+        CF_DEBUG("C %s/%s()", pool->service->name, job.method->name);
+        job.method->proc(job.st);
+        CF_DEBUG("R %s/%s()", pool->service->name, job.method->name);
+      }
+
+      corpc_close_stream(&job.st);
+      release_active_stream();
+
+      pool_lock(pool);
+      --pool->busy;
+      ++pool->idle;
+    }
+    else if ( pool->shutdown ) {
+      break;
+    }
+    else {
+      pool_wait(pool);
+    }
+  }
+
+  --pool->idle;
+  --pool->handlers;
+  last = pool_unref(pool);
+
+  pool_unlock(pool);
+
+  if ( last ) {
+    pool_destroy(pool);
+  }
+}
+
+// must be locked
+static bool spawn_handler(corpc_handler_pool * pool)
+{
+  if ( !co_schedule(handler_thread, pool, pool->stack_size) ) {
+    CF_CRITICAL("co_schedule(%s handler) fails: %s", pool->service->name, strerror(errno));
+    return false;
+  }
+
+  ++pool->handlers;
+  ++pool->idle;
+  ++pool->refs;
+
+  return true;
+}
+
+
+
+corpc_handler_pool * corpc_handler_pool_new(const struct corpc_service * service)
+{
+  corpc_handler_pool * pool = NULL;
+  bool fok = false;
+
+  if ( !(pool = calloc(1, sizeof(*pool))) ) {
+    CF_CRITICAL("calloc(corpc_handler_pool) fails: %s", strerror(errno));
+    goto end;
+  }
+
+  pool->service = service;
+  pool->stack_size = service->stack_size ? service->stack_size : CORPC_HANDLER_DEFAULT_STACK_SIZE;
+  pool->max_handlers = service->max_handlers ? service->max_handlers : CORPC_HANDLER_DEFAULT_MAX_HANDLERS;
+  pool->max_queued = service->max_queued ? service->max_queued : CORPC_HANDLER_DEFAULT_MAX_QUEUED;
+  pool->codel_target = 1000LL * (service->codel_target ? service->codel_target : CORPC_HANDLER_DEFAULT_CODEL_TARGET);
+  pool->codel_interval = 1000LL * (service->codel_interval ? service->codel_interval : CORPC_HANDLER_DEFAULT_CODEL_INTERVAL);
+  pool->min_delay = -1;
+  pool->refs = 1;
+
+  if ( !co_thread_lock_init(&pool->lock) ) {
+    CF_CRITICAL("co_thread_lock_init() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( !ccfifo_init(&pool->queue, pool->max_handlers + pool->max_queued, sizeof(struct handler_job)) ) {
+    CF_CRITICAL("ccfifo_init(queue) fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( service->min_handlers ) {
+    pool_lock(pool);
+    while ( pool->handlers < service->min_handlers && pool->handlers < pool->max_handlers ) {
+      if ( !spawn_handler(pool) ) {
+        break; // the rest will be spawned on demand
+      }
+    }
+    pool_unlock(pool);
+  }
+
+  fok = true;
+
+end:
+
+  if ( !fok && pool ) {
+    if ( pool->lock ) {
+      co_thread_lock_destroy(&pool->lock);
+    }
+    free(pool);
+    pool = NULL;
+  }
+
+  return pool;
+}
+
+
+void corpc_handler_pool_release(corpc_handler_pool ** pool)
+{
+  bool last;
+
+  if ( pool && *pool ) {
+
+    pool_lock(*pool);
+    (*pool)->shutdown = true;
+    last = pool_unref(*pool);
+    pool_broadcast(*pool);
+    pool_unlock(*pool);
+
+    if ( last ) {
+      pool_destroy(*pool);
+    }
+
+    *pool = NULL;
+  }
+}
+
+
+bool corpc_handler_pool_admit(corpc_handler_pool * pool)
+{
+  bool fok = false;
+
+  pool_lock(pool);
+
+  if ( pool->shutdown ) {
+    errno = ESHUTDOWN;
+    goto end;
+  }
+
+  if ( global_limit_reached() ) {
+    ++pool->rejected_limit;
+    errno = EBUSY;
+    goto end;
+  }
+
+  if ( queue_full(pool) ) {
+    ++pool->rejected_queue_full;
+    errno = EBUSY;
+    goto end;
+  }
+
+  if ( pool->overloaded && must_wait(pool) ) {
+    ++pool->rejected_overload;
+    errno = EBUSY;
+    goto end;
+  }
+
+  fok = true;
+
+end:
+
+  pool_unlock(pool);
+
+  return fok;
+}
+
+
+bool corpc_handler_pool_submit(corpc_handler_pool * pool, struct corpc_stream * st,
+    const struct corpc_service_method * method)
+{
+  bool fok = false;
+
+  pool_lock(pool);
+
+  if ( pool->shutdown ) {
+    errno = ESHUTDOWN;
+    goto end;
+  }
+
+  if ( ccfifo_size(&pool->queue) >= pool->idle && pool->handlers < pool->max_handlers ) {
+    spawn_handler(pool); // if fails the stream still can be queued for running handlers
+  }
+
+  if ( !pool->handlers || ccfifo_size(&pool->queue) >= pool->idle + pool->max_queued ) {
+    CF_CRITICAL("%s: all %u handlers are busy and %zu streams are queued",
+        pool->service->name, pool->handlers, ccfifo_size(&pool->queue));
+    ++pool->rejected_queue_full;
+    errno = EBUSY;
+    goto end;
+  }
+
+  if ( !acquire_active_stream() ) {
+    CF_CRITICAL("%s: process-wide limit of %u active streams reached",
+        pool->service->name, __atomic_load_n(&g_max_active_streams, __ATOMIC_RELAXED));
+    ++pool->rejected_limit;
+    errno = EBUSY;
+    goto end;
+  }
+
+  ccfifo_push(&pool->queue, &(struct handler_job ) {
+        .st = st,
+        .method = method,
+        .enqueued = cf_get_monotic_us(),
+      });
+
+  pool_signal(pool);
+
+  fok = true;
+
+end:
+
+  pool_unlock(pool);
+
+  return fok;
+}
+
+
+void corpc_handler_pool_get_stats(corpc_handler_pool * pool, struct corpc_service_stats * stats)
+{
+  pool_lock(pool);
+
+  stats->handlers = pool->handlers;
+  stats->busy = pool->busy;
+  stats->queued = ccfifo_size(&pool->queue);
+  stats->idle = pool->idle > stats->queued ? pool->idle - stats->queued : 0;
+  stats->rejected_queue_full = pool->rejected_queue_full;
+  stats->rejected_overload = pool->rejected_overload;
+  stats->rejected_limit = pool->rejected_limit;
+  stats->rejected = stats->rejected_queue_full + stats->rejected_overload + stats->rejected_limit;
+  stats->shed = pool->shed;
+  stats->overloaded = pool->overloaded;
+
+  pool_unlock(pool);
+}
+
+
+void corpc_set_max_active_streams(uint32_t max_streams)
+{
+  __atomic_store_n(&g_max_active_streams, max_streams, __ATOMIC_RELAXED);
+}
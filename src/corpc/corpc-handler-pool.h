@@ -0,0 +1,53 @@
+/*
+ * corpc-handler-pool.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Reusable coroutines running service method handlers of accepted streams
+ */
+
+//#pragma once
+
+#ifndef __cuttle_corpc_handler_pool_h__
+#define __cuttle_corpc_handler_pool_h__
+
+#include <cuttle/corpc/service.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+struct corpc_stream;
+
+typedef
+struct corpc_handler_pool
+  corpc_handler_pool;
+
+
+corpc_handler_pool * corpc_handler_pool_new(const struct corpc_service * service);
+
+/* Idle handlers exit, busy ones finish queued streams first */
+void corpc_handler_pool_release(corpc_handler_pool ** pool);
+
+/* Fast admission check before the stream is allocated.
+ *  Fails with EBUSY and counts the reason if a new stream would be refused
+ *  by the queue limit, the process-wide limit or queue delay overload */
+bool corpc_handler_pool_admit(corpc_handler_pool * pool);
+
+/* Runs method->proc(st) and closes the stream on a pooled handler.
+ *  Fails with EBUSY if all handlers are busy and the admission queue is full */
+bool corpc_handler_pool_submit(corpc_handler_pool * pool, struct corpc_stream * st,
+    const struct corpc_service_method * method);
+
+void corpc_handler_pool_get_stats(corpc_handler_pool * pool,
+    struct corpc_service_stats * stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cuttle_corpc_handler_pool_h__ */
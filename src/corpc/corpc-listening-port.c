@@ -30,7 +30,7 @@ static const co_ssl_listening_port_opts * fill_ssl_opts(const struct corpc_liste
   ssl_opts->bind_address = opts->listen_address;
   ssl_opts->ssl_ctx = opts->ssl_ctx;
   ssl_opts->sock_type = SOCK_STREAM;
-  ssl_opts->proto = IPPROTO_TCP;
+  ssl_opts->proto = opts->listen_address.sa.sa_family == AF_UNIX ? 0 : IPPROTO_TCP;
   ssl_opts->onaccept = corpc_listening_port_on_accept;
   ssl_opts->cookie = NULL;
   ssl_opts->extra_object_size = sizeof(struct corpc_listening_port) - sizeof(struct co_ssl_listening_port);
@@ -44,7 +44,14 @@ bool corpc_listening_port_init(struct corpc_listening_port * cp, const struct co
 {
   if ( co_ssl_listening_port_init(&cp->base, tmpsslopts(opts)) ) {
     cp->services = opts->services;
-    return true;
+    cp->chwnd = opts->chwnd;
+    cp->max_chwnd = opts->max_chwnd;
+    cp->nocrc = opts->nocrc;
+    cp->shm = opts->shm;
+    if ( !opts->services || (cp->methods = corpc_method_table_new(opts->services)) ) {
+      return true;
+    }
+    co_ssl_listening_port_cleanup(&cp->base);
   }
   return false;
 }
@@ -52,6 +59,7 @@ bool corpc_listening_port_init(struct corpc_listening_port * cp, const struct co
 void corpc_listening_port_cleanup(struct corpc_listening_port * cp)
 {
   co_ssl_listening_port_cleanup(&cp->base);
+  corpc_method_table_release(&cp->methods);
   cp->services = 0;
 }
 
@@ -62,9 +70,17 @@ struct corpc_listening_port * corpc_listening_port_new(const struct corpc_listen
   if ( (clp = (corpc_listening_port *) co_ssl_listening_port_new(tmpsslopts(opts))) ) {
     clp->services = opts->services;
     clp->keep_alive = opts->keep_alive;
+    clp->chwnd = opts->chwnd;
+    clp->max_chwnd = opts->max_chwnd;
+    clp->nocrc = opts->nocrc;
+    clp->shm = opts->shm;
     clp->onaccept = opts->onaccept;
     clp->onaccepted = opts->onaccepted;
     clp->ondisconnected = opts->ondisconnected;
+
+    if ( opts->services && !(clp->methods = corpc_method_table_new(opts->services)) ) {
+      corpc_listening_port_release(&clp);
+    }
   }
 
   return clp;
@@ -72,7 +88,10 @@ struct corpc_listening_port * corpc_listening_port_new(const struct corpc_listen
 
 void corpc_listening_port_release(struct corpc_listening_port ** clp)
 {
-  co_ssl_listening_port_release((co_ssl_listening_port **) clp);
+  if ( clp && *clp ) {
+    corpc_method_table_release(&(*clp)->methods);
+    co_ssl_listening_port_release((co_ssl_listening_port **) clp);
+  }
 }
 
 void * corpc_get_listening_port_cookie(const struct corpc_listening_port * clp)
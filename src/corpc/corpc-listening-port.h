@@ -12,6 +12,7 @@
 
 #include <cuttle/corpc/listening-port.h>
 #include <cuttle/cothread/ssl-listening-port.h>
+#include "corpc-methods.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,9 +27,16 @@ struct corpc_listening_port {
   const struct corpc_service **
     services;
 
+  corpc_method_table *
+    methods;
+
   struct so_keepalive_opts
     keep_alive;
 
+  uint32_t chwnd, max_chwnd;
+  bool nocrc;
+  bool shm;
+
   bool (*onaccept)(const corpc_channel * channel);
   void (*onaccepted)(corpc_channel * channel);
   void (*ondisconnected)(corpc_channel * channel);
@@ -0,0 +1,177 @@
+/*
+ * corpc-methods.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ */
+
+#include <cuttle/debug.h>
+#include <cuttle/hash/crc32.h>
+#include <stdlib.h>
+#include <string.h>
+#include "corpc-methods.h"
+#include "corpc-handler-pool.h"
+
+
+static uint32_t method_id(const char * service, size_t service_name_length,
+    const char * method, size_t method_name_length)
+{
+  uint32_t crc = cf_crc32_begin();
+  crc = cf_crc32_update(crc, service, service_name_length);
+  crc = cf_crc32_update(crc, "/", 1);
+  crc = cf_crc32_update(crc, method, method_name_length);
+  return ~crc; // not cf_crc32_finalize(), the id must not depend on host byte order
+}
+
+uint32_t corpc_method_id(const char * service, const char * method)
+{
+  return method_id(service, strlen(service), method, strlen(method));
+}
+
+
+static int entry_cmp(const void * p1, const void * p2)
+{
+  const corpc_method_entry * e1 = p1;
+  const corpc_method_entry * e2 = p2;
+  return e1->id < e2->id ? -1 : e1->id > e2->id ? 1 : 0;
+}
+
+static const corpc_method_entry * lower_bound(const corpc_method_table * table, uint32_t id)
+{
+  size_t lo = 0, hi = table->size, mid;
+
+  while ( lo < hi ) {
+    if ( table->entries[mid = (lo + hi) / 2].id < id ) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  return lo < table->size && table->entries[lo].id == id ? &table->entries[lo] : NULL;
+}
+
+
+static void table_destroy(corpc_method_table * table)
+{
+  for ( int i = 0; table->pools && table->pools[i]; ++i ) {
+    corpc_handler_pool_release(&table->pools[i]);
+  }
+  free(table->pools);
+  free(table);
+}
+
+
+corpc_method_table * corpc_method_table_new(const struct corpc_service ** services)
+{
+  corpc_method_table * table;
+  size_t n = 0, nservices = 0;
+
+  for ( int i = 0; services && services[i]; ++i, ++nservices ) {
+    for ( int j = 0; services[i]->methods[j].name; ++j ) {
+      ++n;
+    }
+  }
+
+  if ( !(table = malloc(sizeof(*table) + n * sizeof(table->entries[0]))) ) {
+    CF_CRITICAL("malloc(corpc_method_table) fails: %s", strerror(errno));
+    return NULL;
+  }
+
+  table->refs = 1;
+  table->size = 0;
+
+  if ( !(table->pools = calloc(nservices + 1, sizeof(table->pools[0]))) ) {
+    CF_CRITICAL("calloc(pools) fails: %s", strerror(errno));
+    free(table);
+    return NULL;
+  }
+
+  for ( size_t i = 0; i < nservices; ++i ) {
+    if ( !(table->pools[i] = corpc_handler_pool_new(services[i])) ) {
+      CF_CRITICAL("corpc_handler_pool_new(%s) fails", services[i]->name);
+      table_destroy(table);
+      return NULL;
+    }
+  }
+
+  for ( int i = 0; services && services[i]; ++i ) {
+    for ( int j = 0; services[i]->methods[j].name; ++j ) {
+      corpc_method_entry * e = &table->entries[table->size++];
+      e->service = services[i];
+      e->method = &services[i]->methods[j];
+      e->pool = table->pools[i];
+      e->id = corpc_method_id(e->service->name, e->method->name);
+    }
+  }
+
+  qsort(table->entries, table->size, sizeof(table->entries[0]), entry_cmp);
+
+  // clients having corpc_cap_method_id and unary calls address methods by id only
+  for ( size_t i = 1; i < table->size; ++i ) {
+    if ( table->entries[i].id == table->entries[i - 1].id ) {
+      CF_CRITICAL("Method id collision: %s/%s and %s/%s have id 0x%08X, rename one of them",
+          table->entries[i - 1].service->name, table->entries[i - 1].method->name,
+          table->entries[i].service->name, table->entries[i].method->name,
+          table->entries[i].id);
+      table_destroy(table);
+      errno = EEXIST;
+      return NULL;
+    }
+  }
+
+  return table;
+}
+
+void corpc_method_table_addref(corpc_method_table * table)
+{
+  if ( table ) {
+    __atomic_add_fetch(&table->refs, 1, __ATOMIC_RELAXED);
+  }
+}
+
+void corpc_method_table_release(corpc_method_table ** table)
+{
+  if ( table && *table ) {
+    if ( __atomic_sub_fetch(&(*table)->refs, 1, __ATOMIC_ACQ_REL) < 1 ) {
+      table_destroy(*table);
+    }
+    *table = NULL;
+  }
+}
+
+const corpc_method_entry * corpc_method_table_find(const corpc_method_table * table, uint32_t id)
+{
+  return table ? lower_bound(table, id) : NULL;
+}
+
+const corpc_method_entry * corpc_method_table_find_by_name(const corpc_method_table * table,
+    const char * service, size_t service_name_length,
+    const char * method, size_t method_name_length)
+{
+  const uint32_t id = method_id(service, service_name_length, method, method_name_length);
+  const corpc_method_entry * e;
+
+  // ids are unique, the names still must match
+  if ( table && (e = lower_bound(table, id)) ) {
+    if ( strlen(e->service->name) == service_name_length && memcmp(e->service->name, service, service_name_length) == 0
+        && strlen(e->method->name) == method_name_length && memcmp(e->method->name, method, method_name_length) == 0 ) {
+      return e;
+    }
+  }
+
+  return NULL;
+}
+
+const corpc_method_entry * corpc_method_table_find_service(const corpc_method_table * table,
+    const char * service, size_t service_name_length)
+{
+  for ( size_t i = 0; table && i < table->size; ++i ) {
+    const char * name = table->entries[i].service->name;
+    if ( strlen(name) == service_name_length && memcmp(name, service, service_name_length) == 0 ) {
+      return &table->entries[i];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,64 @@
+/*
+ * corpc-methods.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Service method lookup by numeric method id or by names
+ */
+
+//#pragma once
+
+#ifndef __cuttle_corpc_methods_h__
+#define __cuttle_corpc_methods_h__
+
+#include <cuttle/corpc/service.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef
+struct corpc_method_entry {
+  uint32_t id;
+  const struct corpc_service * service;
+  const struct corpc_service_method * method;
+  struct corpc_handler_pool * pool; // shared by all methods of the service
+} corpc_method_entry;
+
+
+/* Immutable table sorted by method id, shared by listening port and accepted channels.
+ * Owns handler pools of the services. Method ids are unique, corpc_method_table_new()
+ * fails with EEXIST on collision */
+typedef
+struct corpc_method_table {
+  int refs;
+  size_t size;
+  struct corpc_handler_pool ** pools; // NULL-terminated
+  corpc_method_entry entries[];
+} corpc_method_table;
+
+
+corpc_method_table * corpc_method_table_new(const struct corpc_service ** services);
+void corpc_method_table_addref(corpc_method_table * table);
+void corpc_method_table_release(corpc_method_table ** table);
+
+const corpc_method_entry * corpc_method_table_find(const corpc_method_table * table, uint32_t id);
+
+const corpc_method_entry * corpc_method_table_find_by_name(const corpc_method_table * table,
+    const char * service, size_t service_name_length,
+    const char * method, size_t method_name_length);
+
+/* Returns any method entry of the service */
+const corpc_method_entry * corpc_method_table_find_service(const corpc_method_table * table,
+    const char * service, size_t service_name_length);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cuttle_corpc_methods_h__ */
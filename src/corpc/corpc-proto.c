@@ -66,6 +66,74 @@ static void htondr(comsghdr * msgh)
   msgh->pldsize = htons(msgh->pldsize);
 }
 
+/* ext follows the names at any offset, it goes through an aligned copy */
+static void ntohext(void * p)
+{
+  comsg_stream_ext ext;
+
+  memcpy(&ext, p, sizeof(ext));
+  ext.caps = ntohl(ext.caps);
+  ext.rwnd = ntohl(ext.rwnd);
+  ext.chwnd = ntohl(ext.chwnd);
+  ext.method_id = ntohl(ext.method_id);
+  ext.deadline = ntohl(ext.deadline);
+  ext.priority = ntohl(ext.priority);
+  ext.compression = ntohl(ext.compression);
+  memcpy(p, &ext, sizeof(ext));
+}
+
+static void htonext(void * p)
+{
+  comsg_stream_ext ext;
+
+  memcpy(&ext, p, sizeof(ext));
+  ext.caps = htonl(ext.caps);
+  ext.rwnd = htonl(ext.rwnd);
+  ext.chwnd = htonl(ext.chwnd);
+  ext.method_id = htonl(ext.method_id);
+  ext.deadline = htonl(ext.deadline);
+  ext.priority = htonl(ext.priority);
+  ext.compression = htonl(ext.compression);
+  memcpy(p, &ext, sizeof(ext));
+}
+
+static size_t create_stream_request_names_size(const comsg_create_stream_request * msg)
+{
+  return sizeof(msg->details) + msg->details.service_name_length + msg->details.method_name_length;
+}
+
+// unaligned, access it with memcpy()
+static uint8_t * create_stream_request_ext(const comsg_create_stream_request * msg)
+{
+  if ( msg->hdr.pldsize < create_stream_request_names_size(msg) + sizeof(comsg_stream_ext) ) {
+    return NULL;
+  }
+  return (uint8_t *) (msg->details.pack + msg->details.service_name_length
+      + msg->details.method_name_length);
+}
+
+bool corpc_proto_get_create_stream_request_ext(const comsg_create_stream_request * msg, comsg_stream_ext * ext)
+{
+  const uint8_t * p;
+
+  if ( !(p = create_stream_request_ext(msg)) ) {
+    return false;
+  }
+
+  memcpy(ext, p, sizeof(*ext));
+  return true;
+}
+
+bool corpc_proto_get_create_stream_responce_ext(const comsg_create_stream_responce * msg, comsg_stream_ext * ext)
+{
+  if ( msg->hdr.pldsize != sizeof(msg->details) ) {
+    return false;
+  }
+
+  memcpy(ext, &msg->details.ext, sizeof(*ext));
+  return true;
+}
+
 
 const char * create_stream_responce_status_string(enum create_stream_responce_code code)
 {
@@ -91,10 +159,23 @@ const char * create_stream_responce_status_string(enum create_stream_responce_co
 }
 
 
+static uint16_t allowed_flags(uint16_t code)
+{
+  switch ( code ) {
+    case co_msg_data :
+      return COMSG_DATA_FLAGS;
+    case co_msg_call_req :
+      return COMSG_CALL_REQUEST_FLAGS;
+    case co_msg_call_resp :
+      return COMSG_CALL_RESPONCE_FLAGS;
+  }
+  return 0;
+}
 
 bool corpc_proto_recv_msg(co_ssl_socket * ssl_sock, comsg * msgp)
 {
   ssize_t size;
+  uint8_t * ext;
   bool fok = false;
   uint32_t crc_received, crc_actual;
 
@@ -104,7 +185,13 @@ bool corpc_proto_recv_msg(co_ssl_socket * ssl_sock, comsg * msgp)
 
   ntohdr(&msgp->hdr);
 
-  switch (msgp->hdr.code) {
+  if ( comsg_flags(&msgp->hdr) & ~allowed_flags(comsg_code(&msgp->hdr)) ) {
+    CF_CRITICAL("Invalid msgp->hdr.code=0x%X flags", msgp->hdr.code);
+    errno = EPROTO;
+    goto end;
+  }
+
+  switch ( comsg_code(&msgp->hdr) ) {
 
     case co_msg_create_stream_req :
       RECV_DEBUG("recv: create_stream_req sid=%u did=%u", msgp->hdr.sid, msgp->hdr.did);
@@ -126,6 +213,19 @@ bool corpc_proto_recv_msg(co_ssl_socket * ssl_sock, comsg * msgp)
       msgp->create_stream_request.details.method_name_length = ntohs(
           msgp->create_stream_request.details.method_name_length);
 
+      if ( create_stream_request_names_size(&msgp->create_stream_request) > msgp->hdr.pldsize ) {
+        CF_CRITICAL("Invalid service/method name lengths: %u/%u pldsize=%u",
+            msgp->create_stream_request.details.service_name_length,
+            msgp->create_stream_request.details.method_name_length,
+            msgp->hdr.pldsize);
+        errno = EPROTO;
+        goto end;
+      }
+
+      if ( (ext = create_stream_request_ext(&msgp->create_stream_request)) ) {
+        ntohext(ext);
+      }
+
     break;
 
 
@@ -134,19 +234,24 @@ bool corpc_proto_recv_msg(co_ssl_socket * ssl_sock, comsg * msgp)
     case co_msg_create_stream_resp:
       RECV_DEBUG("recv: create_stream_resp sid=%u did=%u", msgp->hdr.sid, msgp->hdr.did);
 
-      if ( msgp->hdr.pldsize != sizeof(msgp->create_stream_responce.details) ) {
-        CF_CRITICAL("msgp->hdr.size is too large: %u. Expected %zu", msgp->hdr.pldsize, sizeof(msgp->create_stream_responce.details));
+      if ( msgp->hdr.pldsize != sizeof(msgp->create_stream_responce.details)
+          && msgp->hdr.pldsize != CORPC_LEGACY_CREATE_STREAM_RESPONCE_SIZE - sizeof(msgp->hdr) ) {
+        CF_CRITICAL("msgp->hdr.size is invalid: %u. Expected %zu", msgp->hdr.pldsize, sizeof(msgp->create_stream_responce.details));
         goto end;
       }
 
-      if ( !co_proto_recv_chunk(ssl_sock, &msgp->create_stream_responce.details) ) {
-        CF_CRITICAL("co_proto_recv_chunk() fails");
+      if ( !co_proto_read(ssl_sock, &msgp->create_stream_responce.details, msgp->hdr.pldsize) ) {
+        CF_CRITICAL("co_proto_read() fails");
         goto end;
       }
 
       msgp->create_stream_responce.details.status = ntohs(msgp->create_stream_responce.details.status);
       msgp->create_stream_responce.details.rwnd = ntohs(msgp->create_stream_responce.details.rwnd);
 
+      if ( msgp->hdr.pldsize == sizeof(msgp->create_stream_responce.details) ) {
+        ntohext(&msgp->create_stream_responce.details.ext);
+      }
+
       break;
 
 
@@ -196,12 +301,71 @@ bool corpc_proto_recv_msg(co_ssl_socket * ssl_sock, comsg * msgp)
 
       break;
 
+    case co_msg_window_update:
+      RECV_DEBUG("recv: window_update sid=%u did=%u", msgp->hdr.sid, msgp->hdr.did);
+
+      if ( msgp->hdr.pldsize != sizeof(msgp->window_update.details) ) {
+        CF_CRITICAL("msgp->hdr.size is invalid: %u. Expected %zu", msgp->hdr.pldsize, sizeof(msgp->window_update.details));
+        goto end;
+      }
+
+      if ( !co_proto_recv_chunk(ssl_sock, &msgp->window_update.details) ) {
+        CF_CRITICAL("co_proto_recv_chunk() fails");
+        goto end;
+      }
+
+      msgp->window_update.details.credit = ntohl(msgp->window_update.details.credit);
+      msgp->window_update.details.chcredit = ntohl(msgp->window_update.details.chcredit);
+      break;
+
+    case co_msg_call_req:
+      RECV_DEBUG("recv: call_req sid=%u did=%u", msgp->hdr.sid, msgp->hdr.did);
+
+      if ( msgp->hdr.pldsize < offsetof(struct comsg_call_request, details.bits) - sizeof(msgp->hdr)
+          || msgp->hdr.pldsize > CORPC_MAX_PAYLOAD_SIZE ) {
+        CF_CRITICAL("msgp->hdr.size is invalid: %u", msgp->hdr.pldsize);
+        errno = EPROTO;
+        goto end;
+      }
+
+      if ( !co_proto_read(ssl_sock, &msgp->call_request.details, msgp->hdr.pldsize) ) {
+        CF_CRITICAL("co_proto_read() fails");
+        goto end;
+      }
+
+      msgp->call_request.details.method_id = ntohl(msgp->call_request.details.method_id);
+      msgp->call_request.details.deadline = ntohl(msgp->call_request.details.deadline);
+      break;
+
+    case co_msg_call_resp:
+      RECV_DEBUG("recv: call_resp sid=%u did=%u", msgp->hdr.sid, msgp->hdr.did);
+
+      if ( msgp->hdr.pldsize < sizeof(msgp->call_responce.details.status) || msgp->hdr.pldsize > CORPC_MAX_PAYLOAD_SIZE ) {
+        CF_CRITICAL("msgp->hdr.size is invalid: %u", msgp->hdr.pldsize);
+        errno = EPROTO;
+        goto end;
+      }
+
+      if ( !co_proto_read(ssl_sock, &msgp->call_responce.details, msgp->hdr.pldsize) ) {
+        CF_CRITICAL("co_proto_read() fails");
+        goto end;
+      }
+
+      msgp->call_responce.details.status = ntohs(msgp->call_responce.details.status);
+      break;
+
     default:
       CF_CRITICAL("Invalid msgp->hdr.code=%u", msgp->hdr.code);
       errno = EPROTO;
       goto end;
   }
 
+  if ( comsg_flags(&msgp->hdr) & comsg_flag_nocrc ) {
+    // the channel checks if the stream has negotiated it
+    fok = true;
+    goto end;
+  }
+
   crc_received = msgp->hdr.crc;
 
   crc_actual = calc_crc(&msgp->hdr, sizeof(msgp->hdr) + msgp->hdr.pldsize);
@@ -222,15 +386,23 @@ end:
 
 
 
-bool corpc_proto_send_create_stream_request(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t rwnd, const char * service, const char * method)
+bool corpc_proto_send_create_stream_request(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t rwnd, const char * service, const char * method,
+    const comsg_stream_ext * ext)
 {
   struct comsg_create_stream_request * msg;
+  uint8_t * msgext;
 
   size_t service_name_length = strlen(service);
   size_t method_name_length = strlen(method);
-  size_t payload_size = sizeof(msg->details) + service_name_length + method_name_length;
+  size_t payload_size = sizeof(msg->details) + service_name_length + method_name_length + (ext ? sizeof(*ext) : 0);
   size_t msgsize = offsetof(struct comsg_create_stream_request, details) + payload_size;
 
+  if ( payload_size > CORPC_MAX_PAYLOAD_SIZE ) {
+    CF_CRITICAL("service/method names are too long: payload_size=%zu", payload_size);
+    errno = EINVAL;
+    return false;
+  }
+
   msg = alloca(msgsize);
   msg->hdr.crc = 0;
   msg->hdr.code = co_msg_create_stream_req;
@@ -243,12 +415,19 @@ bool corpc_proto_send_create_stream_request(co_ssl_socket * ssl_sock, uint16_t s
   memcpy(msg->details.pack, service, service_name_length);
   memcpy(msg->details.pack + service_name_length, method, method_name_length);
 
+  if ( (msgext = create_stream_request_ext(msg)) ) {
+    memcpy(msgext, ext, sizeof(*ext));
+  }
+
   set_crc(&msg->hdr, msgsize);
 
   htondr(&msg->hdr);
   msg->details.rwnd = htons(msg->details.rwnd);
   msg->details.service_name_length = htons(service_name_length);
   msg->details.method_name_length = htons(method_name_length);
+  if ( msgext ) {
+    htonext(msgext);
+  }
 
   SEND_DEBUG("send: create_stream_request sid=%u", sid);
 
@@ -256,13 +435,16 @@ bool corpc_proto_send_create_stream_request(co_ssl_socket * ssl_sock, uint16_t s
 }
 
 
-bool corpc_proto_send_create_stream_responce(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t rwnd, uint16_t status)
+bool corpc_proto_send_create_stream_responce(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t rwnd, uint16_t status,
+    const comsg_stream_ext * ext)
 {
+  const size_t msgsize = ext ? sizeof(struct comsg_create_stream_responce) : CORPC_LEGACY_CREATE_STREAM_RESPONCE_SIZE;
+
   struct comsg_create_stream_responce msg = {
     .hdr = {
       .crc = 0,
       .code = co_msg_create_stream_resp,
-      .pldsize = sizeof(msg.details),
+      .pldsize = msgsize - sizeof(msg.hdr),
       .sid = sid,
       .did = did,
     },
@@ -272,16 +454,22 @@ bool corpc_proto_send_create_stream_responce(co_ssl_socket * ssl_sock, uint16_t
     }
   };
 
+  if ( ext ) {
+    msg.details.ext = *ext;
+  }
 
-  set_crc(&msg.hdr, sizeof(msg));
+  set_crc(&msg.hdr, msgsize);
 
   htondr(&msg.hdr);
   msg.details.status = htons(msg.details.status);
   msg.details.rwnd = htons(msg.details.rwnd);
+  if ( ext ) {
+    htonext(&msg.details.ext);
+  }
 
 
   SEND_DEBUG("send: create_stream_responce sid=%u did=%u", sid, did);
-  return (co_ssl_socket_send(ssl_sock, &msg, sizeof(msg)) == sizeof(msg));
+  return (co_ssl_socket_send(ssl_sock, &msg, msgsize) == (ssize_t) msgsize);
 }
 
 bool corpc_proto_send_close_stream(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t status)
@@ -326,10 +514,35 @@ bool corpc_proto_send_data_ack(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t
   return (co_ssl_socket_send(ssl_sock, &msg, sizeof(msg)) == sizeof(msg));
 }
 
-bool corpc_proto_send_data(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, const void * data, size_t size)
+bool corpc_proto_send_window_update(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint32_t credit, uint32_t chcredit)
+{
+  struct comsg_window_update msg = {
+    .hdr = {
+      .code = co_msg_window_update,
+      .pldsize = sizeof(msg.details),
+      .sid = sid,
+      .did = did,
+    },
+    .details = {
+      .credit = credit,
+      .chcredit = chcredit,
+    }
+  };
+
+  set_crc(&msg.hdr, sizeof(msg));
+
+  htondr(&msg.hdr);
+  msg.details.credit = htonl(msg.details.credit);
+  msg.details.chcredit = htonl(msg.details.chcredit);
+
+  SEND_DEBUG("send: window_update sid=%u did=%u credit=%u chcredit=%u", sid, did, credit, chcredit);
+  return (co_ssl_socket_send(ssl_sock, &msg, sizeof(msg)) == sizeof(msg));
+}
+
+bool corpc_proto_send_data(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t flags, const void * data, size_t size)
 {
   struct comsghdr msg = {
-    .code = co_msg_data,
+    .code = co_msg_data | flags,
     .pldsize = size,
     .sid = sid,
     .did = did,
@@ -337,8 +550,16 @@ bool corpc_proto_send_data(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did,
 
   bool fok = false;
 
-  msg.crc = crc_final(crc_update(crc_update(crc_begin(), (const uint8_t*) &msg + sizeof(msg.crc),
-      sizeof(msg) - sizeof(msg.crc)), data, size));
+  if ( size > CORPC_MAX_PAYLOAD_SIZE ) {
+    CF_CRITICAL("data size is too large: %zu", size);
+    errno = EMSGSIZE;
+    return false;
+  }
+
+  if ( !(flags & comsg_flag_nocrc) ) {
+    msg.crc = crc_final(crc_update(crc_update(crc_begin(), (const uint8_t*) &msg + sizeof(msg.crc),
+        sizeof(msg) - sizeof(msg.crc)), data, size));
+  }
 
   htondr(&msg);
 
@@ -353,3 +574,117 @@ bool corpc_proto_send_data(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did,
   return fok;
 }
 
+
+/* Payload was encoded in place after the header space, the frame goes out with single send */
+bool corpc_proto_send_data_frame(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t flags, void * frame,
+    size_t size)
+{
+  comsghdr * msg = frame;
+  const size_t msgsize = sizeof(*msg) + size;
+
+  if ( size > CORPC_MAX_PAYLOAD_SIZE ) {
+    CF_CRITICAL("data size is too large: %zu", size);
+    errno = EMSGSIZE;
+    return false;
+  }
+
+  *msg = (struct comsghdr ) {
+        .code = co_msg_data | flags,
+        .pldsize = size,
+        .sid = sid,
+        .did = did,
+      };
+
+  if ( !(flags & comsg_flag_nocrc) ) {
+    set_crc(msg, msgsize);
+  }
+
+  htondr(msg);
+
+  SEND_DEBUG("send: data frame sid=%u did=%u", sid, did);
+
+  return co_ssl_socket_send(ssl_sock, frame, msgsize) == (ssize_t) msgsize;
+}
+
+
+/* header and fixed part of details are sent from one buffer, payload follows it */
+static bool send_with_payload(co_ssl_socket * ssl_sock, comsghdr * msg, size_t msgsize,
+    void (*hton)(comsghdr *), const void * data, size_t size)
+{
+  bool fok = false;
+
+  if ( !(comsg_flags(msg) & comsg_flag_nocrc) ) {
+    msg->crc = crc_final(crc_update(crc_update(crc_begin(), (const uint8_t*) msg + sizeof(msg->crc),
+        msgsize - sizeof(msg->crc)), data, size));
+  }
+
+  hton(msg);
+
+  if ( co_ssl_socket_send(ssl_sock, msg, msgsize) == (ssize_t) msgsize ) {
+    if ( !size || co_ssl_socket_send(ssl_sock, data, size) == (ssize_t) size ) {
+      fok = true;
+    }
+  }
+
+  return fok;
+}
+
+static void htoncallreq(comsghdr * hdr)
+{
+  struct comsg_call_request_head * msg = (struct comsg_call_request_head *) hdr;
+  msg->details.method_id = htonl(msg->details.method_id);
+  msg->details.deadline = htonl(msg->details.deadline);
+  htondr(&msg->hdr);
+}
+
+static void htoncallresp(comsghdr * hdr)
+{
+  struct comsg_call_responce_head * msg = (struct comsg_call_responce_head *) hdr;
+  msg->details.status = htons(msg->details.status);
+  htondr(&msg->hdr);
+}
+
+bool corpc_proto_send_call_request(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t flags, uint32_t method_id,
+    uint32_t deadline, const void * data, size_t size)
+{
+  struct comsg_call_request_head msg;
+
+  if ( size > CORPC_MAX_CALL_REQUEST_SIZE ) {
+    CF_CRITICAL("call request size is too large: %zu", size);
+    errno = EMSGSIZE;
+    return false;
+  }
+
+  msg.hdr.crc = 0;
+  msg.hdr.code = co_msg_call_req | flags;
+  msg.hdr.sid = sid;
+  msg.hdr.did = 0;
+  msg.hdr.pldsize = sizeof(msg.details) + size;
+  msg.details.method_id = method_id;
+  msg.details.deadline = deadline;
+
+  SEND_DEBUG("send: call_request sid=%u method_id=0x%08X", sid, method_id);
+  return send_with_payload(ssl_sock, &msg.hdr, sizeof(msg), htoncallreq, data, size);
+}
+
+bool corpc_proto_send_call_responce(co_ssl_socket * ssl_sock, uint16_t did, uint16_t flags, uint16_t status,
+    const void * data, size_t size)
+{
+  struct comsg_call_responce_head msg;
+
+  if ( size > CORPC_MAX_CALL_RESPONCE_SIZE ) {
+    CF_CRITICAL("call responce size is too large: %zu", size);
+    errno = EMSGSIZE;
+    return false;
+  }
+
+  msg.hdr.crc = 0;
+  msg.hdr.code = co_msg_call_resp | flags;
+  msg.hdr.sid = 0;
+  msg.hdr.did = did;
+  msg.hdr.pldsize = sizeof(msg.details) + size;
+  msg.details.status = status;
+
+  SEND_DEBUG("send: call_responce did=%u status=%u", did, status);
+  return send_with_payload(ssl_sock, &msg.hdr, sizeof(msg), htoncallresp, data, size);
+}
@@ -27,8 +27,49 @@ enum {
   co_msg_close_stream_req = 3,
   co_msg_data = 4,
   co_msg_data_ack = 5,
+  co_msg_window_update = 6,
+  co_msg_call_req = 7,
+  co_msg_call_resp = 8,
 };
 
+/* Upper byte of comsghdr.code carries message flags.
+ *  Flags are sent only to peers which announced the matching capability */
+#define CORPC_MSG_CODE_MASK   0x00FF
+
+enum {
+  comsg_flag_more = 0x0100,   // co_msg_data, co_msg_call_resp: more fragments of the same message follow
+  comsg_flag_nocrc = 0x0200,  // co_msg_data, co_msg_call_*: crc is not computed, the transport guarantees integrity
+  comsg_flag_early = 0x0400,  // co_msg_data: sent before create_stream_resp, addressed by sender sid, did is 0
+  comsg_flag_compressed = 0x0800, // co_msg_data: first fragment of a message compressed with the stream algorithm
+};
+
+#define COMSG_DATA_FLAGS \
+  (comsg_flag_more|comsg_flag_nocrc|comsg_flag_early|comsg_flag_compressed)
+
+#define COMSG_CALL_REQUEST_FLAGS \
+  (comsg_flag_nocrc)
+
+#define COMSG_CALL_RESPONCE_FLAGS \
+  (comsg_flag_more|comsg_flag_nocrc)
+
+#define comsg_code(hdr)  ((hdr)->code & CORPC_MSG_CODE_MASK)
+#define comsg_flags(hdr) ((hdr)->code & ~CORPC_MSG_CODE_MASK)
+
+
+/* Capability bits exchanged in comsg_stream_ext.caps */
+enum {
+  corpc_cap_byte_window = 0x0001,
+  corpc_cap_fragments = 0x0002,
+  corpc_cap_nocrc = 0x0004,       // accepts comsg_flag_nocrc, announced only over TLS if enabled by options
+  corpc_cap_early_data = 0x0008,  // accepts comsg_flag_early
+  corpc_cap_method_id = 0x0010,   // accepts create_stream_req with method_id and empty names
+  corpc_cap_unary = 0x0020,       // accepts co_msg_call_req
+  corpc_cap_deflate = 0x0040,     // accepts corpc_compression_deflate, announced only if built with zlib
+};
+
+#define CORPC_LOCAL_CAPS \
+  (corpc_cap_byte_window|corpc_cap_fragments|corpc_cap_early_data|corpc_cap_method_id|corpc_cap_unary)
+
 
 typedef
 enum create_stream_responce_code {
@@ -61,6 +102,22 @@ struct comsghdr {
 #define CORPC_MAX_PAYLOAD_SIZE    ((CORPC_MAX_MSG_SIZE) - sizeof(struct comsghdr))
 
 
+/*
+ * Optional stream handshake extension.
+ *  Appended after service and method names of create_stream_req,
+ *  and after create_stream_resp details if the request carried it.
+ *  Old peers ignore trailing bytes of the request and therefore never get the extended responce.
+ */
+typedef
+struct comsg_stream_ext {
+  uint32_t caps;    // corpc_cap_* bits
+  uint32_t rwnd;    // stream receive window, bytes
+  uint32_t chwnd;   // channel receive window, bytes
+  uint32_t method_id; // create_stream_req: corpc_method_id(), 0 if names are used
+  uint32_t deadline;  // create_stream_req: ms left until the caller gives up on the stream, 0 if never
+  uint32_t priority;  // create_stream_req: enum corpc_stream_priority, applied to the accepted side too
+  uint32_t compression; // create_stream_req: enum corpc_compression wanted by the caller, create_stream_resp: accepted one
+} comsg_stream_ext;
 
 
 typedef
@@ -80,9 +137,13 @@ struct comsg_create_stream_responce {
   struct {
     uint16_t status;
     uint16_t rwnd;
+    struct comsg_stream_ext ext;
   } details;
 } comsg_create_stream_responce;
 
+#define CORPC_LEGACY_CREATE_STREAM_RESPONCE_SIZE \
+  offsetof(struct comsg_create_stream_responce, details.ext)
+
 
 
 
@@ -111,6 +172,66 @@ struct comsg_data_ack {
   struct comsghdr hdr;
 } comsg_data_ack;
 
+/*
+ * Unary call: single request frame addressed by method id, no stream handshake.
+ *  The caller sid identifies the call, the responce comes back with did = caller sid
+ *  as one or more call_resp frames, all of them carry the status.
+ *  Neither is accounted in stream or channel windows.
+ *  The caller cancels the call by close_stream_req with its sid and did = 0.
+ */
+typedef
+struct comsg_call_request {
+  struct comsghdr hdr;
+  struct {
+    uint32_t method_id;
+    uint32_t deadline;  // as in comsg_stream_ext
+    uint8_t bits[CORPC_MAX_PAYLOAD_SIZE - 2 * sizeof(uint32_t)];
+  } details;
+} comsg_call_request;
+
+typedef
+struct comsg_call_responce {
+  struct comsghdr hdr;
+  struct {
+    uint16_t status;  // create_stream_responce_code
+    uint8_t bits[CORPC_MAX_PAYLOAD_SIZE - sizeof(uint16_t)];
+  } details;
+} comsg_call_responce;
+
+/* fixed parts of the above, sent in front of the caller payload */
+typedef
+struct comsg_call_request_head {
+  struct comsghdr hdr;
+  struct {
+    uint32_t method_id;
+    uint32_t deadline;
+  } details;
+} comsg_call_request_head;
+
+typedef
+struct comsg_call_responce_head {
+  struct comsghdr hdr;
+  struct {
+    uint16_t status;
+  } details;
+} comsg_call_responce_head;
+
+#define CORPC_MAX_CALL_REQUEST_SIZE \
+  sizeof(((struct comsg_call_request*)0)->details.bits)
+
+#define CORPC_MAX_CALL_RESPONCE_SIZE \
+  sizeof(((struct comsg_call_responce*)0)->details.bits)
+
+
+typedef
+struct comsg_window_update {
+  struct comsghdr hdr;
+  struct {
+    uint32_t credit;    // stream window increment, bytes
+    uint32_t chcredit;  // channel window increment, bytes
+  } details;
+} comsg_window_update;
+
 
 //
 
@@ -123,6 +244,9 @@ struct comsg {
     comsg_close_stream close_stream;
     comsg_data data;
     comsg_data_ack data_ack;
+    comsg_window_update window_update;
+    comsg_call_request call_request;
+    comsg_call_responce call_responce;
   };
 } comsg;
 
@@ -131,11 +255,25 @@ struct comsg {
 
 
 bool corpc_proto_recv_msg(co_ssl_socket * ssl_sock, comsg * msgp);
-bool corpc_proto_send_create_stream_request(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t rwnd, const char * service, const char * method);
-bool corpc_proto_send_create_stream_responce(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t rwnd, uint16_t status);
+bool corpc_proto_send_create_stream_request(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t rwnd, const char * service, const char * method,
+    const comsg_stream_ext * ext);
+bool corpc_proto_send_create_stream_responce(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t rwnd, uint16_t status,
+    const comsg_stream_ext * ext);
 bool corpc_proto_send_close_stream(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t status);
-bool corpc_proto_send_data(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, const void * data, size_t size);
+bool corpc_proto_send_data(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t flags, const void * data, size_t size);
+/* frame = struct comsghdr space followed by size bytes of payload */
+bool corpc_proto_send_data_frame(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint16_t flags, void * frame,
+    size_t size);
 bool corpc_proto_send_data_ack(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did);
+bool corpc_proto_send_window_update(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t did, uint32_t credit, uint32_t chcredit);
+bool corpc_proto_send_call_request(co_ssl_socket * ssl_sock, uint16_t sid, uint16_t flags, uint32_t method_id,
+    uint32_t deadline, const void * data, size_t size);
+bool corpc_proto_send_call_responce(co_ssl_socket * ssl_sock, uint16_t did, uint16_t flags, uint16_t status,
+    const void * data, size_t size);
+
+/* copy the extension out of a received message, false if the peer did not send it */
+bool corpc_proto_get_create_stream_request_ext(const comsg_create_stream_request * msg, comsg_stream_ext * ext);
+bool corpc_proto_get_create_stream_responce_ext(const comsg_create_stream_responce * msg, comsg_stream_ext * ext);
 
 
 
@@ -1432,7 +1432,7 @@ bool co_socket_create(co_socket * cc, int af, int sock_type, int proto)
     sock_type = SOCK_STREAM;
   }
 
-  if ( !proto ) {
+  if ( !proto && af != AF_UNIX ) {
     proto = IPPROTO_TCP;
   }
 
@@ -1481,7 +1481,13 @@ bool co_socket_create_listening(co_socket * cc, const struct sockaddr * addrs, i
     goto end;
   }
 
-  so_set_reuse_addrs(cc->e.so, 1);
+  if ( addrs->sa_family != AF_UNIX ) {
+    so_set_reuse_addrs(cc->e.so, 1);
+  }
+  else if ( *((const struct sockaddr_un *) addrs)->sun_path ) {
+    // stale socket file left by previous run
+    unlink(((const struct sockaddr_un *) addrs)->sun_path);
+  }
 
   if ( bind(cc->e.so, addrs, so_get_addrlen(addrs)) == -1 ) {
     goto end;
@@ -1720,6 +1726,71 @@ ssize_t co_socket_recv(co_socket * cc, void * buf, size_t buf_size, int flags)
   return size;
 }
 
+// single sendmsg() / recvmsg() call, used to pass ancillary data such as SCM_RIGHTS
+static ssize_t co_socket_xmsg(co_socket * cc, struct msghdr * msg, int flags, bool out)
+{
+  struct io_waiter * w;
+  ssize_t size = -1;
+  int tmo;
+
+  if ( !cc || cc->e.so == -1 ) {
+    errno = EBADF;
+  }
+  else if ( !msg ) {
+    errno = EINVAL;
+  }
+  else {
+
+    tmo = out ? cc->sendtmo : cc->recvtmo;
+
+    struct cclist_node * node =
+        add_waiter(current_core, &(struct io_waiter ) {
+              .co = co_current(),
+              .tmo = tmo >= 0 ? co_current_time_ms() + tmo : -1,
+              .mask = out ? EPOLLOUT : EPOLLIN
+            });
+
+    if ( !node ) {
+      CF_FATAL("add_waiter() fails");
+    }
+    else {
+
+      epoll_queue(&cc->e, w = cclist_peek(node));
+
+      while ( cc->e.so != -1 && (size = out ? sendmsg(cc->e.so, msg, flags | MSG_DONTWAIT | MSG_NOSIGNAL) :
+          recvmsg(cc->e.so, msg, flags | MSG_DONTWAIT | MSG_CMSG_CLOEXEC)) < 0 && errno == EAGAIN ) {
+        if ( w->tmo != -1 && co_current_time_ms() >= w->tmo ) {
+          errno = ETIME;
+          break;
+        }
+        co_call(current_core->main);
+      }
+
+      epoll_dequeue(&cc->e, w);
+      remove_waiter(current_core, node);
+
+      if ( cc->e.so == -1 ) {
+        errno = ECONNABORTED;    // see co_socket_close()
+      }
+      else if ( !out && size == 0 ) {
+        errno = ECONNRESET;
+      }
+    }
+  }
+
+  return size;
+}
+
+ssize_t co_socket_sendmsg(co_socket * cc, const struct msghdr * msg, int flags)
+{
+  return co_socket_xmsg(cc, (struct msghdr *) msg, flags, true);
+}
+
+ssize_t co_socket_recvmsg(co_socket * cc, struct msghdr * msg, int flags)
+{
+  return co_socket_xmsg(cc, msg, flags, false);
+}
+
 
 bool co_socket_accept(co_socket * listenning, co_socket * accepted, struct sockaddr * addrs, socklen_t * addrslen)
 {
@@ -1780,6 +1851,68 @@ co_socket * co_socket_connect_new(const struct sockaddr *address, int sock_type,
   return cc;
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// eventfd doorbells
+
+bool co_eventfd_init(struct iorq * e, int efd)
+{
+  e->type = iowait_eventfd;
+  e->tail = e->head = NULL;
+  e->so = efd;
+
+  if ( !set_non_blocking(efd, true) || !epoll_add(e, EPOLLIN) ) {
+    e->so = -1;
+    return false;
+  }
+
+  return true;
+}
+
+void co_eventfd_cleanup(struct iorq * e)
+{
+  if ( e->so != -1 ) {
+    epoll_remove(e->so);
+    close(e->so);
+    e->so = -1;
+  }
+}
+
+bool co_eventfd_wait(struct iorq * e, bool (*ready)(void * arg), void * arg, int tmo_ms)
+{
+  struct io_waiter * w;
+  bool fok = false;
+
+  struct cclist_node * node =
+      add_waiter(current_core, &(struct io_waiter ) {
+            .co = co_current(),
+            .tmo = tmo_ms >= 0 ? co_current_time_ms() + tmo_ms : -1,
+            .mask = EPOLLIN
+          });
+
+  if ( !node ) {
+    CF_FATAL("add_waiter() fails");
+  }
+  else {
+
+    // queue the waiter first so that a signal coming after ready() check is not lost
+    epoll_queue(e, w = cclist_peek(node));
+
+    while ( !(fok = ready(arg)) ) {
+      if ( w->tmo != -1 && co_current_time_ms() >= w->tmo ) {
+        errno = ETIME;
+        break;
+      }
+      co_call(current_core->main);
+    }
+
+    epoll_dequeue(e, w);
+    remove_waiter(current_core, node);
+  }
+
+  return fok;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // co io
 
@@ -50,6 +50,12 @@ bool co_socket_create(co_socket * cc, int af, int sock_type, int proto);
 bool co_socket_create_listening(co_socket * cc, const struct sockaddr * addrs, int sock_type, int proto);
 bool co_socket_accept(co_socket * listenning, co_socket * accepted, struct sockaddr * addrs, socklen_t * addrslen);
 
+/* Eventfd registered with the scheduler, possibly shared with other process.
+ *  co_eventfd_wait() returns when ready(arg) is true, it is re-evaluated after each signal */
+bool co_eventfd_init(struct iorq * e, int efd); // takes ownership
+void co_eventfd_cleanup(struct iorq * e);
+bool co_eventfd_wait(struct iorq * e, bool (*ready)(void * arg), void * arg, int tmo_ms);
+
 #ifdef __cplusplus
 }
 #endif
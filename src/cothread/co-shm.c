@@ -0,0 +1,482 @@
+/*
+ * co-shm.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Each direction is a single producer / single consumer byte ring in a memfd mapping.
+ *  A side sleeps on its own eventfd and announces it in the ring before sleeping,
+ *  the peer writes the eventfd only then, so busy peers exchange data without syscalls.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <cuttle/debug.h>
+#include <cuttle/time.h>
+#include "co-shm.h"
+
+
+#define CO_SHM_MAGIC            0x4D485343  // "CSHM"
+#define CO_SHM_VERSION          1
+#define CO_SHM_MIN_RING_SIZE    (128*1024)
+#define CO_SHM_CACHELINE        64
+#define CO_SHM_HEADER_SIZE      4096
+#define CO_SHM_SPIN             32    // co_yield() rounds before going to sleep
+#define CO_SHM_LIVENESS_MS      500   // peer death check interval while sleeping
+
+// the accepting side maps the client memfd only if its size can't change anymore,
+// otherwise the client could truncate it and crash the server with SIGBUS
+#define CO_SHM_SEALS            (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+struct co_shm_ring {
+  uint64_t head __attribute__((aligned(CO_SHM_CACHELINE)));  // bytes written, advanced by producer
+  uint32_t reader_waiting;
+  uint64_t tail __attribute__((aligned(CO_SHM_CACHELINE)));  // bytes read, advanced by consumer
+  uint32_t writer_waiting;
+  uint8_t data[] __attribute__((aligned(CO_SHM_CACHELINE)));
+};
+
+struct co_shm_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t ring_size;
+  uint32_t closed[2];
+};
+
+struct co_shm {
+  struct co_shm_header * hdr;
+  struct co_shm_ring * tx, * rx;
+  size_t mapsize;
+  uint64_t mask;
+  struct iorq doorbell; // own eventfd
+  int peer_doorbell;
+  co_socket * cc;
+  int side;             // 0 connecting, 1 accepting
+};
+
+struct co_shm_wait {
+  co_shm * shm;
+  uint32_t * flag;
+  bool (*cond)(const co_shm *);
+};
+
+
+static size_t ring_offset(uint64_t ring_size, int i)
+{
+  return CO_SHM_HEADER_SIZE + i * ((sizeof(struct co_shm_ring) + ring_size + 4095) & ~(size_t) 4095);
+}
+
+static size_t map_size(uint64_t ring_size)
+{
+  return ring_offset(ring_size, 2);
+}
+
+static co_shm * shm_map(int memfd, uint64_t ring_size, int side, int doorbell, int peer_doorbell, co_socket * cc)
+{
+  co_shm * shm;
+  void * p;
+
+  if ( !(shm = calloc(1, sizeof(*shm))) ) {
+    return NULL;
+  }
+
+  shm->mapsize = map_size(ring_size);
+
+  if ( (p = mmap(NULL, shm->mapsize, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0)) == MAP_FAILED ) {
+    CF_CRITICAL("mmap(%zu) fails: %s", shm->mapsize, strerror(errno));
+    free(shm);
+    return NULL;
+  }
+
+  if ( !co_eventfd_init(&shm->doorbell, doorbell) ) {
+    CF_CRITICAL("co_eventfd_init() fails: %s", strerror(errno));
+    munmap(p, shm->mapsize);
+    free(shm);
+    return NULL;
+  }
+
+  shm->hdr = p;
+  shm->tx = (struct co_shm_ring *) ((uint8_t*) p + ring_offset(ring_size, side));
+  shm->rx = (struct co_shm_ring *) ((uint8_t*) p + ring_offset(ring_size, !side));
+  shm->mask = ring_size - 1;
+  shm->peer_doorbell = peer_doorbell;
+  shm->cc = cc;
+  shm->side = side;
+
+  return shm;
+}
+
+
+co_shm * co_shm_connect(co_socket * cc, size_t ring_size)
+{
+  co_shm * shm = NULL;
+  int fds[3] = { -1, -1, -1 }; // memfd, doorbell of side 0, doorbell of side 1
+  struct co_shm_header * hdr;
+  char ack = 0;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } ctl;
+  struct msghdr msg;
+  struct cmsghdr * cmsg;
+  bool fok = false;
+
+  if ( !ring_size ) {
+    ring_size = CO_SHM_DEFAULT_RING_SIZE;
+  }
+  if ( ring_size < CO_SHM_MIN_RING_SIZE || (ring_size & (ring_size - 1)) ) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  if ( (fds[0] = memfd_create("co-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1 ) {
+    CF_CRITICAL("memfd_create() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( ftruncate(fds[0], map_size(ring_size)) == -1 ) {
+    CF_CRITICAL("ftruncate(%zu) fails: %s", map_size(ring_size), strerror(errno));
+    goto end;
+  }
+
+  if ( fcntl(fds[0], F_ADD_SEALS, CO_SHM_SEALS) == -1 ) {
+    CF_CRITICAL("fcntl(F_ADD_SEALS) fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( (fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 || (fds[2] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ) {
+    CF_CRITICAL("eventfd() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( (hdr = mmap(NULL, CO_SHM_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0)) == MAP_FAILED ) {
+    CF_CRITICAL("mmap() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  hdr->magic = CO_SHM_MAGIC;
+  hdr->version = CO_SHM_VERSION;
+  hdr->ring_size = ring_size;
+  munmap(hdr, CO_SHM_HEADER_SIZE);
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &(struct iovec ) { .iov_base = &ack, .iov_len = 1 };
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl.buf;
+  msg.msg_controllen = sizeof(ctl.buf);
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  if ( co_socket_sendmsg(cc, &msg, 0) != 1 ) {
+    CF_CRITICAL("co_socket_sendmsg() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( co_socket_recv(cc, &ack, 1, 0) != 1 || ack != 1 ) {
+    CF_CRITICAL("peer refused shared memory rings: %s", strerror(errno));
+    errno = ECONNREFUSED;
+    goto end;
+  }
+
+  if ( !(shm = shm_map(fds[0], ring_size, 0, fds[1], fds[2], cc)) ) {
+    goto end;
+  }
+
+  fds[1] = fds[2] = -1; // owned by shm now
+  fok = true;
+
+end:
+
+  for ( int i = 0; i < 3; ++i ) {
+    if ( fds[i] != -1 && (i == 0 || !fok) ) {
+      close(fds[i]);
+    }
+  }
+
+  return shm;
+}
+
+co_shm * co_shm_accept(co_socket * cc)
+{
+  co_shm * shm = NULL;
+  int fds[3] = { -1, -1, -1 };
+  struct co_shm_header * hdr = MAP_FAILED;
+  struct stat st;
+  uint64_t ring_size = 0;
+  int seals;
+  char ack = 0;
+  union {
+    struct cmsghdr align;
+    char buf[CMSG_SPACE(sizeof(fds))];
+  } ctl;
+  struct msghdr msg;
+  struct cmsghdr * cmsg;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &(struct iovec ) { .iov_base = &ack, .iov_len = 1 };
+  msg.msg_iovlen = 1;
+  msg.msg_control = ctl.buf;
+  msg.msg_controllen = sizeof(ctl.buf);
+
+  if ( co_socket_recvmsg(cc, &msg, 0) != 1 ) {
+    CF_CRITICAL("co_socket_recvmsg() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  if ( !(cmsg = CMSG_FIRSTHDR(&msg)) || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+      || cmsg->cmsg_len != CMSG_LEN(sizeof(fds)) ) {
+    CF_CRITICAL("no shared memory descriptors received");
+    errno = EPROTO;
+    goto end;
+  }
+
+  memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+
+  if ( (seals = fcntl(fds[0], F_GET_SEALS)) == -1 || (seals & CO_SHM_SEALS) != CO_SHM_SEALS ) {
+    CF_CRITICAL("shared memory is not sealed against resizing: seals=0x%X", seals);
+    errno = EPERM;
+    goto end;
+  }
+
+  if ( fstat(fds[0], &st) == -1 || (size_t) st.st_size < CO_SHM_HEADER_SIZE ) {
+    CF_CRITICAL("invalid shared memory size");
+    errno = EPROTO;
+    goto end;
+  }
+
+  if ( (hdr = mmap(NULL, CO_SHM_HEADER_SIZE, PROT_READ, MAP_SHARED, fds[0], 0)) == MAP_FAILED ) {
+    CF_CRITICAL("mmap() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  ring_size = hdr->ring_size;
+
+  if ( hdr->magic != CO_SHM_MAGIC || hdr->version != CO_SHM_VERSION || ring_size < CO_SHM_MIN_RING_SIZE
+      || (ring_size & (ring_size - 1)) || (size_t) st.st_size < map_size(ring_size) ) {
+    CF_CRITICAL("invalid shared memory header");
+    errno = EPROTO;
+    goto end;
+  }
+
+  if ( !(shm = shm_map(fds[0], ring_size, 1, fds[2], fds[1], cc)) ) {
+    goto end;
+  }
+
+  fds[1] = fds[2] = -1;
+
+  ack = 1;
+  if ( co_socket_send(cc, &ack, 1, 0) != 1 ) {
+    CF_CRITICAL("co_socket_send(ack) fails: %s", strerror(errno));
+    co_shm_destroy(&shm);
+  }
+
+end:
+
+  if ( hdr != MAP_FAILED ) {
+    munmap(hdr, CO_SHM_HEADER_SIZE);
+  }
+
+  for ( int i = 0; i < 3; ++i ) {
+    if ( fds[i] != -1 ) {
+      close(fds[i]);
+    }
+  }
+
+  return shm;
+}
+
+
+static bool shm_closed(const co_shm * shm)
+{
+  return __atomic_load_n(&shm->hdr->closed[0], __ATOMIC_ACQUIRE) || __atomic_load_n(&shm->hdr->closed[1], __ATOMIC_ACQUIRE)
+      || shm->cc->e.so == -1;
+}
+
+static bool peer_alive(const co_shm * shm)
+{
+  char c;
+  ssize_t n = recv(shm->cc->e.so, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return n > 0 || (n < 0 && errno == EAGAIN);
+}
+
+void co_shm_close(co_shm * shm)
+{
+  if ( shm ) {
+    __atomic_store_n(&shm->hdr->closed[shm->side], 1, __ATOMIC_RELEASE);
+    eventfd_write(shm->peer_doorbell, 1);
+    eventfd_write(shm->doorbell.so, 1); // wake own waiters
+  }
+}
+
+void co_shm_destroy(co_shm ** shm)
+{
+  if ( shm && *shm ) {
+    co_shm_close(*shm);
+    munmap((*shm)->hdr, (*shm)->mapsize);
+    co_eventfd_cleanup(&(*shm)->doorbell);
+    close((*shm)->peer_doorbell);
+    free(*shm), *shm = NULL;
+  }
+}
+
+
+static bool rx_ready(const co_shm * shm)
+{
+  return __atomic_load_n(&shm->rx->head, __ATOMIC_ACQUIRE) != shm->rx->tail;
+}
+
+static bool tx_ready(const co_shm * shm)
+{
+  return shm->tx->head - __atomic_load_n(&shm->tx->tail, __ATOMIC_ACQUIRE) <= shm->mask;
+}
+
+static void notify_peer(co_shm * shm, uint32_t * flag)
+{
+  // pairs with the fence in wait_ready()
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if ( __atomic_load_n(flag, __ATOMIC_RELAXED) ) {
+    __atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+    eventfd_write(shm->peer_doorbell, 1);
+  }
+}
+
+static bool wait_ready(void * arg)
+{
+  struct co_shm_wait * w = arg;
+  __atomic_store_n(w->flag, 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with the fence in notify_peer()
+  return w->cond(w->shm) || shm_closed(w->shm);
+}
+
+static bool shm_wait(co_shm * shm, uint32_t * flag, bool (*cond)(const co_shm *), int tmo_ms)
+{
+  struct co_shm_wait w = { .shm = shm, .flag = flag, .cond = cond };
+  int64_t deadline = tmo_ms >= 0 ? cf_get_monotic_ms() + tmo_ms : -1;
+  int slice;
+
+  for ( int i = 0; i < CO_SHM_SPIN; ++i ) {
+    if ( cond(shm) ) {
+      return true;
+    }
+    co_yield();
+  }
+
+  while ( 42 ) {
+
+    slice = deadline < 0 ? CO_SHM_LIVENESS_MS : (int) (deadline - cf_get_monotic_ms());
+    if ( slice > CO_SHM_LIVENESS_MS ) {
+      slice = CO_SHM_LIVENESS_MS;
+    }
+
+    if ( co_eventfd_wait(&shm->doorbell, wait_ready, &w, slice > 0 ? slice : 0) ) {
+      break;
+    }
+
+    if ( deadline >= 0 && cf_get_monotic_ms() >= deadline ) {
+      errno = ETIME;
+      return false;
+    }
+
+    if ( !peer_alive(shm) ) {
+      errno = ECONNRESET;
+      return false;
+    }
+  }
+
+  __atomic_store_n(flag, 0, __ATOMIC_RELAXED);
+
+  if ( cond(shm) ) {
+    return true;
+  }
+
+  errno = shm->cc->e.so == -1 ? ECONNABORTED : ECONNRESET;
+  return false;
+}
+
+
+ssize_t co_shm_send(co_shm * shm, const void * buf, size_t size)
+{
+  struct co_shm_ring * r = shm->tx;
+  const uint8_t * p = buf;
+  uint64_t head, space;
+  size_t sent = 0, n, off, first;
+
+  while ( sent < size ) {
+
+    if ( shm_closed(shm) ) {
+      errno = shm->cc->e.so == -1 ? ECONNABORTED : EPIPE;
+      return -1;
+    }
+
+    head = r->head;
+    space = shm->mask + 1 - (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE));
+
+    if ( !space ) {
+      if ( !shm_wait(shm, &r->writer_waiting, tx_ready, shm->cc->sendtmo) ) {
+        return -1;
+      }
+      continue;
+    }
+
+    n = size - sent < space ? size - sent : space;
+    off = head & shm->mask;
+    first = n < shm->mask + 1 - off ? n : shm->mask + 1 - off;
+
+    memcpy(r->data + off, p + sent, first);
+    memcpy(r->data, p + sent + first, n - first);
+
+    __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+    notify_peer(shm, &r->reader_waiting);
+
+    sent += n;
+  }
+
+  return sent;
+}
+
+ssize_t co_shm_recv(co_shm * shm, void * buf, size_t size)
+{
+  struct co_shm_ring * r = shm->rx;
+  uint8_t * p = buf;
+  uint64_t tail, avail;
+  size_t received = 0, n, off, first;
+
+  while ( received < size ) {
+
+    tail = r->tail;
+    avail = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) - tail;
+
+    if ( !avail ) {
+      if ( !shm_wait(shm, &r->reader_waiting, rx_ready, shm->cc->recvtmo) ) {
+        return -1;
+      }
+      continue;
+    }
+
+    n = size - received < avail ? size - received : avail;
+    off = tail & shm->mask;
+    first = n < shm->mask + 1 - off ? n : shm->mask + 1 - off;
+
+    memcpy(p + received, r->data + off, first);
+    memcpy(p + received + first, r->data, n - first);
+
+    __atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+    notify_peer(shm, &r->writer_waiting);
+
+    received += n;
+  }
+
+  return received;
+}
@@ -0,0 +1,45 @@
+/*
+ * co-shm.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Shared memory ring pair between two processes on one host
+ */
+
+#pragma once
+
+#ifndef __cuttle_cothread_co_shm_h__
+#define __cuttle_cothread_co_shm_h__
+
+#include "co-scheduler.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef
+struct co_shm
+  co_shm;
+
+#define CO_SHM_DEFAULT_RING_SIZE  (1024*1024)
+
+/* Both calls run over connected AF_UNIX socket, which is then only watched for peer death.
+ *  The connecting side creates the rings and passes them with SCM_RIGHTS,
+ *  the accepting side attaches and confirms */
+co_shm * co_shm_connect(co_socket * cc, size_t ring_size);
+co_shm * co_shm_accept(co_socket * cc);
+
+void co_shm_close(co_shm * shm);
+void co_shm_destroy(co_shm ** shm);
+
+/* send() writes all bytes, recv() fills whole buffer, both block while the rings are full / empty */
+ssize_t co_shm_send(co_shm * shm, const void * buf, size_t size);
+ssize_t co_shm_recv(co_shm * shm, void * buf, size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __cuttle_cothread_co_shm_h__ */
@@ -16,6 +16,7 @@
 #include <cuttle/cothread/resolve.h>
 #include <cuttle/cothread/ssl.h>
 #include "co-scheduler.h"
+#include "co-shm.h"
 
 //////////////////////////////////////////////////////////////////////////
 
@@ -130,11 +131,13 @@ void co_ssl_free(SSL ** ssl)
 struct co_ssl_socket {
   co_socket cc;
   SSL * ssl;
+  co_shm * shm;
 };
 
 bool co_ssl_socket_init(co_ssl_socket * cc, int so)
 {
   cc->ssl = NULL;
+  cc->shm = NULL;
   return co_socket_init(&cc->cc, so);
 }
 
@@ -153,6 +156,7 @@ bool co_ssl_socket_create(co_ssl_socket * cc, int af, int sock_type, int proto,
   bool fok = false;
 
   cc->ssl = NULL;
+  cc->shm = NULL;
 
   if ( !co_socket_create(&cc->cc, af, sock_type, proto) ) {
     CF_SSL_ERR(CF_SSL_ERR_STDIO, "co_socket_create() fails: %s", strerror(errno));
@@ -283,6 +287,7 @@ void co_ssl_socket_close(co_ssl_socket * ssl_sock, bool abort_conn)
 {
   if ( ssl_sock ) {
     co_socket_close(&ssl_sock->cc, abort_conn);
+    co_shm_close(ssl_sock->shm);
   }
 }
 
@@ -290,12 +295,61 @@ void co_ssl_socket_destroy(co_ssl_socket ** ssl_sock, bool abort_conn)
 {
   if ( ssl_sock && *ssl_sock ) {
     co_socket_close(&(*ssl_sock)->cc, abort_conn);
+    co_shm_destroy(&(*ssl_sock)->shm);
     co_ssl_free(&(*ssl_sock)->ssl);
     free(*ssl_sock), *ssl_sock = NULL;
   }
 }
 
 
+static bool check_shm_socket(co_ssl_socket * ssl_sock)
+{
+  sockaddr_type addrs;
+  socklen_t addrslen = sizeof(addrs);
+
+  if ( !ssl_sock ) {
+    errno = EBADF;
+  }
+  else if ( ssl_sock->ssl || ssl_sock->shm ) {
+    errno = EINVAL;
+  }
+  else if ( !co_socket_get_sockname(&ssl_sock->cc, &addrs.sa, &addrslen) || addrs.sa.sa_family != AF_UNIX ) {
+    errno = EAFNOSUPPORT;
+  }
+  else {
+    return true;
+  }
+
+  return false;
+}
+
+bool co_ssl_socket_shm_connect(co_ssl_socket * ssl_sock, size_t ring_size)
+{
+  if ( !check_shm_socket(ssl_sock) ) {
+    CF_SSL_ERR(CF_SSL_ERR_INVALID_ARG, "not a plain text AF_UNIX socket: %s", strerror(errno));
+    return false;
+  }
+  if ( !(ssl_sock->shm = co_shm_connect(&ssl_sock->cc, ring_size)) ) {
+    CF_SSL_ERR(CF_SSL_ERR_STDIO, "co_shm_connect() fails: %s", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool co_ssl_socket_shm_accept(co_ssl_socket * ssl_sock)
+{
+  if ( !check_shm_socket(ssl_sock) ) {
+    CF_SSL_ERR(CF_SSL_ERR_INVALID_ARG, "not a plain text AF_UNIX socket: %s", strerror(errno));
+    return false;
+  }
+  if ( !(ssl_sock->shm = co_shm_accept(&ssl_sock->cc)) ) {
+    CF_SSL_ERR(CF_SSL_ERR_STDIO, "co_shm_accept() fails: %s", strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+
 
 
 
@@ -349,6 +403,11 @@ ssize_t co_ssl_socket_send(co_ssl_socket * ssl_sock, const void * buf, size_t si
   else if ( ssl_sock->ssl ) {
     bytes_sent = SSL_write(ssl_sock->ssl, buf, size);
   }
+  else if ( ssl_sock->shm ) {
+    if ( (bytes_sent = co_shm_send(ssl_sock->shm, buf, size)) < 0 ) {
+      CF_SSL_ERR(CF_SSL_ERR_STDIO, "co_shm_send() fails: %s", strerror(errno));
+    }
+  }
   else if ( (bytes_sent = co_socket_send(&ssl_sock->cc, buf, size, 0)) < 0 ) {
     CF_SSL_ERR(CF_SSL_ERR_STDIO, "co_socket_send() fails: %s", strerror(errno));
   }
@@ -373,6 +432,11 @@ ssize_t co_ssl_socket_recv(co_ssl_socket * ssl_sock, void * buf, size_t size)
       CF_SSL_ERR(CF_SSL_ERR_OPENSSL, "SSL_read() fails");
     }
   }
+  else if ( ssl_sock->shm ) {
+    if ( (bytes_received = co_shm_recv(ssl_sock->shm, buf, size)) <= 0 ) {
+      CF_SSL_ERR(CF_SSL_ERR_STDIO, "co_shm_recv() fails: %s", strerror(errno));
+    }
+  }
   else if ( (bytes_received = co_socket_recv(&ssl_sock->cc, buf, size, 0)) <= 0 ) {
     CF_SSL_ERR(CF_SSL_ERR_STDIO, "co_socket_recv() fails: %s", strerror(errno));
   }
@@ -14,6 +14,16 @@
 #include <cuttle/hash/crc32.h>
 #include <endian.h>
 #include <string.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+# include <nmmintrin.h>
+# include <cpuid.h>
+#elif defined(__aarch64__)
+# include <arm_acle.h>
+# include <sys/auxv.h>
+# include <asm/hwcap.h>
+#endif
 
 #define CRC32BASE         0xffffffff
 #define SCTP_CRC32C_POLY  0x1EDC6F41
@@ -112,8 +122,11 @@ uint32_t cf_crc32_begin(void) {
   return CRC32BASE;
 }
 
-/** Note crc32 should be initialized to 0xffffffff */
-uint32_t cf_crc32_update(uint32_t crc, const void * buff, size_t length)
+
+/*
+ * Byte-at-a-time reference implementation
+ */
+static uint32_t crc32_update_table(uint32_t crc, const void * buff, size_t length)
 {
   size_t i;
   const uint8_t * buffer = buff;
@@ -123,6 +136,332 @@ uint32_t cf_crc32_update(uint32_t crc, const void * buff, size_t length)
   return (crc);
 }
 
+
+/*
+ * Slicing-by-8, portable fallback
+ */
+static uint32_t crc_s8[8][256];
+
+static void crc32_init_slice8(void)
+{
+  for ( int n = 0; n < 256; ++n ) {
+    crc_s8[0][n] = crc_c[n];
+  }
+  for ( int n = 0; n < 256; ++n ) {
+    for ( int k = 1; k < 8; ++k ) {
+      crc_s8[k][n] = (crc_s8[k - 1][n] >> 8) ^ crc_s8[0][crc_s8[k - 1][n] & 0xFF];
+    }
+  }
+}
+
+static uint32_t crc32_update_slice8(uint32_t crc, const void * buff, size_t length)
+{
+  const uint8_t * p = buff;
+  uint64_t w;
+
+  while ( length && ((uintptr_t) p & 7) ) {
+    crc = (crc >> 8) ^ crc_s8[0][(crc ^ *p++) & 0xFF];
+    --length;
+  }
+
+  while ( length >= 8 ) {
+    memcpy(&w, p, 8);
+    w = le64toh(w) ^ crc;
+    crc = crc_s8[7][w & 0xFF] ^ crc_s8[6][(w >> 8) & 0xFF] ^ crc_s8[5][(w >> 16) & 0xFF] ^ crc_s8[4][(w >> 24) & 0xFF]
+        ^ crc_s8[3][(w >> 32) & 0xFF] ^ crc_s8[2][(w >> 40) & 0xFF] ^ crc_s8[1][(w >> 48) & 0xFF] ^ crc_s8[0][w >> 56];
+    p += 8, length -= 8;
+  }
+
+  while ( length-- ) {
+    crc = (crc >> 8) ^ crc_s8[0][(crc ^ *p++) & 0xFF];
+  }
+
+  return crc;
+}
+
+
+#if defined(__x86_64__)
+/*
+ * SSE4.2 crc32 instruction has 3 cycles latency and 1 cycle throughput,
+ * so three independent streams are computed in parallel and then combined
+ * by shifting the crc over the length of the following blocks.
+ * See Mark Adler's crc32c.c, https://stackoverflow.com/a/17646775
+ */
+#define CRC32_LONG_BLOCK  8192
+#define CRC32_SHORT_BLOCK 256
+
+static uint32_t crc_long[4][256];
+static uint32_t crc_short[4][256];
+
+static uint32_t gf2_matrix_times(const uint32_t * mat, uint32_t vec)
+{
+  uint32_t sum = 0;
+  while ( vec ) {
+    if ( vec & 1 ) {
+      sum ^= *mat;
+    }
+    vec >>= 1;
+    ++mat;
+  }
+  return sum;
+}
+
+static void gf2_matrix_square(uint32_t * square, const uint32_t * mat)
+{
+  for ( int n = 0; n < 32; ++n ) {
+    square[n] = gf2_matrix_times(mat, mat[n]);
+  }
+}
+
+// operator appending len zero bytes to a crc, len must be a power of two
+static void crc32_zeros_op(uint32_t * even, size_t len)
+{
+  uint32_t odd[32];
+  uint32_t row = 1;
+
+  odd[0] = 0x82F63B78; // reflected SCTP_CRC32C_POLY
+  for ( int n = 1; n < 32; ++n ) {
+    odd[n] = row;
+    row <<= 1;
+  }
+
+  gf2_matrix_square(even, odd); // 2 zero bits
+  gf2_matrix_square(odd, even); // 4 zero bits
+
+  do {
+    gf2_matrix_square(even, odd);
+    if ( !(len >>= 1) ) {
+      return;
+    }
+    gf2_matrix_square(odd, even);
+    len >>= 1;
+  } while ( len );
+
+  memcpy(even, odd, sizeof(odd));
+}
+
+static void crc32_zeros(uint32_t zeros[4][256], size_t len)
+{
+  uint32_t op[32];
+
+  crc32_zeros_op(op, len);
+
+  for ( uint32_t n = 0; n < 256; ++n ) {
+    zeros[0][n] = gf2_matrix_times(op, n);
+    zeros[1][n] = gf2_matrix_times(op, n << 8);
+    zeros[2][n] = gf2_matrix_times(op, n << 16);
+    zeros[3][n] = gf2_matrix_times(op, n << 24);
+  }
+}
+
+static inline uint32_t crc32_shift(uint32_t zeros[4][256], uint32_t crc)
+{
+  return zeros[0][crc & 0xFF] ^ zeros[1][(crc >> 8) & 0xFF] ^ zeros[2][(crc >> 16) & 0xFF] ^ zeros[3][crc >> 24];
+}
+
+static bool crc32_have_sse42(void)
+{
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_SSE4_2);
+}
+
+static void crc32_init_sse42(void)
+{
+  crc32_zeros(crc_long, CRC32_LONG_BLOCK);
+  crc32_zeros(crc_short, CRC32_SHORT_BLOCK);
+}
+
+#define CRC32_SSE42_3WAY(block, zeros) \
+  while ( length >= 3 * (block) ) { \
+    uint64_t crc1 = 0, crc2 = 0; \
+    const uint8_t * end = p + (block); \
+    do { \
+      crc0 = _mm_crc32_u64(crc0, *(const uint64_t *) p); \
+      crc1 = _mm_crc32_u64(crc1, *(const uint64_t *) (p + (block))); \
+      crc2 = _mm_crc32_u64(crc2, *(const uint64_t *) (p + 2 * (block))); \
+      p += 8; \
+    } while ( p < end ); \
+    crc0 = crc32_shift(zeros, crc0) ^ crc1; \
+    crc0 = crc32_shift(zeros, crc0) ^ crc2; \
+    p += 2 * (block); \
+    length -= 3 * (block); \
+  }
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32_update_sse42(uint32_t crc, const void * buff, size_t length)
+{
+  const uint8_t * p = buff;
+  uint64_t crc0 = crc;
+
+  while ( length && ((uintptr_t) p & 7) ) {
+    crc0 = _mm_crc32_u8(crc0, *p++);
+    --length;
+  }
+
+  CRC32_SSE42_3WAY(CRC32_LONG_BLOCK, crc_long);
+  CRC32_SSE42_3WAY(CRC32_SHORT_BLOCK, crc_short);
+
+  while ( length >= 8 ) {
+    crc0 = _mm_crc32_u64(crc0, *(const uint64_t *) p);
+    p += 8, length -= 8;
+  }
+
+  while ( length-- ) {
+    crc0 = _mm_crc32_u8(crc0, *p++);
+  }
+
+  return (uint32_t) crc0;
+}
+
+#undef CRC32_SSE42_3WAY
+#endif /* __x86_64__ */
+
+
+#if defined(__aarch64__)
+/*
+ * ARMv8 CRC32 extension
+ */
+static bool crc32_have_armv8(void)
+{
+  return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+__attribute__((target("+crc")))
+static uint32_t crc32_update_armv8(uint32_t crc, const void * buff, size_t length)
+{
+  const uint8_t * p = buff;
+
+  while ( length && ((uintptr_t) p & 7) ) {
+    crc = __crc32cb(crc, *p++);
+    --length;
+  }
+
+  while ( length >= 8 ) {
+    crc = __crc32cd(crc, *(const uint64_t *) p);
+    p += 8, length -= 8;
+  }
+
+  while ( length-- ) {
+    crc = __crc32cb(crc, *p++);
+  }
+
+  return crc;
+}
+#endif /* __aarch64__ */
+
+
+
+/*
+ * Runtime dispatch
+ */
+
+typedef uint32_t (*crc32_update_func)(uint32_t crc, const void * buff, size_t length);
+
+static pthread_once_t crc32_init_once = PTHREAD_ONCE_INIT;
+static crc32_update_func crc32_update = NULL;
+
+static crc32_update_func crc32_impl_func(enum cf_crc32_impl impl)
+{
+  switch ( impl ) {
+    case cf_crc32_impl_table :
+      return crc32_update_table;
+    case cf_crc32_impl_slice8 :
+      return crc32_update_slice8;
+#if defined(__x86_64__)
+    case cf_crc32_impl_sse42 :
+      return crc32_have_sse42() ? crc32_update_sse42 : NULL;
+#endif
+#if defined(__aarch64__)
+    case cf_crc32_impl_armv8 :
+      return crc32_have_armv8() ? crc32_update_armv8 : NULL;
+#endif
+    default :
+      break;
+  }
+  return NULL;
+}
+
+static void crc32_init(void)
+{
+  crc32_update_func func;
+
+  crc32_init_slice8();
+#if defined(__x86_64__)
+  crc32_init_sse42();
+#endif
+
+  if ( !(func = crc32_impl_func(cf_crc32_impl_sse42)) && !(func = crc32_impl_func(cf_crc32_impl_armv8)) ) {
+    func = crc32_update_slice8;
+  }
+
+  __atomic_store_n(&crc32_update, func, __ATOMIC_RELEASE);
+}
+
+static inline crc32_update_func crc32_get_update_func(void)
+{
+  crc32_update_func func;
+  if ( !(func = __atomic_load_n(&crc32_update, __ATOMIC_ACQUIRE)) ) {
+    pthread_once(&crc32_init_once, crc32_init);
+    func = __atomic_load_n(&crc32_update, __ATOMIC_ACQUIRE);
+  }
+  return func;
+}
+
+bool cf_crc32_set_impl(enum cf_crc32_impl impl)
+{
+  crc32_update_func func;
+
+  crc32_get_update_func();
+
+  if ( impl == cf_crc32_impl_auto ) {
+    if ( !(func = crc32_impl_func(cf_crc32_impl_sse42)) && !(func = crc32_impl_func(cf_crc32_impl_armv8)) ) {
+      func = crc32_update_slice8;
+    }
+  }
+  else if ( !(func = crc32_impl_func(impl)) ) {
+    return false;
+  }
+
+  __atomic_store_n(&crc32_update, func, __ATOMIC_RELEASE);
+  return true;
+}
+
+enum cf_crc32_impl cf_crc32_get_impl(void)
+{
+  crc32_update_func func = crc32_get_update_func();
+
+  for ( int impl = cf_crc32_impl_table; impl <= cf_crc32_impl_armv8; ++impl ) {
+    if ( crc32_impl_func(impl) == func ) {
+      return impl;
+    }
+  }
+
+  return cf_crc32_impl_auto;
+}
+
+const char * cf_crc32_impl_name(enum cf_crc32_impl impl)
+{
+  switch ( impl ) {
+    case cf_crc32_impl_auto :
+      return "auto";
+    case cf_crc32_impl_table :
+      return "table";
+    case cf_crc32_impl_slice8 :
+      return "slice8";
+    case cf_crc32_impl_sse42 :
+      return "sse42";
+    case cf_crc32_impl_armv8 :
+      return "armv8";
+  }
+  return "unknown";
+}
+
+/** Note crc32 should be initialized to 0xffffffff */
+uint32_t cf_crc32_update(uint32_t crc, const void * buff, size_t length)
+{
+  return crc32_get_update_func()(crc, buff, length);
+}
+
 uint32_t cf_crc32_update_s(uint32_t crc, const char * buff)
 {
   return cf_crc32_update(crc, buff, strlen(buff));
@@ -165,15 +165,66 @@ pb_istream_t pb_istream_from_buffer(const pb_byte_t *buf, size_t bufsize)
     return stream;
 }
 
+bool pb_istream_is_buffer(const pb_istream_t *stream)
+{
+#ifdef PB_BUFFER_ONLY
+    PB_UNUSED(stream);
+    return true;
+#else
+    return stream->callback == &buf_read;
+#endif
+}
+
 /********************
  * Helper functions *
  ********************/
 
+/* Varint read in place from memory buffer, at most maxbytes long.
+ * Returns number of bytes consumed, 0 if the varint doesn't end within the limits. */
+static size_t buf_decode_varint(const pb_istream_t *stream, size_t maxbytes, uint64_t *dest)
+{
+    const pb_byte_t *p = (const pb_byte_t*)stream->state;
+    size_t n = stream->bytes_left < maxbytes ? stream->bytes_left : maxbytes;
+    uint64_t result = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        result |= (uint64_t)(p[i] & 0x7F) << (7 * i);
+        if (!(p[i] & 0x80))
+        {
+            *dest = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+static void buf_consume(pb_istream_t *stream, size_t count)
+{
+    stream->state = (pb_byte_t*)stream->state + count;
+    stream->bytes_left -= count;
+}
+
 static bool checkreturn pb_decode_varint32(pb_istream_t *stream, uint32_t *dest)
 {
     pb_byte_t byte;
     uint32_t result;
 
+    if (pb_istream_is_buffer(stream))
+    {
+        uint64_t value;
+        size_t size;
+
+        if (!(size = buf_decode_varint(stream, 5, &value)))
+            PB_RETURN_ERROR(stream, stream->bytes_left < 5 ? "end-of-stream" : "varint overflow");
+
+        buf_consume(stream, size);
+        *dest = (uint32_t)value;
+        return true;
+    }
+
     if (!pb_readbyte(stream, &byte))
         return false;
 
@@ -211,6 +262,17 @@ bool checkreturn pb_decode_varint(pb_istream_t *stream, uint64_t *dest)
     uint_fast8_t bitpos = 0;
     uint64_t result = 0;
 
+    if (pb_istream_is_buffer(stream))
+    {
+        size_t size;
+
+        if (!(size = buf_decode_varint(stream, 10, dest)))
+            PB_RETURN_ERROR(stream, stream->bytes_left < 10 ? "end-of-stream" : "varint overflow");
+
+        buf_consume(stream, size);
+        return true;
+    }
+
     do
     {
         if (bitpos >= 64)
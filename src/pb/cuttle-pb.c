@@ -7,10 +7,48 @@
 
 #include <cuttle/debug.h>
 #include <cuttle/pb/pb.h>
+#include <cuttle/pb/codegen.h>
+#include <cuttle/arena.h>
+#include <malloc.h>
 
 
+/* Decoder state shared by all nesting levels of one message */
+typedef
+struct cf_pb_decoder {
+  cf_arena * arena;         // variable-length data goes here if set, to the heap otherwise
+  const pb_byte_t * end;    // end of input in cf_pb_unpack_views() mode, NULL otherwise
+  pb_byte_t * term;         // string view waiting for its null terminator
+  bool reuse;               // heap buffers found in the message are reused, see cf_pb_decode_reuse()
+} cf_pb_decoder;
+
 typedef bool (*cf_pb_encfn_t) (pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value);
-typedef bool (*cf_pb_decfn_t) (pb_istream_t * istream, const cf_pb_field_t * field, void * dst);
+typedef bool (*cf_pb_decfn_t) (pb_istream_t * istream, const cf_pb_field_t * field, void * dst, cf_pb_decoder * dec);
+
+struct cf_pb_size_cache;
+
+static bool cf_pb_encode_message(pb_ostream_t * ostream, const cf_pb_field_t fields[], const void * msg,
+    struct cf_pb_size_cache * cache);
+
+static bool cf_pb_decode_message(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg,
+    cf_pb_decoder * dec);
+
+static bool cf_pb_lazy_size(const cf_pb_field_t * field, const cf_pb_lazy * lazy, struct cf_pb_size_cache * cache,
+    size_t * size);
+static bool cf_pb_encode_lazy(pb_ostream_t * ostream, const cf_pb_field_t * field, const cf_pb_lazy * lazy,
+    struct cf_pb_size_cache * cache);
+static bool cf_pb_decode_lazy(pb_istream_t * istream, pb_wire_type_t wiretype, const cf_pb_field_t * field,
+    cf_pb_lazy * lazy, const pb_byte_t * start, cf_pb_decoder * dec);
+static void cf_pb_lazy_release(const cf_pb_field_t * field, cf_pb_lazy * lazy);
+
+/* prev is the heap value left by cf_pb_reset(), reused when it fits. Plain decoding does not trust
+ * the destination and allocates fresh */
+static inline void * cf_pb_alloc(cf_pb_decoder * dec, void * prev, size_t size)
+{
+  if ( dec->arena ) {
+    return cf_arena_alloc(dec->arena, size);
+  }
+  return dec->reuse ? cf_pb_realloc(prev, size) : malloc(size);
+}
 
 
 static bool cf_pb_field_has_data(const cf_pb_field_t * field, const void * msg)
@@ -33,6 +71,26 @@ static const cf_pb_field_t * cf_pb_find_tag(const cf_pb_field_t f[], uint32_t ta
   return f->tag ? f : NULL;
 }
 
+
+/* last is the end of table, its CF_PB_LAST_FIELD_INDEXED() order holds field indexes sorted by tag */
+static const cf_pb_field_t * cf_pb_lookup_tag(const cf_pb_field_t fields[], const cf_pb_field_t * last,
+    uint32_t tag)
+{
+  const uint16_t * order = last->ptr;
+  size_t lo, hi, mid;
+
+  for ( lo = 0, hi = last->item_size; lo < hi; ) {
+    if ( fields[order[mid = (lo + hi) / 2]].tag < tag ) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+
+  return lo < last->item_size && fields[order[lo]].tag == tag ? &fields[order[lo]] : NULL;
+}
+
 static pb_wire_type_t cf_pb_wire_type(cf_pb_field_type type)
 {
   switch ( type ) {
@@ -64,6 +122,17 @@ static pb_wire_type_t cf_pb_wire_type(cf_pb_field_type type)
   return (pb_wire_type_t) (-1);
 }
 
+static bool cf_pb_type_owns_memory(cf_pb_field_type type)
+{
+  return type == CF_PB_STRING || type == CF_PB_BYTES || type == CF_PB_MESSAGE;
+}
+
+/* The generated tables give sizeof(uint8_t) as item_size of bytes fields, the member is cf_membuf */
+static size_t cf_pb_member_size(const cf_pb_field_t * field)
+{
+  return field->pbtype == CF_PB_BYTES ? sizeof(cf_membuf) : field->item_size;
+}
+
 static bool cf_pb_type_packable(cf_pb_field_type type)
 {
   switch ( type ) {
@@ -85,6 +154,74 @@ static bool cf_pb_type_packable(cf_pb_field_type type)
 
 
 
+/*
+ * Sizes of submessages and packed varint arrays computed bottom-up by the sizing pass,
+ * in the same order as the writing pass consumes them. This way each message is measured once
+ * instead of re-measuring every nested message before writing it.
+ */
+typedef
+struct cf_pb_size_cache {
+  size_t * sizes;
+  size_t size, capacity;
+  size_t pos;
+  size_t stack[64];
+} cf_pb_size_cache;
+
+static void cf_pb_size_cache_init(cf_pb_size_cache * cache)
+{
+  cache->sizes = cache->stack;
+  cache->capacity = sizeof(cache->stack) / sizeof(cache->stack[0]);
+  cache->size = 0;
+  cache->pos = 0;
+}
+
+static void cf_pb_size_cache_cleanup(cf_pb_size_cache * cache)
+{
+  if ( cache->sizes != cache->stack ) {
+    free(cache->sizes);
+  }
+  cache->sizes = NULL;
+}
+
+// returns slot index to be filled after the nested sizes are known, -1 if realloc fails
+static ssize_t cf_pb_size_cache_reserve(cf_pb_size_cache * cache)
+{
+  if ( cache->size == cache->capacity ) {
+
+    size_t capacity = 2 * cache->capacity;
+    size_t * sizes;
+
+    if ( cache->sizes == cache->stack ) {
+      if ( (sizes = malloc(capacity * sizeof(*sizes))) ) {
+        memcpy(sizes, cache->stack, cache->size * sizeof(*sizes));
+      }
+    }
+    else {
+      sizes = realloc(cache->sizes, capacity * sizeof(*sizes));
+    }
+
+    if ( !sizes ) {
+      return -1;
+    }
+
+    cache->sizes = sizes;
+    cache->capacity = capacity;
+  }
+
+  return cache->size++;
+}
+
+static size_t cf_pb_svarint_size(int64_t value)
+{
+  return cf_pb_varint_size(cf_pb_zigzag(value));
+}
+
+static size_t cf_pb_tag_size(uint32_t tag)
+{
+  return cf_pb_varint_size((uint64_t) tag << 3);
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 
@@ -94,9 +231,9 @@ bool cf_pb_encode_int32(pb_ostream_t * ostream, const cf_pb_field_t * field, con
   return pb_encode_svarint(ostream, *(int32_t*) value);
 }
 
-bool cf_pb_decode_int32(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_int32(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   int64_t val;
   if ( pb_decode_svarint(istream, &val) && val >= INT32_MIN && val <= INT32_MAX ) {
     *(int32_t*) value = val;
@@ -115,9 +252,9 @@ bool cf_pb_encode_uint32(pb_ostream_t * ostream, const cf_pb_field_t * field, co
   return pb_encode_varint(ostream, *(uint32_t*) value);
 }
 
-bool cf_pb_decode_uint32(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_uint32(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   uint64_t val;
   if ( pb_decode_varint(istream, &val) && val <= UINT32_MAX ) {
     *(uint32_t*) value = val;
@@ -136,9 +273,9 @@ bool cf_pb_encode_int64(pb_ostream_t * ostream, const cf_pb_field_t * field, con
   return pb_encode_svarint(ostream, *(int64_t*) value);
 }
 
-bool cf_pb_decode_int64(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_int64(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   return pb_decode_svarint(istream, (int64_t*) value);
 }
 
@@ -150,9 +287,9 @@ bool cf_pb_encode_uint64(pb_ostream_t * ostream, const cf_pb_field_t * field, co
   return pb_encode_varint(ostream, *(uint64_t *) value);
 }
 
-bool cf_pb_decode_uint64(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_uint64(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   return pb_decode_varint(istream, (uint64_t*) value);
 }
 
@@ -166,9 +303,9 @@ bool cf_pb_encode_fixed32(pb_ostream_t * ostream, const cf_pb_field_t * field, c
   return pb_encode_fixed32(ostream, value);
 }
 
-bool cf_pb_decode_fixed32(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_fixed32(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   return pb_decode_fixed32(istream, (uint32_t*)value);
 }
 
@@ -181,9 +318,9 @@ bool cf_pb_encode_fixed64(pb_ostream_t * ostream, const cf_pb_field_t * field, c
   return pb_encode_fixed64(ostream, value);
 }
 
-bool cf_pb_decode_fixed64(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_fixed64(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   return pb_decode_fixed64(istream, value);
 }
 
@@ -198,9 +335,9 @@ bool cf_pb_encode_bool(pb_ostream_t * ostream, const cf_pb_field_t * field, cons
   return pb_encode_varint(ostream, *(bool *) value);
 }
 
-bool cf_pb_decode_bool(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_bool(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   uint64_t boolval = 0;
   if ( pb_decode_varint(istream, &boolval) ) {
     *(bool*) value = boolval != 0;
@@ -217,9 +354,9 @@ bool cf_pb_encode_float(pb_ostream_t * ostream, const cf_pb_field_t * field, con
   return pb_encode_fixed32(ostream, value);
 }
 
-bool cf_pb_decode_float(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_float(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   return pb_decode_fixed32(istream, value);
 }
 
@@ -231,9 +368,9 @@ bool cf_pb_encode_double(pb_ostream_t * ostream, const cf_pb_field_t * field, co
   return pb_encode_fixed64(ostream, value);
 }
 
-bool cf_pb_decode_double(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_double(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
-  (void)(field);
+  (void)(field), (void)(dec);
   return pb_decode_fixed64(istream, value);
 }
 
@@ -248,29 +385,50 @@ bool cf_pb_encode_string(pb_ostream_t * ostream, const cf_pb_field_t * field, co
 }
 
 
-bool cf_pb_decode_string(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_string(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
   (void)(field);
   uint64_t size;
   size_t alloc_size;
   char * str = NULL;
+  void * p;
   bool fok = false;
 
   if ( !pb_decode_varint(istream, &size) ) {
     goto end;
   }
 
+  if ( dec->end && size < (uint64_t) (dec->end - (const pb_byte_t *) istream->state) ) {
+    /* View into the input, the byte after it is always a tag and becomes
+     * the null terminator once the tag is consumed. Strings ending the input are copied */
+    str = istream->state;
+    if ( (fok = pb_read(istream, NULL, size)) ) {
+      dec->term = (pb_byte_t *) str + size;
+    }
+    else {
+      str = NULL;
+    }
+    *(char**)value = str;
+    return fok;
+  }
+
   /* Space for null terminator */
   if ( (alloc_size = size + 1) < size ) {
     PB_SET_ERROR(istream, "size too large");
     goto end;
   }
 
-  if ( !(str = malloc(alloc_size)) ) {
+  if ( dec->reuse ) {
+    str = *(char **) value;
+  }
+
+  if ( !(p = cf_pb_alloc(dec, str, alloc_size)) ) {
     PB_SET_ERROR(istream, "malloc() fails");
     goto end;
   }
 
+  str = p;
+
   if ( !(fok = pb_read(istream, (pb_byte_t*) str, size)) ) {
     PB_SET_ERROR(istream, "pb_read() fails");
     goto end;
@@ -281,9 +439,10 @@ bool cf_pb_decode_string(pb_istream_t * istream, const cf_pb_field_t * field, vo
 end :
 
   if ( !fok ) {
-    if ( str ) {
-      free(str), str = NULL;
+    if ( str && !dec->arena ) {
+      free(str);
     }
+    str = NULL;
   }
 
   *(char**)value = str;
@@ -302,27 +461,36 @@ bool cf_pb_encode_bytes(pb_ostream_t * ostream, const cf_pb_field_t * field, con
   return pb_encode_string(ostream, data->data, data->size);
 }
 
-bool cf_pb_decode_bytes(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_bytes(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
   (void)(field);
   uint64_t size;
   cf_membuf * mbuf = value;
+  void * data;
   bool fok = false;
 
   if ( !pb_decode_varint(istream, &size) ) {
     goto end;
   }
 
-  if ( size > 64 * 1024 ) {
+  if ( size > istream->bytes_left ) {
     PB_SET_ERROR(istream, "Too large array");
     goto end;
   }
 
-  if ( !(mbuf->data = malloc((size_t) (size))) ) {
+  if ( dec->end ) { /* View into the input */
+    mbuf->data = size ? istream->state : NULL;
+    mbuf->size = (size_t) size;
+    return pb_read(istream, NULL, size);
+  }
+
+  if ( !(data = cf_pb_alloc(dec, mbuf->data, (size_t) (size))) ) {
     PB_SET_ERROR(istream, "malloc() fails");
     goto end;
   }
 
+  mbuf->data = data;
+
   if ( !(fok = pb_read(istream, (pb_byte_t*) mbuf->data, size)) ) {
     PB_SET_ERROR(istream, "pb_read() fails");
     goto end;
@@ -333,7 +501,10 @@ bool cf_pb_decode_bytes(pb_istream_t * istream, const cf_pb_field_t * field, voi
 end :
 
   if ( !fok && mbuf->data ) {
-    free(mbuf->data), mbuf->data = NULL;
+    if ( !dec->arena ) {
+      free(mbuf->data);
+    }
+    mbuf->data = NULL;
   }
 
   return fok;
@@ -341,11 +512,11 @@ end :
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool cf_pb_encode_submessage(pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value)
+bool cf_pb_encode_submessage(pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value,
+    cf_pb_size_cache * cache)
 {
   const cf_pb_field_t * submessage_fields;
-  pb_ostream_t substream = PB_OSTREAM_SIZING;
-  size_t size;
+  size_t size, start;
   bool fok = false;
 
   if ( !(submessage_fields = field->ptr) ) {
@@ -353,19 +524,14 @@ bool cf_pb_encode_submessage(pb_ostream_t * ostream, const cf_pb_field_t * field
     goto end;
   }
 
-  /* First calculate the message size using a non-writing substream. */
-  if ( !cf_pb_encode(&substream, submessage_fields, value) ) {
-    ostream->errmsg = substream.errmsg;
+  if ( cache->pos >= cache->size ) {
+    PB_SET_ERROR(ostream, "submsg size not cached");
     goto end;
   }
 
-  size = substream.bytes_written;
-  if ( !pb_encode_varint(ostream, (uint64_t) size) ) {
-    goto end;
-  }
+  size = cache->sizes[cache->pos++];
 
-  if ( ostream->callback == NULL ) {
-    fok = pb_write(ostream, NULL, size); /* Just sizing */
+  if ( !pb_encode_varint(ostream, (uint64_t) size) ) {
     goto end;
   }
 
@@ -374,33 +540,26 @@ bool cf_pb_encode_submessage(pb_ostream_t * ostream, const cf_pb_field_t * field
     goto end;
   }
 
+  start = ostream->bytes_written;
 
-  /* Use a substream to verify that a callback doesn't write more than
-   * what it did the first time. */
-  substream.callback = ostream->callback;
-  substream.state = ostream->state;
-  substream.max_size = size;
-  substream.bytes_written = 0;
-  substream.errmsg = NULL;
-
-
-  fok = cf_pb_encode(&substream, submessage_fields, value);
-  ostream->bytes_written += substream.bytes_written;
-  ostream->state = substream.state;
-  ostream->errmsg = substream.errmsg;
+  if ( !cf_pb_encode_message(ostream, submessage_fields, value, cache) ) {
+    goto end;
+  }
 
-  if ( fok && substream.bytes_written != size ) {
+  if ( ostream->bytes_written - start != size ) {
     PB_SET_ERROR(ostream, "submsg size changed");
-    fok = false;
+    goto end;
   }
 
+  fok = true;
+
 end:
 
   return fok;
 }
 
 
-bool cf_pb_decode_submessage(pb_istream_t * istream, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_submessage(pb_istream_t * istream, const cf_pb_field_t * field, void * value, cf_pb_decoder * dec)
 {
   pb_istream_t substream;
   const cf_pb_field_t * submsg_fields;
@@ -415,7 +574,7 @@ bool cf_pb_decode_submessage(pb_istream_t * istream, const cf_pb_field_t * field
     goto end;
   }
 
-  if ( !(fok = cf_pb_decode(&substream, submsg_fields, value)) ) {
+  if ( !(fok = cf_pb_decode_message(&substream, submsg_fields, value, dec)) ) {
     CF_FATAL("cf_pb_decode(substream) fails");
     PB_SET_ERROR(istream, substream.errmsg);
   }
@@ -469,8 +628,7 @@ cf_pb_encfn_t cf_pb_encfunc(const cf_pb_field_t * field)
     func = cf_pb_encode_bytes;
   break;
   case CF_PB_MESSAGE:
-    func = cf_pb_encode_submessage;
-    break;
+    break; // cf_pb_encode_submessage() needs the size cache
   }
 
   return func;
@@ -526,12 +684,22 @@ cf_pb_decfn_t cf_pb_decfunc(const cf_pb_field_t * field)
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool cf_pb_encode_scalar(pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value, cf_pb_encfn_t func)
+static bool cf_pb_encode_value(pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value,
+    cf_pb_encfn_t func, cf_pb_size_cache * cache)
+{
+  return field->pbtype == CF_PB_MESSAGE ? cf_pb_encode_submessage(ostream, field, value, cache) :
+      func(ostream, field, value);
+}
+
+bool cf_pb_encode_scalar(pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value, cf_pb_encfn_t func,
+    cf_pb_size_cache * cache)
 {
-  return pb_encode_tag(ostream, cf_pb_wire_type(field->pbtype), field->tag) && func(ostream, field, value);
+  return pb_encode_tag(ostream, cf_pb_wire_type(field->pbtype), field->tag)
+      && cf_pb_encode_value(ostream, field, value, func, cache);
 }
 
-bool cf_pb_encode_array(pb_ostream_t * ostream, const cf_pb_field_t * field, const ccarray_t * array, cf_pb_encfn_t func)
+bool cf_pb_encode_array(pb_ostream_t * ostream, const cf_pb_field_t * field, const ccarray_t * array, cf_pb_encfn_t func,
+    cf_pb_size_cache * cache)
 {
   pb_wire_type_t wiretype;
   size_t size, count, i;
@@ -546,18 +714,16 @@ bool cf_pb_encode_array(pb_ostream_t * ostream, const cf_pb_field_t * field, con
 
   /* Pack arrays if the datatype allows it. */
   if ( !cf_pb_type_packable(field->pbtype) ) {
-    CF_DEBUG("UNPACKED ARRAY: count=%zu ostream->callback=%p", count, ostream->callback);
 
     for ( i = 0; i < count; ++i ) {
-      if ( !pb_encode_tag(ostream, wiretype, field->tag) || !func(ostream, field, ccarray_peek(array, i)) ) {
+      if ( !pb_encode_tag(ostream, wiretype, field->tag)
+          || !cf_pb_encode_value(ostream, field, ccarray_peek(array, i), func, cache) ) {
         goto end;
       }
     }
   }
   else {
 
-    CF_DEBUG("PACKED ARRAY: count=%zu ostream->callback=%p", count, ostream->callback);
-
     if ( !pb_encode_tag(ostream, PB_WT_STRING, field->tag) ) {
       goto end;
     }
@@ -569,15 +735,12 @@ bool cf_pb_encode_array(pb_ostream_t * ostream, const cf_pb_field_t * field, con
     else if ( wiretype == PB_WT_64BIT ) {
       size = 8 * count;
     }
+    else if ( cache->pos < cache->size ) {
+      size = cache->sizes[cache->pos++];
+    }
     else {
-      pb_ostream_t sizestream = PB_OSTREAM_SIZING;
-      for ( i = 0; i < count; ++i ) {
-        if ( !func(&sizestream, field, ccarray_peek(array, i)) ) {
-          goto end;
-        }
-      }
-      size = sizestream.bytes_written;
-      CF_DEBUG("pack size=%zu", size);
+      PB_SET_ERROR(ostream, "pack size not cached");
+      goto end;
     }
 
     if ( !pb_encode_varint(ostream, size) ) {
@@ -606,10 +769,137 @@ end:
 
 
 
+/* Arena backed arrays can't be realloc()-ed, they are copied into the new arena space instead */
+static bool cf_pb_array_reserve(ccarray_t * array, size_t capacity, size_t item_size, cf_pb_decoder * dec)
+{
+  void * items;
+
+  if ( capacity <= ccarray_capacity(array) ) {
+    return true;
+  }
+
+  if ( dec->arena ) {
+    if ( !(items = cf_arena_realloc(dec->arena, array->items, array->capacity * item_size, capacity * item_size)) ) {
+      return false;
+    }
+    array->items = items;
+    array->capacity = capacity;
+    array->item_size = item_size;
+    return true;
+  }
+
+  if ( !ccarray_capacity(array) ) {
+    return ccarray_init(array, capacity, item_size) != NULL;
+  }
+
+  return ccarray_realloc(array, capacity) == capacity;
+}
+
+/* Space of outgrown arena arrays is not reused, so these start small and double */
+static inline size_t cf_pb_array_grow(const ccarray_t * array, cf_pb_decoder * dec)
+{
+  if ( !dec->arena ) {
+    return ccarray_capacity(array) + 64;
+  }
+  return ccarray_capacity(array) ? 2 * ccarray_capacity(array) : 4;
+}
+
+/* Packed array read in place from memory buffer: the items are counted first for single
+ * reservation, then decoded in tight per-type loops straight into the array storage */
+static bool cf_pb_decode_packed(pb_istream_t * substream, const cf_pb_field_t * field, ccarray_t * array,
+    cf_pb_decoder * dec)
+{
+  cf_pb_rbuf r = { substream->state, (const uint8_t *) substream->state + substream->bytes_left, NULL, NULL };
+  size_t count = 0;
+  uint8_t * items;
+  bool fok = true;
+
+  switch ( field->pbtype ) {
+  case CF_PB_FIXED32 :
+  case CF_PB_SFIXED32 :
+    count = substream->bytes_left / 4;
+    break;
+  case CF_PB_FIXED64 :
+  case CF_PB_SFIXED64 :
+    count = substream->bytes_left / 8;
+    break;
+  default : /* each varint ends with a byte with clear high bit */
+    for ( const uint8_t * p = r.ptr; p < r.end; ++p ) {
+      count += !(*p & 0x80);
+    }
+    break;
+  }
+
+  if ( !count ) {
+    return r.ptr == r.end;
+  }
+
+  if ( !cf_pb_array_reserve(array, array->size + count, field->item_size, dec) ) {
+    return false;
+  }
+
+  items = ccarray_peek_end(array);
+
+  switch ( field->pbtype ) {
+  case CF_PB_FIXED32 :
+  case CF_PB_SFIXED32 :
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(items, r.ptr, count * 4), r.ptr += count * 4;
+#else
+    for ( size_t i = 0; i < count && fok; ++i ) {
+      fok = cf_pb_get_fixed32(&r, items + 4 * i);
+    }
+#endif
+    break;
+  case CF_PB_FIXED64 :
+  case CF_PB_SFIXED64 :
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(items, r.ptr, count * 8), r.ptr += count * 8;
+#else
+    for ( size_t i = 0; i < count && fok; ++i ) {
+      fok = cf_pb_get_fixed64(&r, items + 8 * i);
+    }
+#endif
+    break;
+  case CF_PB_INT32 :
+    for ( int32_t * v = (int32_t *) items, * e = v + count; v < e && fok; ++v ) {
+      fok = cf_pb_get_int32(&r, v);
+    }
+    break;
+  case CF_PB_UINT32 :
+    for ( uint32_t * v = (uint32_t *) items, * e = v + count; v < e && fok; ++v ) {
+      fok = cf_pb_get_uint32(&r, v);
+    }
+    break;
+  case CF_PB_INT64 :
+    for ( int64_t * v = (int64_t *) items, * e = v + count; v < e && fok; ++v ) {
+      fok = cf_pb_get_int64(&r, v);
+    }
+    break;
+  case CF_PB_UINT64 :
+    for ( uint64_t * v = (uint64_t *) items, * e = v + count; v < e && fok; ++v ) {
+      fok = cf_pb_get_uint64(&r, v);
+    }
+    break;
+  default :
+    fok = false;
+    break;
+  }
+
+  if ( !fok || r.ptr != r.end ) {
+    return false;
+  }
+
+  array->size += count;
+
+  return pb_read(substream, NULL, substream->bytes_left);
+}
+
 bool cf_pb_decode_array(pb_istream_t * istream, const cf_pb_field_t * field, ccarray_t * array, pb_wire_type_t wiretype,
-    cf_pb_decfn_t func)
+    cf_pb_decfn_t func, cf_pb_decoder * dec)
 {
   pb_istream_t substream;
+  size_t capacity;
   bool fok = false;
 
   if ( wiretype == PB_WT_STRING && cf_pb_type_packable(field->pbtype) ) {
@@ -619,18 +909,26 @@ bool cf_pb_decode_array(pb_istream_t * istream, const cf_pb_field_t * field, cca
       goto end;
     }
 
-    if ( !ccarray_init(array, 2 * substream.bytes_left / field->item_size + 1, field->item_size) ) {
-      PB_SET_ERROR(istream, "ccarray_init() fails");
-      goto end;
+    if ( pb_istream_is_buffer(&substream) ) {
+      if ( !cf_pb_decode_packed(&substream, field, array, dec) ) {
+        PB_SET_ERROR(istream, "invalid packed array");
+      }
     }
+    else {
 
-    CF_DEBUG("unpack size=%zu", substream.bytes_left);
+      if ( !cf_pb_array_reserve(array, array->size + 2 * substream.bytes_left / field->item_size + 1,
+          field->item_size, dec) ) {
+        PB_SET_ERROR(istream, "ccarray_init() fails");
+        goto end;
+      }
 
-    while ( substream.bytes_left && func(&substream, field, ccarray_peek_end(array)) ) {
-      if ( ++array->size >= array->capacity ) {
-        if ( !ccarray_realloc(array, array->capacity + 2 * substream.bytes_left / field->item_size + 1) ) {
-          PB_SET_ERROR(istream, "ccarray_realloc() fails");
-          break;
+      while ( substream.bytes_left && func(&substream, field, ccarray_peek_end(array), dec) ) {
+        if ( ++array->size >= array->capacity ) {
+          if ( !cf_pb_array_reserve(array, array->capacity + 2 * substream.bytes_left / field->item_size + 1,
+              field->item_size, dec) ) {
+            PB_SET_ERROR(istream, "ccarray_realloc() fails");
+            break;
+          }
         }
       }
     }
@@ -644,17 +942,20 @@ bool cf_pb_decode_array(pb_istream_t * istream, const cf_pb_field_t * field, cca
   }
   else {
 
-    if ( !ccarray_capacity(array) && !ccarray_init(array, 64, field->item_size) ) {
-      PB_SET_ERROR(istream, "ccarray_init() fails");
-      goto end;
-    }
+    if ( (capacity = ccarray_capacity(array)) <= ccarray_size(array) ) {
 
-    if ( ccarray_size(array) >= ccarray_capacity(array) && !ccarray_realloc(array, ccarray_capacity(array) + 64) ) {
-      PB_SET_ERROR(istream, "ccarray_realloc() fails");
-      goto end;
+      if ( !cf_pb_array_reserve(array, cf_pb_array_grow(array, dec), field->item_size, dec) ) {
+        PB_SET_ERROR(istream, "ccarray_realloc() fails");
+        goto end;
+      }
+
+      /* Spare items start empty, the ones left by cf_pb_reset() keep their buffers */
+      if ( cf_pb_type_owns_memory(field->pbtype) ) {
+        memset(ccarray_peek(array, capacity), 0, (ccarray_capacity(array) - capacity) * field->item_size);
+      }
     }
 
-    if ( !func(istream, field, ccarray_peek_end(array)) ) {
+    if ( !func(istream, field, ccarray_peek_end(array), dec) ) {
       goto end;
     }
 
@@ -673,12 +974,17 @@ end:
 
 
 
-bool cf_pb_encode_field(pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value)
+bool cf_pb_encode_field(pb_ostream_t * ostream, const cf_pb_field_t * field, const void * value,
+    cf_pb_size_cache * cache)
 {
   cf_pb_encfn_t func = NULL;
   bool fok = false;
 
-  if ( !(func = cf_pb_encfunc(field)) ) {
+  if ( field->alloctype & CF_PB_LAZY ) {
+    return cf_pb_encode_lazy(ostream, field, value, cache);
+  }
+
+  if ( !(func = cf_pb_encfunc(field)) && field->pbtype != CF_PB_MESSAGE ) {
     PB_SET_ERROR(ostream, "Invalid field type");
     goto end;
   }
@@ -686,15 +992,15 @@ bool cf_pb_encode_field(pb_ostream_t * ostream, const cf_pb_field_t * field, con
   switch ( field->alloctype ) {
 
   case CF_PB_SCALAR :
-    fok = cf_pb_encode_scalar(ostream, field, value, func);
+    fok = cf_pb_encode_scalar(ostream, field, value, func, cache);
   break;
 
   case CF_PB_ARRAY :
-    fok = cf_pb_encode_array(ostream, field, value, func);
+    fok = cf_pb_encode_array(ostream, field, value, func, cache);
   break;
 
   case CF_PB_ONEOF :
-    fok = cf_pb_encode_scalar(ostream, field, value, func);
+    fok = cf_pb_encode_scalar(ostream, field, value, func, cache);
   break;
 
   default :
@@ -706,7 +1012,8 @@ end:
   return fok;
 }
 
-bool cf_pb_decode_field(pb_istream_t * istream, pb_wire_type_t wiretype, const cf_pb_field_t * field, void * value)
+bool cf_pb_decode_field(pb_istream_t * istream, pb_wire_type_t wiretype, const cf_pb_field_t * field, void * value,
+    cf_pb_decoder * dec)
 {
   cf_pb_decfn_t func = NULL;
   bool fok = false;
@@ -719,7 +1026,7 @@ bool cf_pb_decode_field(pb_istream_t * istream, pb_wire_type_t wiretype, const c
   switch ( field->alloctype ) {
 
   case CF_PB_ARRAY :
-    fok = cf_pb_decode_array(istream, field, value, wiretype, func);
+    fok = cf_pb_decode_array(istream, field, value, wiretype, func, dec);
   break;
 
   case CF_PB_SCALAR :
@@ -727,7 +1034,7 @@ bool cf_pb_decode_field(pb_istream_t * istream, pb_wire_type_t wiretype, const c
       PB_SET_ERROR(istream, "Invalid wire type");
     }
     else {
-      fok = func(istream, field, value);
+      fok = func(istream, field, value, dec);
     }
   break;
 
@@ -736,7 +1043,7 @@ bool cf_pb_decode_field(pb_istream_t * istream, pb_wire_type_t wiretype, const c
       PB_SET_ERROR(istream, "Invalid wire type");
     }
     else {
-      fok = func(istream, field, value);
+      fok = func(istream, field, value, dec);
     }
     break;
 
@@ -755,68 +1062,299 @@ end:
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-bool cf_pb_get_encoded_size(size_t * size, const cf_pb_field_t fields[], const void * msg)
-{
-  pb_ostream_t stream = PB_OSTREAM_SIZING;
-  bool fok = cf_pb_encode(&stream, fields, msg);
-  if ( fok ) {
-    *size = stream.bytes_written;
-  }
-  return fok;
-}
-
+static bool cf_pb_message_size(const cf_pb_field_t fields[], const void * msg, cf_pb_size_cache * cache,
+    size_t * size);
 
-bool cf_pb_encode(pb_ostream_t * ostream, const cf_pb_field_t fields[], const void * msg)
+static bool cf_pb_value_size(const cf_pb_field_t * field, const void * value, cf_pb_size_cache * cache,
+    size_t * size)
 {
-  bool fok = true;
+  size_t subsize;
+  ssize_t slot;
 
-  for ( const cf_pb_field_t * field = fields; field->tag; ++field ) {
-    if ( cf_pb_field_has_data(field, msg) && !cf_pb_encode_field(ostream, field, msg + field->item_offset) ) {
-      CF_FATAL("cf_pb_encode_field() fails");
-      fok = false;
-      break;
+  switch ( field->pbtype ) {
+  case CF_PB_INT32 :
+    *size = cf_pb_svarint_size(*(const int32_t*) value);
+    break;
+  case CF_PB_UINT32 :
+    *size = cf_pb_varint_size(*(const uint32_t*) value);
+    break;
+  case CF_PB_INT64 :
+    *size = cf_pb_svarint_size(*(const int64_t*) value);
+    break;
+  case CF_PB_UINT64 :
+    *size = cf_pb_varint_size(*(const uint64_t*) value);
+    break;
+  case CF_PB_FIXED32 :
+    case CF_PB_SFIXED32 :
+    case CF_PB_FLOAT :
+    *size = 4;
+    break;
+  case CF_PB_FIXED64 :
+    case CF_PB_SFIXED64 :
+    case CF_PB_DOUBLE :
+    *size = 8;
+    break;
+  case CF_PB_BOOL :
+    *size = 1;
+    break;
+  case CF_PB_STRING :
+    subsize = strlen(*(const char **) value);
+    *size = cf_pb_varint_size(subsize) + subsize;
+    break;
+  case CF_PB_BYTES :
+    subsize = ((const cf_membuf *) value)->size;
+    *size = cf_pb_varint_size(subsize) + subsize;
+    break;
+  case CF_PB_MESSAGE :
+    if ( !field->ptr ) {
+      return false;
+    }
+    if ( (slot = cf_pb_size_cache_reserve(cache)) < 0 ) {
+      CF_FATAL("cf_pb_size_cache_reserve() fails: %s", strerror(errno));
+      return false;
     }
+    if ( !cf_pb_message_size(field->ptr, value, cache, &subsize) ) {
+      return false;
+    }
+    cache->sizes[slot] = subsize;
+    *size = cf_pb_varint_size(subsize) + subsize;
+    break;
+  default :
+    return false;
   }
 
-  return fok;
+  return true;
 }
 
-
-bool cf_pb_decode(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg)
+static bool cf_pb_array_size(const cf_pb_field_t * field, const ccarray_t * array, cf_pb_size_cache * cache,
+    size_t * size)
 {
-  const cf_pb_field_t * field;
+  size_t count, payload, itemsize, i;
   pb_wire_type_t wiretype;
-  uint32_t tag;
-  bool eof = false, fok = true;
+  ssize_t slot;
 
-  while ( istream->bytes_left && pb_decode_tag(istream, &wiretype, &tag, &eof) ) {
+  *size = 0;
 
-    if ( !(field = cf_pb_find_tag(fields, tag)) ) { /* No match found, skip data */
-      if ( !(fok = pb_skip_field(istream, wiretype)) ) {
-        break;
-      }
-      CF_WARNING("tag=%u not found", tag);
-      continue;
-    }
+  if ( (count = ccarray_size(array)) < 1 ) {
+    return true;
+  }
 
-    if ( !(fok = cf_pb_decode_field(istream, wiretype, field, msg + field->item_offset)) ) {
-      break;
-    }
+  wiretype = cf_pb_wire_type(field->pbtype);
 
-    if ( field->alloctype == CF_PB_ONEOF ) {
-      *(uint32_t*) (msg + field->has_offset) = field->tag;
-    }
-    else if ( field->has_offset != (uint16_t) (-1) ) {
-      *(bool *) (msg + field->has_offset) = true;
+  if ( !cf_pb_type_packable(field->pbtype) ) {
+    for ( i = 0; i < count; ++i ) {
+      if ( !cf_pb_value_size(field, ccarray_peek(array, i), cache, &itemsize) ) {
+        return false;
+      }
+      *size += cf_pb_tag_size(field->tag) + itemsize;
     }
+    return true;
   }
 
-  if ( istream->bytes_left ) {
-    fok = false;
+  if ( wiretype == PB_WT_32BIT ) {
+    payload = 4 * count;
   }
+  else if ( wiretype == PB_WT_64BIT ) {
+    payload = 8 * count;
+  }
+  else {
 
-  return fok;
-}
+    if ( (slot = cf_pb_size_cache_reserve(cache)) < 0 ) {
+      CF_FATAL("cf_pb_size_cache_reserve() fails: %s", strerror(errno));
+      return false;
+    }
+
+    for ( payload = 0, i = 0; i < count; ++i ) {
+      if ( !cf_pb_value_size(field, ccarray_peek(array, i), cache, &itemsize) ) {
+        return false;
+      }
+      payload += itemsize;
+    }
+
+    cache->sizes[slot] = payload;
+  }
+
+  *size = cf_pb_tag_size(field->tag) + cf_pb_varint_size(payload) + payload;
+
+  return true;
+}
+
+static bool cf_pb_message_size(const cf_pb_field_t fields[], const void * msg, cf_pb_size_cache * cache,
+    size_t * size)
+{
+  size_t fieldsize;
+  bool fok;
+
+  *size = 0;
+
+  for ( const cf_pb_field_t * field = fields; field->tag; ++field ) {
+
+    if ( !cf_pb_field_has_data(field, msg) ) {
+      continue;
+    }
+
+    if ( field->alloctype & CF_PB_LAZY ) {
+      fok = cf_pb_lazy_size(field, msg + field->item_offset, cache, &fieldsize);
+    }
+    else if ( field->alloctype == CF_PB_ARRAY ) {
+      fok = cf_pb_array_size(field, msg + field->item_offset, cache, &fieldsize);
+    }
+    else if ( (fok = cf_pb_value_size(field, msg + field->item_offset, cache, &fieldsize)) ) {
+      fieldsize += cf_pb_tag_size(field->tag);
+    }
+
+    if ( !fok ) {
+      CF_FATAL("Can not compute size of field tag=%u pbtype=%u", field->tag, field->pbtype);
+      return false;
+    }
+
+    *size += fieldsize;
+  }
+
+  return true;
+}
+
+
+static bool cf_pb_encode_message(pb_ostream_t * ostream, const cf_pb_field_t fields[], const void * msg,
+    cf_pb_size_cache * cache)
+{
+  bool fok = true;
+
+  for ( const cf_pb_field_t * field = fields; field->tag; ++field ) {
+    if ( cf_pb_field_has_data(field, msg) && !cf_pb_encode_field(ostream, field, msg + field->item_offset, cache) ) {
+      CF_FATAL("cf_pb_encode_field() fails");
+      fok = false;
+      break;
+    }
+  }
+
+  return fok;
+}
+
+
+bool cf_pb_get_encoded_size(size_t * size, const cf_pb_field_t fields[], const void * msg)
+{
+  cf_pb_size_cache cache;
+  bool fok;
+
+  cf_pb_size_cache_init(&cache);
+  fok = cf_pb_message_size(fields, msg, &cache, size);
+  cf_pb_size_cache_cleanup(&cache);
+
+  return fok;
+}
+
+
+bool cf_pb_encode(pb_ostream_t * ostream, const cf_pb_field_t fields[], const void * msg)
+{
+  cf_pb_size_cache cache;
+  size_t size;
+  bool fok = false;
+
+  cf_pb_size_cache_init(&cache);
+
+  if ( !cf_pb_message_size(fields, msg, &cache, &size) ) {
+    PB_SET_ERROR(ostream, "cf_pb_message_size() fails");
+  }
+  else {
+    fok = cf_pb_encode_message(ostream, fields, msg, &cache);
+  }
+
+  cf_pb_size_cache_cleanup(&cache);
+
+  return fok;
+}
+
+
+static bool cf_pb_decode_message(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg,
+    cf_pb_decoder * dec)
+{
+  const cf_pb_field_t * field;
+  const cf_pb_field_t * expected = fields; // fields are usually sent in table order
+  const cf_pb_field_t * last = NULL;
+  const pb_byte_t * start;
+  pb_wire_type_t wiretype;
+  uint32_t tag;
+  bool eof = false, fok = true;
+
+  /* start is the field record in buffer streams, lazy fields keep it */
+  while ( istream->bytes_left && (start = istream->state, pb_decode_tag(istream, &wiretype, &tag, &eof)) ) {
+
+    if ( dec->term ) { /* the tag byte after string view is consumed now */
+      *dec->term = 0, dec->term = NULL;
+    }
+
+    if ( expected->tag == tag ) {
+      field = expected;
+    }
+    else if ( expected > fields && expected[-1].tag == tag ) { // next item of unpacked array
+      field = expected - 1;
+    }
+    else {
+      if ( !last ) {
+        for ( last = expected; last->tag; ++last ) {
+        }
+      }
+      field = last->ptr ? cf_pb_lookup_tag(fields, last, tag) : cf_pb_find_tag(fields, tag);
+    }
+
+    if ( !field ) { /* No match found, skip data */
+      if ( !(fok = pb_skip_field(istream, wiretype)) ) {
+        break;
+      }
+      CF_WARNING("tag=%u not found", tag);
+      continue;
+    }
+
+    if ( field->alloctype == CF_PB_ONEOF && *(uint32_t*) (msg + field->has_offset) != field->tag ) {
+      memset(msg + field->item_offset, 0, cf_pb_member_size(field)); /* union holds other member */
+    }
+
+    if ( field->alloctype & CF_PB_LAZY ) {
+      fok = cf_pb_decode_lazy(istream, wiretype, field, msg + field->item_offset, start, dec);
+    }
+    else {
+      fok = cf_pb_decode_field(istream, wiretype, field, msg + field->item_offset, dec);
+    }
+
+    if ( !fok ) {
+      break;
+    }
+
+    expected = field + 1;
+
+    if ( field->alloctype == CF_PB_ONEOF ) {
+      *(uint32_t*) (msg + field->has_offset) = field->tag;
+    }
+    else if ( field->has_offset != (uint16_t) (-1) ) {
+      *(bool *) (msg + field->has_offset) = true;
+    }
+  }
+
+  if ( istream->bytes_left ) {
+    fok = false;
+  }
+
+  return fok;
+}
+
+bool cf_pb_decode(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg)
+{
+  cf_pb_decoder dec = { .arena = NULL };
+  return cf_pb_decode_message(istream, fields, msg, &dec);
+}
+
+bool cf_pb_decode_reuse(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg)
+{
+  cf_pb_decoder dec = { .arena = NULL, .reuse = true };
+  return cf_pb_decode_message(istream, fields, msg, &dec);
+}
+
+bool cf_pb_decode_arena(pb_istream_t * istream, const cf_pb_field_t fields[], void * msg, cf_arena * arena)
+{
+  cf_pb_decoder dec = { .arena = arena };
+  return cf_pb_decode_message(istream, fields, msg, &dec);
+}
 
 
 
@@ -825,12 +1363,16 @@ bool cf_pb_decode(pb_istream_t * istream, const cf_pb_field_t fields[], void * m
 
 size_t cf_pb_pack(const void * message, const cf_pb_field_t fields[], void ** buf)
 {
+  cf_pb_size_cache cache;
   size_t size = 0;
 
   *buf = NULL;
 
-  if ( !cf_pb_get_encoded_size(&size, fields, message) ) {
-    CF_FATAL("cf_pb_get_encoded_size() fails");
+  cf_pb_size_cache_init(&cache);
+
+  if ( !cf_pb_message_size(fields, message, &cache, &size) ) {
+    CF_FATAL("cf_pb_message_size() fails");
+    size = 0;
   }
   else if ( !(*buf = malloc(size)) ) {
     CF_FATAL("malloc(buf) fails: %s", strerror(errno));
@@ -838,15 +1380,17 @@ size_t cf_pb_pack(const void * message, const cf_pb_field_t fields[], void ** bu
   }
   else {
     pb_ostream_t stream = pb_ostream_from_buffer(*buf, size);
-    if ( cf_pb_encode(&stream, fields, message) ) {
+    if ( cf_pb_encode_message(&stream, fields, message, &cache) ) {
       size = stream.bytes_written;
     }
     else {
-      CF_FATAL("pb_encode() fails");
+      CF_FATAL("pb_encode() fails: %s", PB_GET_ERROR(&stream));
       size = 0;
     }
   }
 
+  cf_pb_size_cache_cleanup(&cache);
+
   if ( !size && *buf ) {
     free(*buf), *buf = NULL;
   }
@@ -854,6 +1398,41 @@ size_t cf_pb_pack(const void * message, const cf_pb_field_t fields[], void ** bu
   return size;
 }
 
+bool cf_pb_pack_membuf(const void * message, const cf_pb_field_t fields[], cf_membuf * buf, size_t headroom,
+    size_t * size)
+{
+  cf_pb_size_cache cache;
+  void * data;
+  bool fok = false;
+
+  cf_pb_size_cache_init(&cache);
+
+  if ( !cf_pb_message_size(fields, message, &cache, size) ) {
+    CF_FATAL("cf_pb_message_size() fails");
+    goto end;
+  }
+
+  if ( buf->size < headroom + *size ) {
+    if ( !(data = realloc(buf->data, headroom + *size)) ) {
+      CF_FATAL("realloc(buf) fails: %s", strerror(errno));
+      goto end;
+    }
+    buf->data = data;
+    buf->size = headroom + *size;
+  }
+
+  pb_ostream_t stream = pb_ostream_from_buffer((pb_byte_t *) buf->data + headroom, *size);
+  if ( !(fok = cf_pb_encode_message(&stream, fields, message, &cache)) ) {
+    CF_FATAL("pb_encode() fails: %s", PB_GET_ERROR(&stream));
+  }
+
+end:
+
+  cf_pb_size_cache_cleanup(&cache);
+
+  return fok;
+}
+
 bool cf_pb_unpack(const void * buf, size_t size, const cf_pb_field_t fields[], void * message)
 {
   pb_istream_t stream = pb_istream_from_buffer(buf, size);
@@ -863,3 +1442,444 @@ bool cf_pb_unpack(const void * buf, size_t size, const cf_pb_field_t fields[], v
   }
   return true;
 }
+
+bool cf_pb_unpack_reuse(const void * buf, size_t size, const cf_pb_field_t fields[], void * message)
+{
+  pb_istream_t stream = pb_istream_from_buffer(buf, size);
+  if ( !cf_pb_decode_reuse(&stream, fields, message) ) {
+    CF_FATAL("pb_decode() fails: %s", PB_GET_ERROR(&stream));
+    return false;
+  }
+  return true;
+}
+
+bool cf_pb_unpack_arena(const void * buf, size_t size, const cf_pb_field_t fields[], void * message, cf_arena * arena)
+{
+  pb_istream_t stream = pb_istream_from_buffer(buf, size);
+  if ( !cf_pb_decode_arena(&stream, fields, message, arena) ) {
+    CF_FATAL("pb_decode() fails: %s", PB_GET_ERROR(&stream));
+    return false;
+  }
+  return true;
+}
+
+bool cf_pb_unpack_views(void * buf, size_t size, const cf_pb_field_t fields[], void * message, cf_arena * arena)
+{
+  pb_istream_t stream = pb_istream_from_buffer(buf, size);
+  cf_pb_decoder dec = { .arena = arena, .end = (pb_byte_t *) buf + size };
+
+  if ( !arena ) {
+    CF_FATAL("arena is required for views");
+    errno = EINVAL;
+    return false;
+  }
+
+  if ( !cf_pb_decode_message(&stream, fields, message, &dec) ) {
+    CF_FATAL("pb_decode() fails: %s", PB_GET_ERROR(&stream));
+    return false;
+  }
+
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void cf_pb_cleanup_value(const cf_pb_field_t * field, void * value)
+{
+  switch ( field->pbtype ) {
+  case CF_PB_STRING :
+    free(*(char **) value);
+    break;
+  case CF_PB_BYTES :
+    free(((cf_membuf *) value)->data);
+    break;
+  case CF_PB_MESSAGE :
+    if ( field->ptr ) {
+      cf_pb_cleanup(field->ptr, value);
+    }
+    break;
+  default :
+    break;
+  }
+
+  memset(value, 0, cf_pb_member_size(field));
+}
+
+static void cf_pb_reset_value(const cf_pb_field_t * field, void * value)
+{
+  switch ( field->pbtype ) {
+  case CF_PB_STRING :
+    if ( *(char **) value ) {
+      **(char **) value = 0;
+    }
+    break;
+  case CF_PB_BYTES :
+    ((cf_membuf *) value)->size = 0;
+    break;
+  case CF_PB_MESSAGE :
+    if ( field->ptr ) {
+      cf_pb_reset(field->ptr, value);
+    }
+    break;
+  default :
+    memset(value, 0, field->item_size);
+    break;
+  }
+}
+
+void cf_pb_reset(const cf_pb_field_t fields[], void * msg)
+{
+  const cf_pb_field_t * field;
+  ccarray_t * array;
+  void * value;
+  size_t i, n;
+
+  for ( field = fields; field->tag; ++field ) {
+
+    value = msg + field->item_offset;
+
+    switch ( field->alloctype ) {
+
+    case CF_PB_SCALAR | CF_PB_LAZY :
+    case CF_PB_ARRAY | CF_PB_LAZY :
+      /* the records buffer is kept, decoded value is not since it is allocated on access */
+      cf_pb_lazy_release(field, value);
+      ((cf_pb_lazy *) value)->data.size = 0;
+      if ( field->has_offset != (uint16_t) (-1) ) {
+        *(bool *) (msg + field->has_offset) = false;
+      }
+      break;
+
+    case CF_PB_ARRAY :
+      array = value;
+      if ( cf_pb_type_owns_memory(field->pbtype) ) {
+        for ( i = 0, n = ccarray_size(array); i < n; ++i ) {
+          cf_pb_reset_value(field, ccarray_peek(array, i));
+        }
+      }
+      array->size = 0;
+      break;
+
+    case CF_PB_ONEOF :
+      /* the union can't keep a buffer for its other members */
+      if ( *(uint32_t*) (msg + field->has_offset) == field->tag ) {
+        cf_pb_cleanup_value(field, value);
+        *(uint32_t*) (msg + field->has_offset) = 0;
+      }
+      break;
+
+    default :
+      cf_pb_reset_value(field, value);
+      if ( field->has_offset != (uint16_t) (-1) ) {
+        *(bool *) (msg + field->has_offset) = false;
+      }
+      break;
+    }
+  }
+}
+
+void cf_pb_cleanup(const cf_pb_field_t fields[], void * msg)
+{
+  const cf_pb_field_t * field;
+  ccarray_t * array;
+  void * value;
+  size_t i, n;
+
+  for ( field = fields; field->tag; ++field ) {
+
+    value = msg + field->item_offset;
+
+    switch ( field->alloctype ) {
+
+    case CF_PB_SCALAR | CF_PB_LAZY :
+    case CF_PB_ARRAY | CF_PB_LAZY :
+      cf_pb_lazy_release(field, value);
+      free(((cf_pb_lazy *) value)->data.data);
+      memset(value, 0, sizeof(cf_pb_lazy));
+      if ( field->has_offset != (uint16_t) (-1) ) {
+        *(bool *) (msg + field->has_offset) = false;
+      }
+      break;
+
+    case CF_PB_ARRAY :
+      array = value;
+      if ( cf_pb_type_owns_memory(field->pbtype) ) { /* spare items may hold buffers left by cf_pb_reset() */
+        for ( i = 0, n = ccarray_capacity(array); i < n; ++i ) {
+          cf_pb_cleanup_value(field, ccarray_peek(array, i));
+        }
+      }
+      ccarray_cleanup(array);
+      memset(array, 0, sizeof(*array));
+      break;
+
+    case CF_PB_ONEOF :
+      if ( *(uint32_t*) (msg + field->has_offset) == field->tag ) {
+        cf_pb_cleanup_value(field, value);
+        *(uint32_t*) (msg + field->has_offset) = 0;
+      }
+      break;
+
+    default :
+      cf_pb_cleanup_value(field, value);
+      if ( field->has_offset != (uint16_t) (-1) ) {
+        *(bool *) (msg + field->has_offset) = false;
+      }
+      break;
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * The value of lazy field is decoded and encoded through single-field table with the value at
+ * offset 0. Its records hold this field only, so they never reach the tag index, which is keyed
+ * by the table address.
+ */
+static void cf_pb_lazy_table(const cf_pb_field_t * field, cf_pb_field_t table[2])
+{
+  table[0] = *field;
+  table[0].alloctype &= ~CF_PB_LAZY;
+  table[0].item_offset = 0;
+  table[0].has_offset = (uint16_t) (-1);
+  memset(&table[1], 0, sizeof(table[1]));
+}
+
+static void * cf_pb_lazy_alloc(const cf_pb_field_t * field, cf_pb_lazy * lazy, cf_arena * arena)
+{
+  const size_t size = (field->alloctype & ~CF_PB_LAZY) == CF_PB_ARRAY ? sizeof(ccarray_t) : field->item_size;
+
+  if ( !lazy->value ) {
+    if ( !arena ) {
+      lazy->value = calloc(1, size);
+    }
+    else if ( (lazy->value = cf_arena_alloc(arena, size)) ) {
+      memset(lazy->value, 0, size);
+    }
+  }
+
+  return lazy->value;
+}
+
+/* Decoded value is on heap, arena messages are never released field by field */
+static void cf_pb_lazy_release(const cf_pb_field_t * field, cf_pb_lazy * lazy)
+{
+  cf_pb_field_t table[2];
+
+  if ( lazy->value ) {
+    cf_pb_lazy_table(field, table);
+    cf_pb_cleanup(table, lazy->value);
+    free(lazy->value);
+    lazy->value = NULL;
+  }
+}
+
+static bool cf_pb_lazy_append(cf_pb_lazy * lazy, const void * records, size_t size)
+{
+  size_t capacity = lazy->data.data ? malloc_usable_size(lazy->data.data) : 0;
+  void * data;
+
+  if ( lazy->data.size + size > capacity ) {
+
+    if ( (capacity *= 2) < lazy->data.size + size ) {
+      capacity = lazy->data.size + size;
+    }
+
+    if ( !(data = realloc(lazy->data.data, capacity)) ) {
+      return false;
+    }
+
+    lazy->data.data = data;
+  }
+
+  memcpy((uint8_t *) lazy->data.data + lazy->data.size, records, size);
+  lazy->data.size += size;
+
+  return true;
+}
+
+static bool cf_pb_decode_lazy(pb_istream_t * istream, pb_wire_type_t wiretype, const cf_pb_field_t * field,
+    cf_pb_lazy * lazy, const pb_byte_t * start, cf_pb_decoder * dec)
+{
+  cf_pb_field_t table[2];
+
+  if ( !dec->arena && pb_istream_is_buffer(istream) ) {
+
+    if ( !pb_skip_field(istream, wiretype) ) {
+      return false;
+    }
+
+    if ( !cf_pb_lazy_append(lazy, start, (const pb_byte_t *) istream->state - start) ) {
+      PB_SET_ERROR(istream, "realloc() fails");
+      return false;
+    }
+
+    return true;
+  }
+
+  if ( !cf_pb_lazy_alloc(field, lazy, dec->arena) ) {
+    PB_SET_ERROR(istream, "malloc() fails");
+    return false;
+  }
+
+  cf_pb_lazy_table(field, table);
+
+  return cf_pb_decode_field(istream, wiretype, table, lazy->value, dec);
+}
+
+/* Required singular field with neither value nor records can't be encoded */
+static bool cf_pb_lazy_missing(const cf_pb_field_t * field, const cf_pb_lazy * lazy)
+{
+  return field->has_offset == (uint16_t) (-1) && (field->alloctype & ~CF_PB_LAZY) == CF_PB_SCALAR
+      && !lazy->value && !lazy->data.size;
+}
+
+static bool cf_pb_lazy_size(const cf_pb_field_t * field, const cf_pb_lazy * lazy, struct cf_pb_size_cache * cache,
+    size_t * size)
+{
+  cf_pb_field_t table[2];
+  size_t value_size = 0;
+
+  if ( cf_pb_lazy_missing(field, lazy) ) {
+    CF_CRITICAL("Required lazy field tag=%u has no value", field->tag);
+    return false;
+  }
+
+  if ( lazy->value ) {
+    cf_pb_lazy_table(field, table);
+    if ( !cf_pb_message_size(table, lazy->value, cache, &value_size) ) {
+      return false;
+    }
+  }
+
+  *size = value_size + lazy->data.size;
+
+  return true;
+}
+
+static bool cf_pb_encode_lazy(pb_ostream_t * ostream, const cf_pb_field_t * field, const cf_pb_lazy * lazy,
+    struct cf_pb_size_cache * cache)
+{
+  cf_pb_field_t table[2];
+
+  if ( cf_pb_lazy_missing(field, lazy) ) {
+    PB_SET_ERROR(ostream, "Missing required lazy field");
+    return false;
+  }
+
+  if ( lazy->value ) {
+    cf_pb_lazy_table(field, table);
+    if ( !cf_pb_encode_message(ostream, table, lazy->value, cache) ) {
+      return false;
+    }
+  }
+
+  return !lazy->data.size || pb_write(ostream, lazy->data.data, lazy->data.size);
+}
+
+void * cf_pb_lazy_value(const cf_pb_field_t * field, cf_pb_lazy * lazy)
+{
+  cf_pb_field_t table[2];
+  pb_istream_t stream;
+  cf_pb_decoder dec = { .arena = NULL };
+
+  if ( !lazy->data.size ) {
+    return lazy->value;
+  }
+
+  if ( !cf_pb_lazy_alloc(field, lazy, NULL) ) {
+    CF_FATAL("calloc() fails: %s", strerror(errno));
+    return NULL;
+  }
+
+  cf_pb_lazy_table(field, table);
+  stream = pb_istream_from_buffer(lazy->data.data, lazy->data.size);
+
+  if ( !cf_pb_decode_message(&stream, table, lazy->value, &dec) ) {
+    // drop the partial value, the records are kept and still encoded as they are
+    CF_FATAL("cf_pb_decode_message() fails: %s", PB_GET_ERROR(&stream));
+    cf_pb_lazy_release(field, lazy);
+    return NULL;
+  }
+
+  lazy->data.size = 0;
+
+  return lazy->value;
+}
+
+void cf_pb_lazy_set(const cf_pb_field_t * field, cf_pb_lazy * lazy, void * value)
+{
+  cf_pb_lazy_release(field, lazy);
+  lazy->data.size = 0;
+  lazy->value = value;
+}
+
+bool cf_pb_get_lazy(cf_pb_rbuf * r, const cf_pb_field_t * field, cf_pb_lazy * lazy, const uint8_t * start,
+    pb_wire_type_t wt)
+{
+  cf_pb_field_t table[2];
+  pb_istream_t stream;
+  cf_pb_decoder dec = { .arena = r->arena };
+
+  if ( !r->arena ) {
+    return cf_pb_skip_field(r, wt) && cf_pb_lazy_append(lazy, start, r->ptr - start);
+  }
+
+  /* With arena the value is decoded right away, from the field data since
+   * the tag byte could be taken by the terminator of preceding string view */
+  if ( !cf_pb_lazy_alloc(field, lazy, r->arena) ) {
+    return false;
+  }
+
+  cf_pb_lazy_table(field, table);
+  stream = pb_istream_from_buffer(r->ptr, r->end - r->ptr);
+
+  if ( !cf_pb_decode_field(&stream, wt, table, lazy->value, &dec) ) {
+    CF_FATAL("cf_pb_decode_field() fails: %s", PB_GET_ERROR(&stream));
+    return false;
+  }
+
+  r->ptr = stream.state;
+
+  return true;
+}
+
+bool cf_pb_put_lazy(cf_pb_wbuf * w, const cf_pb_field_t * field, const cf_pb_lazy * lazy)
+{
+  cf_pb_field_t table[2];
+  pb_ostream_t stream;
+  size_t size;
+
+  if ( cf_pb_lazy_missing(field, lazy) ) {
+    CF_CRITICAL("Required lazy field tag=%u has no value", field->tag);
+    return false;
+  }
+
+  if ( lazy->data.size ) { /* the records as they are, with tags and lengths */
+    if ( !cf_pb_wbuf_reserve(w, lazy->data.size) ) {
+      return false;
+    }
+    w->ptr -= lazy->data.size;
+    memcpy(w->ptr, lazy->data.data, lazy->data.size);
+  }
+
+  if ( lazy->value ) {
+
+    cf_pb_lazy_table(field, table);
+
+    if ( !cf_pb_get_encoded_size(&size, table, lazy->value) || !cf_pb_wbuf_reserve(w, size) ) {
+      return false;
+    }
+
+    stream = pb_ostream_from_buffer(w->ptr - size, size);
+
+    if ( !cf_pb_encode(&stream, table, lazy->value) ) {
+      CF_FATAL("cf_pb_encode() fails: %s", PB_GET_ERROR(&stream));
+      return false;
+    }
+
+    w->ptr -= size;
+  }
+
+  return true;
+}
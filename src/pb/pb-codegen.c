@@ -0,0 +1,251 @@
+/*
+ * pb-codegen.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Out-of-line helpers of the generated encoders and decoders
+ */
+
+#include <cuttle/debug.h>
+#include <cuttle/pb/codegen.h>
+#include <cuttle/arena.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <errno.h>
+
+#define CF_PB_WBUF_MIN_SIZE   256
+
+
+/* prev is the heap value left by cf_pb_reset(), reused when it fits and reuse is set */
+static inline void * rbuf_alloc(const cf_pb_rbuf * r, void * prev, size_t size)
+{
+  if ( r->arena ) {
+    return cf_arena_alloc(r->arena, size);
+  }
+  return r->reuse ? cf_pb_realloc(prev, size) : malloc(size);
+}
+
+void * cf_pb_realloc(void * ptr, size_t size)
+{
+  return ptr && malloc_usable_size(ptr) >= size ? ptr : realloc(ptr, size);
+}
+
+
+bool cf_pb_wbuf_grow(cf_pb_wbuf * w, size_t n)
+{
+  size_t size = w->end - w->ptr;
+  size_t capacity = w->end - w->base;
+  size_t new_capacity = capacity ? 2 * capacity : CF_PB_WBUF_MIN_SIZE;
+  uint8_t * base;
+
+  while ( new_capacity < size + n ) {
+    new_capacity *= 2;
+  }
+
+  if ( !(base = malloc(new_capacity)) ) {
+    CF_FATAL("malloc(%zu) fails: %s", new_capacity, strerror(errno));
+    return false;
+  }
+
+  if ( size ) {
+    memcpy(base + new_capacity - size, w->ptr, size);
+  }
+
+  free(w->base);
+
+  w->base = base;
+  w->end = base + new_capacity;
+  w->ptr = w->end - size;
+
+  return true;
+}
+
+void cf_pb_wbuf_cleanup(cf_pb_wbuf * w)
+{
+  free(w->base);
+  w->base = w->ptr = w->end = NULL;
+}
+
+size_t cf_pb_wbuf_detach(cf_pb_wbuf * w, void ** buf)
+{
+  size_t size = cf_pb_wbuf_size(w);
+
+  if ( size && w->ptr != w->base ) {
+    memmove(w->base, w->ptr, size);
+  }
+
+  *buf = w->base;
+  w->base = w->ptr = w->end = NULL;
+
+  return size;
+}
+
+
+/*
+ * Multi-byte varints up to 8 bytes (56 bits) are decoded from one 64-bit load without
+ * per byte branches: the length comes from the first clear continuation bit, then the
+ * 7-bit groups are packed together in three shift-and-mask steps.
+ * Longer varints and the last bytes of buffer go through the byte loop.
+ */
+bool cf_pb_get_varint_slow(cf_pb_rbuf * r, uint64_t * v)
+{
+  const uint8_t * p = r->ptr;
+  uint64_t result = 0;
+  int shift = 0;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if ( r->end - r->ptr >= 8 ) {
+
+    uint64_t w, stop;
+    int n;
+
+    memcpy(&w, p, 8);
+
+    if ( (stop = ~w & 0x8080808080808080ULL) ) {
+
+      n = (__builtin_ctzll(stop) + 1) / 8;
+      if ( n < 8 ) {
+        w &= (1ULL << (8 * n)) - 1;
+      }
+
+      w &= 0x7F7F7F7F7F7F7F7FULL;
+      w = ((w & 0x7F007F007F007F00ULL) >> 1) | (w & 0x007F007F007F007FULL);
+      w = ((w & 0x3FFF00003FFF0000ULL) >> 2) | (w & 0x00003FFF00003FFFULL);
+      w = ((w & 0x0FFFFFFF00000000ULL) >> 4) | (w & 0x000000000FFFFFFFULL);
+
+      *v = w;
+      r->ptr = p + n;
+      return true;
+    }
+  }
+#endif
+
+  while ( p < r->end && shift < 64 ) {
+    result |= (uint64_t) (*p & 0x7F) << shift;
+    if ( !(*p++ & 0x80) ) {
+      *v = result;
+      r->ptr = p;
+      return true;
+    }
+    shift += 7;
+  }
+
+  return false;
+}
+
+bool cf_pb_get_string(cf_pb_rbuf * r, char ** value)
+{
+  cf_pb_rbuf sub;
+  char * str;
+
+  if ( !cf_pb_get_sub(r, &sub) ) {
+    return false;
+  }
+
+  if ( r->views && sub.end < r->views->end ) { /* terminated by cf_pb_get_tag() */
+    *value = (char *) sub.ptr;
+    r->views->term = (uint8_t *) sub.end;
+    return true;
+  }
+
+  if ( !(str = rbuf_alloc(r, *value, sub.end - sub.ptr + 1)) ) {
+    CF_FATAL("malloc() fails: %s", strerror(errno));
+    return false;
+  }
+
+  memcpy(str, sub.ptr, sub.end - sub.ptr);
+  str[sub.end - sub.ptr] = 0;
+
+  *value = str;
+
+  return true;
+}
+
+bool cf_pb_get_bytes(cf_pb_rbuf * r, cf_membuf * value)
+{
+  cf_pb_rbuf sub;
+  void * data = NULL;
+
+  if ( !cf_pb_get_sub(r, &sub) ) {
+    return false;
+  }
+
+  if ( r->views ) {
+    data = sub.end > sub.ptr ? (void *) sub.ptr : NULL;
+  }
+  else if ( sub.end > sub.ptr ) {
+    if ( !(data = rbuf_alloc(r, value->data, sub.end - sub.ptr)) ) {
+      CF_FATAL("malloc() fails: %s", strerror(errno));
+      return false;
+    }
+    memcpy(data, sub.ptr, sub.end - sub.ptr);
+  }
+  else if ( r->reuse ) {
+    data = value->data; // keep the buffer for next decode
+  }
+
+  value->data = data;
+  value->size = sub.end - sub.ptr;
+
+  return true;
+}
+
+bool cf_pb_skip_field(cf_pb_rbuf * r, pb_wire_type_t wt)
+{
+  cf_pb_rbuf sub;
+  uint64_t v;
+
+  switch ( wt ) {
+  case PB_WT_VARINT :
+    return cf_pb_get_varint(r, &v);
+  case PB_WT_64BIT :
+    return cf_pb_get_fixed64(r, &v);
+  case PB_WT_STRING :
+    return cf_pb_get_sub(r, &sub);
+  case PB_WT_32BIT :
+    return cf_pb_get_fixed32(r, &v);
+  }
+
+  return false;
+}
+
+/*
+ * Items past the array size are either zeroed here when the array grows or left by
+ * cf_pb_reset() with their buffers, so they are not cleared on each push.
+ */
+void * cf_pb_array_push(cf_pb_rbuf * r, ccarray_t * array, size_t item_size)
+{
+  const size_t capacity = ccarray_capacity(array);
+  void * item;
+
+  if ( ccarray_size(array) >= capacity ) {
+
+    if ( r->arena ) {
+      size_t new_capacity = capacity ? 2 * capacity : 16;
+      if ( !(item = cf_arena_realloc(r->arena, array->items, capacity * item_size, new_capacity * item_size)) ) {
+        return NULL;
+      }
+      array->items = item;
+      array->capacity = new_capacity;
+      array->item_size = item_size;
+    }
+    else if ( !capacity ) {
+      if ( !ccarray_init(array, 16, item_size) ) {
+        CF_FATAL("ccarray_init() fails: %s", strerror(errno));
+        return NULL;
+      }
+    }
+    else if ( ccarray_realloc(array, 2 * capacity) != 2 * capacity ) {
+      CF_FATAL("ccarray_realloc() fails: %s", strerror(errno));
+      return NULL;
+    }
+
+    memset(ccarray_peek(array, capacity), 0, (ccarray_capacity(array) - capacity) * item_size);
+  }
+
+  item = ccarray_peek_end(array);
+  ++array->size;
+
+  return item;
+}
@@ -0,0 +1,676 @@
+/*
+ * protocol-test.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  corpc protocol regression tests: fragmented messages, pipelined open errors, call deadlines,
+ *  compression, and fallback to peers without each of the protocol capabilities.
+ *  Server and client run in the same process on separate scheduler threads,
+ *  the exit status is the number of failed tests.
+ *
+ *  Usage: protocol-test
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <cuttle/debug.h>
+#include <cuttle/time.h>
+#include <cuttle/cothread/scheduler.h>
+#include <cuttle/ssl/init-ssl.h>
+#include <cuttle/corpc/server.h>
+#include "corpc/corpc-channel.h"
+#include "corpc/corpc-proto.h"
+
+
+#define TEST_TCP_PORT     6028
+#define TEST_UNIX_PATH    "/tmp/corpc-protocol-test.sock"
+
+#define CHECK(x) \
+  if ( !(x) ) { \
+    fprintf(stderr, "%s:%d: %s: check failed: %s\n", __FILE__, __LINE__, __func__, #x); \
+    goto end; \
+  }
+
+struct blob {
+  void * data;
+  size_t size;
+};
+
+static int nb_failed = 0;
+static int client_main_finished = 0;
+static co_thread_lock_t thread_lock = CO_THREAD_LOCK_INITIALIZER;
+
+// guarded by thread_lock
+static uint32_t server_disabled_caps;
+static int server_remaining_time;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static void set_event(int * event)
+{
+  co_thread_lock(&thread_lock);
+  ++*event;
+  co_thread_broadcast(&thread_lock);
+  co_thread_unlock(&thread_lock);
+}
+
+static void wait_event(int * event, int v)
+{
+  co_thread_lock(&thread_lock);
+  while ( *event != v ) {
+    co_thread_wait(&thread_lock, -1);
+  }
+  co_thread_unlock(&thread_lock);
+}
+
+static void set_locked(void * dst, const void * src, size_t size)
+{
+  co_thread_lock(&thread_lock);
+  memcpy(dst, src, size);
+  co_thread_unlock(&thread_lock);
+}
+
+static void get_locked(void * dst, const void * src, size_t size)
+{
+  co_thread_lock(&thread_lock);
+  memcpy(dst, src, size);
+  co_thread_unlock(&thread_lock);
+}
+
+static size_t pack_blob(const void * obj, void ** data)
+{
+  const struct blob * b = obj;
+  if ( (*data = malloc(b->size)) ) {
+    memcpy(*data, b->data, b->size);
+    return b->size;
+  }
+  return 0;
+}
+
+static bool unpack_blob(void * obj, const void * data, size_t size)
+{
+  struct blob * b = obj;
+  if ( !(b->data = malloc(size ? size : 1)) ) {
+    return false;
+  }
+  memcpy(b->data, data, size);
+  b->size = size;
+  return true;
+}
+
+// deflate can't shrink it
+static void fill_random(void * data, size_t size, uint32_t seed)
+{
+  uint8_t * p = data;
+  for ( size_t i = 0; i < size; ++i ) {
+    seed = seed * 1103515245 + 12345;
+    p[i] = seed >> 24;
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static void on_echo(corpc_stream * st)
+{
+  void * data = NULL;
+  ssize_t size;
+
+  if ( (size = corpc_stream_read(st, &data)) >= 0 ) {
+    corpc_stream_write(st, data, size);
+  }
+
+  free(data);
+}
+
+// echo every message until the client closes the stream
+static void on_echo_all(corpc_stream * st)
+{
+  void * data = NULL;
+  ssize_t size;
+
+  while ( (size = corpc_stream_read(st, &data)) >= 0 ) {
+    if ( !corpc_stream_write(st, data, size) ) {
+      break;
+    }
+    free(data), data = NULL;
+  }
+
+  free(data);
+}
+
+// first message is the number of messages to follow, the responce is the number of bytes received
+static void on_sink(corpc_stream * st)
+{
+  void * data = NULL;
+  uint64_t count = 0, total = 0;
+  ssize_t size;
+
+  if ( (size = corpc_stream_read(st, &data)) != sizeof(count) ) {
+    CF_CRITICAL("bad sink header");
+    goto end;
+  }
+
+  memcpy(&count, data, sizeof(count));
+  free(data), data = NULL;
+
+  while ( count-- > 0 && (size = corpc_stream_read(st, &data)) >= 0 ) {
+    total += size;
+    free(data), data = NULL;
+  }
+
+  corpc_stream_write(st, &total, sizeof(total));
+
+end:
+  free(data);
+}
+
+// the request is the number of milliseconds to sleep before echoing it back
+static void on_sleep(corpc_stream * st)
+{
+  void * data = NULL;
+  uint32_t ms;
+  int remaining;
+
+  if ( corpc_stream_read(st, &data) == sizeof(ms) ) {
+    remaining = corpc_stream_get_remaining_time(st);
+    set_locked(&server_remaining_time, &remaining, sizeof(remaining));
+    memcpy(&ms, data, sizeof(ms));
+    co_sleep(ms);
+    corpc_stream_write(st, data, sizeof(ms));
+  }
+
+  free(data);
+}
+
+static corpc_service test_service = {
+  .name = "test",
+  .methods = {
+    { .name = "echo", .proc = on_echo },
+    { .name = "echo_all", .proc = on_echo_all },
+    { .name = "sink", .proc = on_sink },
+    { .name = "sleep", .proc = on_sleep },
+    { .name = NULL },
+  }
+};
+
+static const corpc_service * test_services[] = {
+  &test_service,
+  NULL
+};
+
+// the server side plays legacy peer for test_legacy_peer()
+static bool on_accept(const corpc_channel * channel)
+{
+  uint32_t caps;
+  get_locked(&caps, &server_disabled_caps, sizeof(caps));
+  corpc_channel_disable_caps((corpc_channel *) channel, caps);
+  return true;
+}
+
+static bool start_server(void)
+{
+  corpc_server * server;
+  struct corpc_listening_port_opts opts;
+
+  if ( !(server = corpc_server_new(&(struct corpc_server_opts ) { .ssl_ctx = NULL })) ) {
+    CF_FATAL("corpc_server_new() fails");
+    return false;
+  }
+
+  memset(&opts, 0, sizeof(opts));
+  opts.services = test_services;
+  opts.nocrc = true;
+  opts.onaccept = on_accept;
+
+  opts.listen_address.in.sin_family = AF_INET;
+  opts.listen_address.in.sin_port = htons(TEST_TCP_PORT);
+  opts.listen_address.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ( !corpc_server_add_port(server, &opts) ) {
+    CF_FATAL("corpc_server_add_port(tcp) fails");
+    return false;
+  }
+
+  memset(&opts.listen_address, 0, sizeof(opts.listen_address));
+  opts.listen_address.un.sun_family = AF_UNIX;
+  strncpy(opts.listen_address.un.sun_path, TEST_UNIX_PATH, sizeof(opts.listen_address.un.sun_path) - 1);
+  if ( !corpc_server_add_port(server, &opts) ) {
+    CF_FATAL("corpc_server_add_port(unix) fails");
+    return false;
+  }
+
+  return corpc_server_start(server);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static corpc_channel * open_channel(const char * address, uint16_t port)
+{
+  return corpc_channel_open(&(struct corpc_channel_open_args ) {
+        .connect_address = address,
+        .connect_port = port,
+        .connect_tmout_ms = 5000,
+        .nocrc = true,
+      });
+}
+
+static bool call(corpc_channel * channel, const char * method, const void * data, size_t size, int tmo)
+{
+  struct blob rq = { (void *) data, size };
+  struct blob rp = { NULL, 0 };
+  bool fok;
+
+  fok = corpc_call(channel, "test", method, pack_blob, &rq, unpack_blob, &rp, tmo)
+      && rp.size == size && memcmp(rp.data, data, size) == 0;
+
+  free(rp.data);
+  return fok;
+}
+
+static bool call_sleep(corpc_channel * channel, uint32_t ms, int tmo)
+{
+  return call(channel, "sleep", &ms, sizeof(ms), tmo);
+}
+
+static bool echo_message(corpc_stream * st, const void * data, size_t size)
+{
+  void * reply = NULL;
+  bool fok;
+
+  fok = corpc_stream_write(st, data, size) && corpc_stream_read(st, &reply) == (ssize_t) size
+      && memcmp(reply, data, size) == 0;
+
+  free(reply);
+  return fok;
+}
+
+static bool sink(corpc_channel * channel, uint64_t count, size_t size)
+{
+  corpc_stream * st = NULL;
+  uint64_t * total = NULL;
+  void * buf = NULL;
+  bool fok = false;
+
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "test",
+        .method = "sink",
+      });
+
+  CHECK(st);
+  CHECK((buf = calloc(1, size)));
+  CHECK(corpc_stream_write(st, &count, sizeof(count)));
+
+  for ( uint64_t i = 0; i < count; ++i ) {
+    CHECK(corpc_stream_write(st, buf, size));
+  }
+
+  CHECK(corpc_stream_read(st, (void**) &total) == sizeof(*total));
+  CHECK(*total == count * size);
+
+  fok = true;
+
+end:
+  corpc_close_stream(&st);
+  free(total);
+  free(buf);
+  return fok;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool test_large_message(corpc_channel * channel)
+{
+  const size_t size = 3 * CORPC_MAX_PAYLOAD_SIZE + 17;
+  corpc_stream * st = NULL;
+  void * data = NULL;
+  bool fok = false;
+
+  CHECK((data = malloc(size)));
+  fill_random(data, size, 1);
+
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "test",
+        .method = "echo_all",
+      });
+
+  CHECK(st);
+  CHECK(echo_message(st, data, size));
+  CHECK(echo_message(st, "x", 1)); // framing is intact after the fragments
+  CHECK(echo_message(st, data, size));
+
+  // does not fit call_req frame, goes over stream
+  CHECK(call(channel, "echo", data, size, 0));
+
+  fok = true;
+
+end:
+  corpc_close_stream(&st);
+  free(data);
+  return fok;
+}
+
+static bool test_pipelined_open_errors(corpc_channel * channel)
+{
+  corpc_stream * st = NULL;
+  void * data = NULL;
+  bool fok = false;
+
+  // peer caps are learnt from the first stream of the channel
+  CHECK(call(channel, "echo", "ping", 4, 0));
+
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "test",
+        .method = "nosuch",
+        .pipelined = true,
+      });
+
+  CHECK(st);
+  CHECK(st->early);
+  corpc_stream_write(st, "early", 5); // may succeed before the refusal arrives
+  CHECK(corpc_stream_read(st, &data) < 0);
+  CHECK(corpc_get_stream_state(st) == corpc_stream_no_such_method);
+  CHECK(!corpc_stream_write(st, "late", 4));
+  corpc_close_stream(&st);
+
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "nosuch",
+        .method = "echo",
+        .pipelined = true,
+      });
+
+  CHECK(st);
+  CHECK(corpc_stream_read(st, &data) < 0);
+  CHECK(corpc_get_stream_state(st) == corpc_stream_no_such_service ||
+      corpc_get_stream_state(st) == corpc_stream_no_such_method); // unknown method id can't tell which
+  corpc_close_stream(&st);
+
+  // the channel is still usable
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "test",
+        .method = "echo_all",
+        .pipelined = true,
+      });
+
+  CHECK(st);
+  CHECK(echo_message(st, "hello", 5));
+  CHECK(corpc_get_stream_state(st) == corpc_stream_established);
+
+  fok = true;
+
+end:
+  corpc_close_stream(&st);
+  free(data);
+  return fok;
+}
+
+static bool test_call_deadline(corpc_channel * channel)
+{
+  int64_t t0, elapsed;
+  int remaining;
+  bool fok = false;
+
+  // zero and -1 are no deadline
+  CHECK(call(channel, "echo", "ping", 4, 0));
+  CHECK(call(channel, "echo", "ping", 4, -1));
+  CHECK(call(channel, "echo", "ping", 4, 5000));
+
+  t0 = cf_get_monotic_ms();
+  CHECK(call_sleep(channel, 200, 0));
+  CHECK(cf_get_monotic_ms() - t0 >= 200);
+  get_locked(&remaining, &server_remaining_time, sizeof(remaining));
+  CHECK(remaining == -1);
+
+  // the deadline reaches the server
+  CHECK(call_sleep(channel, 50, 5000));
+  get_locked(&remaining, &server_remaining_time, sizeof(remaining));
+  CHECK(remaining > 0 && remaining <= 5000);
+
+  // the server exceeds it, the caller does not wait for the responce
+  t0 = cf_get_monotic_ms();
+  CHECK(!call_sleep(channel, 2000, 200));
+  elapsed = cf_get_monotic_ms() - t0;
+  CHECK(elapsed >= 200 && elapsed < 1500);
+
+  // and the channel is not affected by the late responce
+  CHECK(call(channel, "echo", "ping", 4, 0));
+
+  fok = true;
+
+end:
+  return fok;
+}
+
+static bool test_compression(corpc_channel * channel)
+{
+  const size_t size = 64 * 1024;
+  struct corpc_compression_stats s0, s1;
+  corpc_stream * st = NULL;
+  void * data = NULL;
+  bool fok = false;
+
+  if ( !corpc_compression_supported(corpc_compression_deflate) ) {
+    printf("  deflate is not built in, skipped\n");
+    return true;
+  }
+
+  CHECK((data = calloc(1, size)));
+
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "test",
+        .method = "echo_all",
+        .compression = corpc_compression_deflate,
+        .compression_threshold = 256,
+      });
+
+  CHECK(st);
+  CHECK(st->compression == corpc_compression_deflate);
+  CHECK(corpc_channel_get_compression_stats(channel, &s0));
+
+  CHECK(echo_message(st, data, size)); // compressible
+  CHECK(corpc_channel_get_compression_stats(channel, &s1));
+  CHECK(s1.compressed_messages == s0.compressed_messages + 1);
+  CHECK(s1.incompressible_messages == s0.incompressible_messages);
+  CHECK(s1.compressed_bytes_out - s0.compressed_bytes_out < size / 16);
+  CHECK(s1.compressed_bytes_in > s0.compressed_bytes_in); // the echo came compressed too
+
+  fill_random(data, size, 2);
+  CHECK(echo_message(st, data, size)); // incompressible, goes as is
+  CHECK(corpc_channel_get_compression_stats(channel, &s0));
+  CHECK(s0.compressed_messages == s1.compressed_messages);
+  CHECK(s0.incompressible_messages == s1.incompressible_messages + 1);
+
+  CHECK(echo_message(st, data, 100)); // below threshold, not even tried
+  CHECK(corpc_channel_get_compression_stats(channel, &s1));
+  CHECK(s1.compressed_messages == s0.compressed_messages);
+  CHECK(s1.incompressible_messages == s0.incompressible_messages);
+
+  // larger than one frame, compressed or not
+  free(data);
+  CHECK((data = malloc(3 * CORPC_MAX_PAYLOAD_SIZE)));
+  fill_random(data, 3 * CORPC_MAX_PAYLOAD_SIZE, 3);
+  CHECK(echo_message(st, data, 3 * CORPC_MAX_PAYLOAD_SIZE));
+  memset(data, 'z', 3 * CORPC_MAX_PAYLOAD_SIZE);
+  CHECK(echo_message(st, data, 3 * CORPC_MAX_PAYLOAD_SIZE));
+
+  fok = true;
+
+end:
+  corpc_close_stream(&st);
+  free(data);
+  return fok;
+}
+
+/*
+ * The server stops announcing one capability bit, everything must still work
+ * through the fallback path. caps = 0 is the control run with everything enabled.
+ */
+static bool test_legacy_peer(uint32_t cap)
+{
+  const size_t large_size = 2 * CORPC_MAX_PAYLOAD_SIZE;
+  corpc_channel * channel = NULL;
+  corpc_stream * st = NULL;
+  void * data = NULL;
+  uint32_t expected;
+  bool fok = false;
+
+  // peer without byte windows ignores the whole handshake extension
+  expected = cap == corpc_cap_byte_window ? 0 : ~cap;
+
+  set_locked(&server_disabled_caps, &cap, sizeof(cap));
+
+  CHECK((channel = open_channel("unix:" TEST_UNIX_PATH, 0)));
+  CHECK((data = calloc(1, large_size)));
+
+  // first stream of the channel learns the peer caps
+  CHECK(call(channel, "echo", "ping", 4, 0));
+  CHECK(!(channel->peer_caps & cap));
+  CHECK((channel->peer_caps == 0) == (cap == corpc_cap_byte_window));
+
+  // unary call or its fallback, with and without deadline
+  CHECK(call(channel, "echo", "ping", 4, 0));
+  CHECK(call_sleep(channel, 20, 5000));
+  CHECK(!call_sleep(channel, 2000, 100));
+
+  // pipelined open waits for the peer without early data
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "test",
+        .method = "echo_all",
+        .pipelined = true,
+        .compression = corpc_compression_deflate,
+      });
+
+  CHECK(st);
+  CHECK(st->early == !!(expected & corpc_cap_early_data));
+  CHECK(echo_message(st, "hello", 5));
+  CHECK(!(st->caps & cap));
+  CHECK(!!(st->caps & corpc_cap_nocrc) == !!(expected & corpc_cap_nocrc));
+
+  if ( corpc_compression_supported(corpc_compression_deflate) ) {
+    CHECK(st->compression == (expected & corpc_cap_deflate ? corpc_compression_deflate : corpc_compression_none));
+  }
+
+  if ( !(expected & corpc_cap_fragments) ) {
+    CHECK(!corpc_stream_write(st, data, large_size));
+    CHECK(errno == EMSGSIZE);
+  }
+  else {
+    CHECK(echo_message(st, data, large_size));
+  }
+
+  CHECK(echo_message(st, data, 1000));
+  corpc_close_stream(&st);
+
+  // many more messages and bytes than any initial window
+  CHECK(sink(channel, 256, 8 * 1024));
+
+  fok = true;
+
+end:
+  corpc_close_stream(&st);
+  corpc_channel_close(&channel);
+  free(data);
+  return fok;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static void report(const char * name, const char * transport, bool fok)
+{
+  printf("%-28s %-6s %s\n", name, transport, fok ? "OK" : "FAILED");
+  if ( !fok ) {
+    ++nb_failed;
+  }
+}
+
+static void run_tests(const char * transport, const char * address, uint16_t port)
+{
+  corpc_channel * channel;
+
+  if ( !(channel = open_channel(address, port)) ) {
+    report("connect", transport, false);
+    return;
+  }
+
+  report("pipelined open errors", transport, test_pipelined_open_errors(channel));
+  report("large message", transport, test_large_message(channel));
+  report("call deadline", transport, test_call_deadline(channel));
+  report("compression", transport, test_compression(channel));
+
+  corpc_channel_close(&channel);
+}
+
+static void client_main(void * arg)
+{
+  static const struct {
+    uint32_t cap;
+    const char * name;
+  } caps[] = {
+    { 0, "legacy peer: none" },
+    { corpc_cap_byte_window, "legacy peer: byte_window" },
+    { corpc_cap_fragments, "legacy peer: fragments" },
+    { corpc_cap_nocrc, "legacy peer: nocrc" },
+    { corpc_cap_early_data, "legacy peer: early_data" },
+    { corpc_cap_method_id, "legacy peer: method_id" },
+    { corpc_cap_unary, "legacy peer: unary" },
+    { corpc_cap_deflate, "legacy peer: deflate" },
+  };
+
+  (void) (arg);
+
+  run_tests("tcp", "127.0.0.1", TEST_TCP_PORT);
+  run_tests("unix", "unix:" TEST_UNIX_PATH, 0);
+
+  for ( size_t i = 0; i < sizeof(caps) / sizeof(caps[0]); ++i ) {
+    report(caps[i].name, "unix", test_legacy_peer(caps[i].cap));
+  }
+
+  set_event(&client_main_finished);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+  (void) (argv);
+
+  if ( argc > 1 ) {
+    fprintf(stderr, "Usage: protocol-test\n");
+    return 1;
+  }
+
+  cf_set_logfilename("stderr");
+  cf_set_loglevel(CF_LOG_FATAL);
+
+  if ( !cf_ssl_initialize() ) {
+    CF_FATAL("cf_ssl_initialize() fails");
+    return 1;
+  }
+
+  if ( !co_scheduler_init(2) ) {
+    CF_FATAL("co_scheduler_init() fails");
+    return 1;
+  }
+
+  unlink(TEST_UNIX_PATH);
+
+  if ( !start_server() ) {
+    return 1;
+  }
+
+  if ( !co_schedule(client_main, NULL, 1024 * 1024) ) {
+    CF_FATAL("co_schedule(client_main) fails: %s", strerror(errno));
+    return 1;
+  }
+
+  wait_event(&client_main_finished, 1);
+  unlink(TEST_UNIX_PATH);
+
+  printf("%s: %d failed\n", nb_failed ? "FAILED" : "PASSED", nb_failed);
+
+  return nb_failed;
+}
@@ -0,0 +1,414 @@
+/*
+ * transport-bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Compare corpc latency and throughput over loopback TCP, loopback TLS, AF_UNIX socket
+ *  and shared memory rings.
+ *  Server and client run in the same process on separate scheduler threads.
+ *
+ *  Usage: transport-bench [-cert server.crt -key server.key] [-n calls] [-mb MiB] [-size bytes]
+ *    TLS is measured only if server certificate and key are given
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <cuttle/debug.h>
+#include <cuttle/time.h>
+#include <cuttle/cothread/scheduler.h>
+#include <cuttle/ssl/init-ssl.h>
+#include <cuttle/corpc/server.h>
+
+
+#define BENCH_TCP_PORT    6018
+#define BENCH_TLS_PORT    6019
+#define BENCH_UNIX_PATH   "/tmp/corpc-transport-bench.sock"
+#define BENCH_SHM_PATH    "/tmp/corpc-transport-bench-shm.sock"
+
+struct blob {
+  void * data;
+  size_t size;
+};
+
+static SSL_CTX * server_ssl_ctx;
+static SSL_CTX * client_ssl_ctx;
+
+static int nb_calls = 20000;
+static size_t call_size = 64;
+static size_t stream_bytes = 256 * 1024 * 1024;
+static size_t stream_msg_size = 32 * 1024;
+
+static int client_main_finished = 0;
+static co_thread_lock_t thread_lock = CO_THREAD_LOCK_INITIALIZER;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static void set_event(int * event)
+{
+  co_thread_lock(&thread_lock);
+  ++*event;
+  co_thread_broadcast(&thread_lock);
+  co_thread_unlock(&thread_lock);
+}
+
+static void wait_event(int * event, int v)
+{
+  co_thread_lock(&thread_lock);
+  while ( *event != v ) {
+    co_thread_wait(&thread_lock, -1);
+  }
+  co_thread_unlock(&thread_lock);
+}
+
+static size_t pack_blob(const void * obj, void ** data)
+{
+  const struct blob * b = obj;
+  if ( (*data = malloc(b->size)) ) {
+    memcpy(*data, b->data, b->size);
+    return b->size;
+  }
+  return 0;
+}
+
+static bool unpack_blob(void * obj, const void * data, size_t size)
+{
+  struct blob * b = obj;
+  if ( !(b->data = malloc(size)) ) {
+    return false;
+  }
+  memcpy(b->data, data, size);
+  b->size = size;
+  return true;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static void on_echo(corpc_stream * st)
+{
+  void * data = NULL;
+  ssize_t size;
+
+  if ( (size = corpc_stream_read(st, &data)) >= 0 ) {
+    corpc_stream_write(st, data, size);
+  }
+
+  free(data);
+}
+
+// first message is the number of messages to follow, the responce is the number of bytes received
+static void on_sink(corpc_stream * st)
+{
+  void * data = NULL;
+  uint64_t count = 0, total = 0;
+  ssize_t size;
+
+  if ( (size = corpc_stream_read(st, &data)) != sizeof(count) ) {
+    CF_CRITICAL("bad sink header");
+    goto end;
+  }
+
+  memcpy(&count, data, sizeof(count));
+  free(data), data = NULL;
+
+  while ( count-- > 0 && (size = corpc_stream_read(st, &data)) >= 0 ) {
+    total += size;
+    free(data), data = NULL;
+  }
+
+  corpc_stream_write(st, &total, sizeof(total));
+
+end:
+  free(data);
+}
+
+static corpc_service bench_service = {
+  .name = "bench",
+  .methods = {
+    { .name = "echo", .proc = on_echo },
+    { .name = "sink", .proc = on_sink },
+    { .name = NULL },
+  }
+};
+
+static const corpc_service * bench_services[] = {
+  &bench_service,
+  NULL
+};
+
+static bool start_server(void)
+{
+  corpc_server * server;
+  struct corpc_listening_port_opts opts;
+
+  if ( !(server = corpc_server_new(&(struct corpc_server_opts ) { .ssl_ctx = NULL })) ) {
+    CF_FATAL("corpc_server_new() fails");
+    return false;
+  }
+
+  memset(&opts, 0, sizeof(opts));
+  opts.services = bench_services;
+  opts.nocrc = true;
+
+  opts.listen_address.in.sin_family = AF_INET;
+  opts.listen_address.in.sin_port = htons(BENCH_TCP_PORT);
+  opts.listen_address.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if ( !corpc_server_add_port(server, &opts) ) {
+    CF_FATAL("corpc_server_add_port(tcp) fails");
+    return false;
+  }
+
+  if ( server_ssl_ctx ) {
+    opts.listen_address.in.sin_port = htons(BENCH_TLS_PORT);
+    opts.ssl_ctx = server_ssl_ctx;
+    if ( !corpc_server_add_port(server, &opts) ) {
+      CF_FATAL("corpc_server_add_port(tls) fails");
+      return false;
+    }
+    opts.ssl_ctx = NULL;
+  }
+
+  memset(&opts.listen_address, 0, sizeof(opts.listen_address));
+  opts.listen_address.un.sun_family = AF_UNIX;
+  strncpy(opts.listen_address.un.sun_path, BENCH_UNIX_PATH, sizeof(opts.listen_address.un.sun_path) - 1);
+  if ( !corpc_server_add_port(server, &opts) ) {
+    CF_FATAL("corpc_server_add_port(unix) fails");
+    return false;
+  }
+
+  strncpy(opts.listen_address.un.sun_path, BENCH_SHM_PATH, sizeof(opts.listen_address.un.sun_path) - 1);
+  opts.shm = true;
+  if ( !corpc_server_add_port(server, &opts) ) {
+    CF_FATAL("corpc_server_add_port(shm) fails");
+    return false;
+  }
+
+  return corpc_server_start(server);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static int cmp_int64(const void * a, const void * b)
+{
+  const int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+static bool bench_latency(corpc_channel * channel, double * p50, double * p99, double * rps)
+{
+  struct blob rq, rp;
+  int64_t * t = NULL;
+  int64_t t0, t1;
+  bool fok = false;
+
+  if ( !(t = malloc(nb_calls * sizeof(*t))) || !(rq.data = calloc(1, rq.size = call_size)) ) {
+    goto end;
+  }
+
+  t0 = cf_get_monotic_us();
+
+  for ( int i = 0; i < nb_calls; ++i ) {
+
+    int64_t c0 = cf_get_monotic_us();
+
+    if ( !corpc_call(channel, "bench", "echo", pack_blob, &rq, unpack_blob, &rp, -1) ) {
+      CF_FATAL("corpc_call() fails at %d: %s", i, strerror(errno));
+      goto end;
+    }
+
+    t[i] = cf_get_monotic_us() - c0;
+    free(rp.data);
+  }
+
+  t1 = cf_get_monotic_us();
+
+  qsort(t, nb_calls, sizeof(*t), cmp_int64);
+  *p50 = t[nb_calls / 2];
+  *p99 = t[nb_calls * 99 / 100];
+  *rps = 1e6 * nb_calls / (t1 > t0 ? t1 - t0 : 1);
+
+  fok = true;
+
+end:
+  free(rq.data);
+  free(t);
+  return fok;
+}
+
+static bool bench_throughput(corpc_channel * channel, double * mbps)
+{
+  corpc_stream * st = NULL;
+  uint64_t count = stream_bytes / stream_msg_size;
+  uint64_t * total = NULL;
+  void * buf = NULL;
+  int64_t t0, t1;
+  bool fok = false;
+
+  if ( !(buf = calloc(1, stream_msg_size)) ) {
+    goto end;
+  }
+
+  t0 = cf_get_monotic_us();
+
+  st = corpc_open_stream(channel, &(struct corpc_open_stream_opts ) {
+        .service = "bench",
+        .method = "sink",
+        .pipelined = true,
+      });
+
+  if ( !st || !corpc_stream_write(st, &count, sizeof(count)) ) {
+    CF_FATAL("sink open fails: %s", strerror(errno));
+    goto end;
+  }
+
+  for ( uint64_t i = 0; i < count; ++i ) {
+    if ( !corpc_stream_write(st, buf, stream_msg_size) ) {
+      CF_FATAL("corpc_stream_write() fails: %s", strerror(errno));
+      goto end;
+    }
+  }
+
+  if ( corpc_stream_read(st, (void**) &total) != sizeof(*total) ) {
+    CF_FATAL("corpc_stream_read() fails: %s", strerror(errno));
+    goto end;
+  }
+
+  t1 = cf_get_monotic_us();
+
+  *mbps = (double) *total / (t1 > t0 ? t1 - t0 : 1) * 1e6 / (1024 * 1024);
+  fok = true;
+
+end:
+  corpc_close_stream(&st);
+  free(total);
+  free(buf);
+  return fok;
+}
+
+static void run_bench(const char * name, const char * address, uint16_t port, SSL_CTX * ssl_ctx)
+{
+  corpc_channel * channel;
+  double p50 = 0, p99 = 0, rps = 0, mbps = 0;
+
+  channel = corpc_channel_open(&(struct corpc_channel_open_args ) {
+        .connect_address = address,
+        .connect_port = port,
+        .connect_tmout_ms = 5000,
+        .ssl_ctx = ssl_ctx,
+        .nocrc = true,
+      });
+
+  if ( !channel ) {
+    printf("%-6s %10s\n", name, "n/a");
+    return;
+  }
+
+  if ( bench_latency(channel, &p50, &p99, &rps) && bench_throughput(channel, &mbps) ) {
+    printf("%-6s %10.1f %10.1f %10.0f %10.1f\n", name, p50, p99, rps, mbps);
+  }
+
+  corpc_channel_close(&channel);
+}
+
+static void client_main(void * arg)
+{
+  (void) (arg);
+
+  printf("call size %zu bytes, stream message size %zu bytes\n", call_size, stream_msg_size);
+  printf("%-6s %10s %10s %10s %10s\n", "", "p50 us", "p99 us", "calls/s", "MiB/s");
+
+  run_bench("tcp", "127.0.0.1", BENCH_TCP_PORT, NULL);
+  if ( client_ssl_ctx ) {
+    run_bench("tls", "127.0.0.1", BENCH_TLS_PORT, client_ssl_ctx);
+  }
+  run_bench("unix", "unix:" BENCH_UNIX_PATH, 0, NULL);
+  run_bench("shm", "shm:" BENCH_SHM_PATH, 0, NULL);
+
+  set_event(&client_main_finished);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char *argv[])
+{
+  const char * cert = NULL, * key = NULL;
+
+  for ( int i = 1; i < argc; ++i ) {
+    if ( strcmp(argv[i], "-cert") == 0 && i + 1 < argc ) {
+      cert = argv[++i];
+    }
+    else if ( strcmp(argv[i], "-key") == 0 && i + 1 < argc ) {
+      key = argv[++i];
+    }
+    else if ( strcmp(argv[i], "-n") == 0 && i + 1 < argc ) {
+      nb_calls = atoi(argv[++i]);
+    }
+    else if ( strcmp(argv[i], "-size") == 0 && i + 1 < argc ) {
+      call_size = strtoul(argv[++i], NULL, 0);
+    }
+    else if ( strcmp(argv[i], "-mb") == 0 && i + 1 < argc ) {
+      stream_bytes = strtoull(argv[++i], NULL, 0) * 1024 * 1024;
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-cert server.crt -key server.key] [-n calls] [-size bytes] [-mb MiB]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ( nb_calls < 1 || stream_bytes < stream_msg_size ) {
+    fprintf(stderr, "Invalid arguments\n");
+    return 1;
+  }
+
+  cf_set_logfilename("stderr");
+  cf_set_loglevel(CF_LOG_ERROR);
+
+  if ( !cf_ssl_initialize() ) {
+    CF_FATAL("cf_ssl_initialize() fails");
+    return 1;
+  }
+
+  if ( cert && key ) {
+
+    server_ssl_ctx = cf_ssl_create_context(&(struct cf_ssl_create_context_args ) {
+          .enabled_ciphers = "ALL",
+          .keycert_file_pairs = (struct cf_keycert_pem_file_pair[] ) {
+                { .cert = cert, .key = key } },
+          .nb_keycert_file_pairs = 1,
+        });
+
+    client_ssl_ctx = cf_ssl_create_context(&(struct cf_ssl_create_context_args ) {
+          .enabled_ciphers = "ALL",
+        });
+
+    if ( !server_ssl_ctx || !client_ssl_ctx ) {
+      CF_FATAL("cf_ssl_create_context() fails");
+      return 1;
+    }
+  }
+
+  if ( !co_scheduler_init(2) ) {
+    CF_FATAL("co_scheduler_init() fails");
+    return 1;
+  }
+
+  if ( !start_server() ) {
+    return 1;
+  }
+
+  if ( !co_schedule(client_main, NULL, 1024 * 1024) ) {
+    CF_FATAL("co_schedule(client_main) fails: %s", strerror(errno));
+    return 1;
+  }
+
+  wait_event(&client_main_finished, 1);
+  unlink(BENCH_UNIX_PATH);
+  unlink(BENCH_SHM_PATH);
+
+  return 0;
+}
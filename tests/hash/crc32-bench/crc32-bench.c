@@ -0,0 +1,133 @@
+/*
+ * crc32-bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Verify cf_crc32_update() implementations against the byte-at-a-time table
+ *  and report their throughput for several buffer sizes
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuttle/time.h>
+#include <cuttle/hash/crc32.h>
+
+
+static const enum cf_crc32_impl impls[] = {
+  cf_crc32_impl_table,
+  cf_crc32_impl_slice8,
+  cf_crc32_impl_sse42,
+  cf_crc32_impl_armv8,
+};
+
+static const size_t sizes[] = {
+  16, 64, 1024, 64 * 1024, 1024 * 1024
+};
+
+
+static uint32_t crc_of(const uint8_t * buf, size_t offset, size_t size)
+{
+  return cf_crc32_finalize(cf_crc32_update(cf_crc32_begin(), buf + offset, size));
+}
+
+static int verify(const uint8_t * buf, size_t bufsize)
+{
+  static const size_t lengths[] = { 0, 1, 7, 8, 9, 255, 256, 257, 768, 769, 8192, 3 * 8192, 3 * 8192 + 13, 100000 };
+  uint32_t expected, actual;
+  int errors = 0;
+
+  for ( size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); ++l ) {
+    for ( size_t offset = 0; offset < 8; ++offset ) {
+
+      if ( offset + lengths[l] > bufsize ) {
+        continue;
+      }
+
+      cf_crc32_set_impl(cf_crc32_impl_table);
+      expected = crc_of(buf, offset, lengths[l]);
+
+      for ( size_t i = 1; i < sizeof(impls) / sizeof(impls[0]); ++i ) {
+        if ( cf_crc32_set_impl(impls[i]) && (actual = crc_of(buf, offset, lengths[l])) != expected ) {
+          fprintf(stderr, "MISMATCH %s: length=%zu offset=%zu crc=%08X expected=%08X\n",
+              cf_crc32_impl_name(impls[i]), lengths[l], offset, actual, expected);
+          ++errors;
+        }
+      }
+    }
+  }
+
+  return errors;
+}
+
+
+int main(int argc, char *argv[])
+{
+  const size_t bufsize = 4 * 1024 * 1024;
+  size_t total = 256 * 1024 * 1024;
+  uint8_t * buf;
+  volatile uint32_t sink = 0;
+  int errors;
+
+  if ( argc > 1 && (total = strtoull(argv[1], NULL, 0) * 1024 * 1024) == 0 ) {
+    fprintf(stderr, "Usage: %s [MiB per measurement]\n", argv[0]);
+    return 1;
+  }
+
+  if ( !(buf = malloc(bufsize)) ) {
+    perror("malloc()");
+    return 1;
+  }
+
+  srand(1);
+  for ( size_t i = 0; i < bufsize; ++i ) {
+    buf[i] = rand();
+  }
+
+  if ( (errors = verify(buf, bufsize)) ) {
+    fprintf(stderr, "%d errors\n", errors);
+    return 1;
+  }
+
+  cf_crc32_set_impl(cf_crc32_impl_auto);
+  printf("auto: %s\n", cf_crc32_impl_name(cf_crc32_get_impl()));
+  printf("%-8s %10s %10s\n", "impl", "size", "GB/s");
+
+  for ( size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i ) {
+
+    if ( !cf_crc32_set_impl(impls[i]) ) {
+      printf("%-8s %10s %10s\n", cf_crc32_impl_name(impls[i]), "-", "n/a");
+      continue;
+    }
+
+    for ( size_t j = 0; j < sizeof(sizes) / sizeof(sizes[0]); ++j ) {
+
+      const size_t size = sizes[j];
+      const size_t count = total / size;
+      size_t offset = 0;
+      int64_t t0, t1;
+      uint32_t crc = cf_crc32_begin();
+
+      t0 = cf_get_monotic_us();
+      for ( size_t k = 0; k < count; ++k ) {
+        crc = cf_crc32_update(crc, buf + offset, size);
+        if ( (offset += size) + size > bufsize ) {
+          offset = 0;
+        }
+      }
+      t1 = cf_get_monotic_us();
+      sink ^= crc;
+
+      printf("%-8s %10zu %10.2f\n", cf_crc32_impl_name(impls[i]), size,
+          (double) count * size / (t1 > t0 ? t1 - t0 : 1) / 1000.0);
+    }
+  }
+
+  (void)(sink);
+  free(buf);
+
+  return 0;
+}
@@ -0,0 +1,535 @@
+/*
+ * pb-bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  Measure cf_pb_get_encoded_size(), table driven cf_pb_pack() / cf_pb_unpack()
+ *  and the specialized functions generated with --c_opt=codegen on flat and nested messages.
+ *  The arena columns decode with cf_pb_unpack_arena() / cf_pb_unpack_arena_<type>() and
+ *  release each message with single cf_arena_reset(). The views columns decode with
+ *  cf_pb_unpack_views() / cf_pb_unpack_views_<type>(), which consume the input, so they
+ *  include memcpy() of the input into scratch buffer. The reuse columns decode with
+ *  cf_pb_unpack_reuse() / cf_pb_unpack_reuse_<type>() into the same message emptied with
+ *  cf_pb_reset() / cf_pb_reset_<type>(), which keeps its heap memory.
+ *
+ *  Usage: pb-bench [-n iterations] [-depth levels] [-fanout children]
+ *    The flat case is a single bench_record, the chain has one child per level,
+ *    the tree has -fanout children per level up to -depth (keep fanout^depth sane)
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuttle/debug.h>
+#include <cuttle/time.h>
+#include "pb-bench.pb.h"
+
+
+static int nb_iterations = 20000;
+static int max_depth = 32;
+static int fanout = 3;
+static int tree_depth = 6;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static void init_record(struct bench_record * r, int id)
+{
+  static const char payload[256] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+  memset(r, 0, sizeof(*r));
+
+  r->id = id;
+  r->timestamp = cf_get_realtime_ms() * 1000 + id;
+  r->value = id * 3.14159;
+
+  r->has_name = true;
+  r->name = strdup("bench_record.name");
+
+  r->has_payload = true;
+  r->payload.size = sizeof(payload);
+  r->payload.data = malloc(sizeof(payload));
+  memcpy(r->payload.data, payload, sizeof(payload));
+
+  ccarray_init(&r->samples, 32, sizeof(int32_t));
+  for ( int32_t i = 0; i < 32; ++i ) {
+    int32_t v = (i - 16) * (id + 1) * 1021;
+    ccarray_push_back(&r->samples, &v);
+  }
+
+  ccarray_init(&r->weights, 8, sizeof(double));
+  for ( int i = 0; i < 8; ++i ) {
+    double w = i / 8.0;
+    ccarray_push_back(&r->weights, &w);
+  }
+
+  r->has_flag = true;
+  r->flag = id & 1;
+}
+
+static void cleanup_record(struct bench_record * r)
+{
+  free(r->name);
+  free(r->payload.data);
+  ccarray_cleanup(&r->samples);
+  ccarray_cleanup(&r->weights);
+}
+
+static void init_tree(struct bench_tree * t, int depth, int nchilds, int * id)
+{
+  memset(t, 0, sizeof(*t));
+
+  init_record(&t->record, (*id)++);
+  ccarray_init(&t->children, nchilds ? nchilds : 1, sizeof(struct bench_tree));
+
+  if ( depth > 0 ) {
+    for ( int i = 0; i < nchilds; ++i ) {
+      init_tree(ccarray_peek_end(&t->children), depth - 1, nchilds, id);
+      ++t->children.size;
+    }
+  }
+}
+
+static void cleanup_tree(struct bench_tree * t)
+{
+  for ( size_t i = 0, n = ccarray_size(&t->children); i < n; ++i ) {
+    cleanup_tree(ccarray_peek(&t->children, i));
+  }
+  ccarray_cleanup(&t->children);
+  cleanup_record(&t->record);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+struct codec {
+  size_t (*pack)(const void * msg, void ** buf);
+  bool (*unpack)(void * msg, const void * buf, size_t size);
+  bool (*unpack_reuse)(void * msg, const void * buf, size_t size);
+  bool (*unpack_arena)(void * msg, const void * buf, size_t size, cf_arena * arena);
+  bool (*unpack_views)(void * msg, void * buf, size_t size, cf_arena * arena);
+  void (*reset)(void * msg);
+  void (*cleanup)(void * msg);
+};
+
+static double pack_time(const struct codec * codec, const void * msg, void ** buf, size_t * size)
+{
+  int64_t t0, t1;
+
+  t0 = cf_get_monotic_us();
+
+  for ( int i = 0; i < nb_iterations; ++i ) {
+    free(*buf);
+    if ( !(*size = codec->pack(msg, buf)) ) {
+      return -1;
+    }
+  }
+
+  t1 = cf_get_monotic_us();
+
+  return (double) (t1 - t0) / nb_iterations;
+}
+
+static double unpack_time(const struct codec * codec, const void * buf, size_t size,
+    void (*cleanup)(void * msg), size_t msg_size)
+{
+  int64_t t0, t1;
+  void * dst;
+  bool fok = true;
+
+  if ( !(dst = calloc(1, msg_size)) ) {
+    return -1;
+  }
+
+  t0 = cf_get_monotic_us();
+
+  for ( int i = 0; i < nb_iterations && fok; ++i ) {
+    fok = codec->unpack(dst, buf, size);
+    cleanup(dst);
+    memset(dst, 0, msg_size);
+  }
+
+  t1 = cf_get_monotic_us();
+
+  free(dst);
+
+  return fok ? (double) (t1 - t0) / nb_iterations : -1;
+}
+
+static double unpack_arena_time(const struct codec * codec, const void * buf, size_t size, size_t msg_size,
+    bool views)
+{
+  int64_t t0, t1;
+  cf_arena * arena = NULL;
+  void * dst = NULL, * scratch = NULL;
+  bool fok = false;
+
+  if ( !(dst = calloc(1, msg_size)) || !(scratch = malloc(size)) || !(arena = cf_arena_create(0)) ) {
+    goto end;
+  }
+
+  fok = true;
+
+  t0 = cf_get_monotic_us();
+
+  for ( int i = 0; i < nb_iterations && fok; ++i ) {
+    if ( !views ) {
+      fok = codec->unpack_arena(dst, buf, size, arena);
+    }
+    else {
+      memcpy(scratch, buf, size);
+      fok = codec->unpack_views(dst, scratch, size, arena);
+    }
+    cf_arena_reset(arena);
+    memset(dst, 0, msg_size);
+  }
+
+  t1 = cf_get_monotic_us();
+
+end:
+
+  cf_arena_destroy(&arena);
+  free(scratch);
+  free(dst);
+
+  return fok ? (double) (t1 - t0) / nb_iterations : -1;
+}
+
+static double unpack_reuse_time(const struct codec * codec, const void * buf, size_t size, size_t msg_size)
+{
+  int64_t t0, t1;
+  void * dst;
+  bool fok = true;
+
+  if ( !(dst = calloc(1, msg_size)) ) {
+    return -1;
+  }
+
+  t0 = cf_get_monotic_us();
+
+  for ( int i = 0; i < nb_iterations && fok; ++i ) {
+    fok = codec->unpack_reuse(dst, buf, size);
+    codec->reset(dst);
+  }
+
+  t1 = cf_get_monotic_us();
+
+  codec->cleanup(dst);
+  free(dst);
+
+  return fok ? (double) (t1 - t0) / nb_iterations : -1;
+}
+
+static void run(const char * name, const void * msg, const cf_pb_field_t fields[],
+    const struct codec * table, const struct codec * codegen,
+    void (*cleanup)(void * msg), size_t msg_size)
+{
+  int64_t t0, t1;
+  size_t size = 0, tsize = 0, csize = 0;
+  void * tbuf = NULL, * cbuf = NULL;
+  double tpack, tunpack, tarena, tviews, treuse, cpack, cunpack, carena, cviews, creuse;
+
+  t0 = cf_get_monotic_us();
+
+  for ( int i = 0; i < nb_iterations; ++i ) {
+    if ( !cf_pb_get_encoded_size(&size, fields, msg) ) {
+      CF_FATAL("%s: cf_pb_get_encoded_size() fails", name);
+      goto end;
+    }
+  }
+
+  t1 = cf_get_monotic_us();
+
+  if ( (tpack = pack_time(table, msg, &tbuf, &tsize)) < 0 ) {
+    CF_FATAL("%s: cf_pb_pack() fails", name);
+    goto end;
+  }
+
+  if ( (cpack = pack_time(codegen, msg, &cbuf, &csize)) < 0 ) {
+    CF_FATAL("%s: generated pack fails", name);
+    goto end;
+  }
+
+  if ( tsize != csize || memcmp(tbuf, cbuf, tsize) != 0 ) {
+    CF_FATAL("%s: generated encoding differs from cf_pb_pack()", name);
+    goto end;
+  }
+
+  if ( (tunpack = unpack_time(table, tbuf, tsize, cleanup, msg_size)) < 0 ) {
+    CF_FATAL("%s: cf_pb_unpack() fails", name);
+    goto end;
+  }
+
+  if ( (tarena = unpack_arena_time(table, tbuf, tsize, msg_size, false)) < 0 ) {
+    CF_FATAL("%s: cf_pb_unpack_arena() fails", name);
+    goto end;
+  }
+
+  if ( (tviews = unpack_arena_time(table, tbuf, tsize, msg_size, true)) < 0 ) {
+    CF_FATAL("%s: cf_pb_unpack_views() fails", name);
+    goto end;
+  }
+
+  if ( (treuse = unpack_reuse_time(table, tbuf, tsize, msg_size)) < 0 ) {
+    CF_FATAL("%s: cf_pb_unpack() into reset message fails", name);
+    goto end;
+  }
+
+  if ( (cunpack = unpack_time(codegen, cbuf, csize, cleanup, msg_size)) < 0 ) {
+    CF_FATAL("%s: generated unpack fails", name);
+    goto end;
+  }
+
+  if ( (carena = unpack_arena_time(codegen, cbuf, csize, msg_size, false)) < 0 ) {
+    CF_FATAL("%s: generated arena unpack fails", name);
+    goto end;
+  }
+
+  if ( (cviews = unpack_arena_time(codegen, cbuf, csize, msg_size, true)) < 0 ) {
+    CF_FATAL("%s: generated views unpack fails", name);
+    goto end;
+  }
+
+  if ( (creuse = unpack_reuse_time(codegen, cbuf, csize, msg_size)) < 0 ) {
+    CF_FATAL("%s: generated unpack into reset message fails", name);
+    goto end;
+  }
+
+  printf("%-8s %10zu %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f %10.3f\n", name, tsize,
+      (double) (t1 - t0) / nb_iterations, tpack, tunpack, tarena, tviews, treuse, cpack, cunpack, carena, cviews,
+      creuse);
+
+end:
+
+  free(tbuf);
+  free(cbuf);
+}
+
+static void cleanup_record_msg(void * msg)
+{
+  cleanup_record(msg);
+}
+
+static void cleanup_tree_msg(void * msg)
+{
+  cleanup_tree(msg);
+}
+
+static size_t table_pack_record(const void * msg, void ** buf)
+{
+  return cf_pb_pack(msg, bench_record_fields, buf);
+}
+
+static bool table_unpack_record(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack(buf, size, bench_record_fields, msg);
+}
+
+static bool table_unpack_reuse_record(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack_reuse(buf, size, bench_record_fields, msg);
+}
+
+static bool table_unpack_arena_record(void * msg, const void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_arena(buf, size, bench_record_fields, msg, arena);
+}
+
+static bool table_unpack_views_record(void * msg, void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_views(buf, size, bench_record_fields, msg, arena);
+}
+
+static void table_reset_record(void * msg)
+{
+  cf_pb_reset(bench_record_fields, msg);
+}
+
+static void table_cleanup_record(void * msg)
+{
+  cf_pb_cleanup(bench_record_fields, msg);
+}
+
+static size_t table_pack_tree(const void * msg, void ** buf)
+{
+  return cf_pb_pack(msg, bench_tree_fields, buf);
+}
+
+static bool table_unpack_tree(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack(buf, size, bench_tree_fields, msg);
+}
+
+static bool table_unpack_reuse_tree(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack_reuse(buf, size, bench_tree_fields, msg);
+}
+
+static bool table_unpack_arena_tree(void * msg, const void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_arena(buf, size, bench_tree_fields, msg, arena);
+}
+
+static bool table_unpack_views_tree(void * msg, void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_views(buf, size, bench_tree_fields, msg, arena);
+}
+
+static void table_reset_tree(void * msg)
+{
+  cf_pb_reset(bench_tree_fields, msg);
+}
+
+static void table_cleanup_tree(void * msg)
+{
+  cf_pb_cleanup(bench_tree_fields, msg);
+}
+
+static size_t codegen_pack_record(const void * msg, void ** buf)
+{
+  return cf_pb_pack_bench_record(msg, buf);
+}
+
+static bool codegen_unpack_record(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack_bench_record(msg, buf, size);
+}
+
+static bool codegen_unpack_reuse_record(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack_reuse_bench_record(msg, buf, size);
+}
+
+static bool codegen_unpack_arena_record(void * msg, const void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_arena_bench_record(msg, buf, size, arena);
+}
+
+static bool codegen_unpack_views_record(void * msg, void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_views_bench_record(msg, buf, size, arena);
+}
+
+static void codegen_reset_record(void * msg)
+{
+  cf_pb_reset_bench_record(msg);
+}
+
+static void codegen_cleanup_record(void * msg)
+{
+  cf_pb_cleanup_bench_record(msg);
+}
+
+static size_t codegen_pack_tree(const void * msg, void ** buf)
+{
+  return cf_pb_pack_bench_tree(msg, buf);
+}
+
+static bool codegen_unpack_tree(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack_bench_tree(msg, buf, size);
+}
+
+static bool codegen_unpack_reuse_tree(void * msg, const void * buf, size_t size)
+{
+  return cf_pb_unpack_reuse_bench_tree(msg, buf, size);
+}
+
+static bool codegen_unpack_arena_tree(void * msg, const void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_arena_bench_tree(msg, buf, size, arena);
+}
+
+static bool codegen_unpack_views_tree(void * msg, void * buf, size_t size, cf_arena * arena)
+{
+  return cf_pb_unpack_views_bench_tree(msg, buf, size, arena);
+}
+
+static void codegen_reset_tree(void * msg)
+{
+  cf_pb_reset_bench_tree(msg);
+}
+
+static void codegen_cleanup_tree(void * msg)
+{
+  cf_pb_cleanup_bench_tree(msg);
+}
+
+static const struct codec table_record = {
+    table_pack_record, table_unpack_record, table_unpack_reuse_record,
+    table_unpack_arena_record, table_unpack_views_record,
+    table_reset_record, table_cleanup_record };
+static const struct codec table_tree = {
+    table_pack_tree, table_unpack_tree, table_unpack_reuse_tree,
+    table_unpack_arena_tree, table_unpack_views_tree,
+    table_reset_tree, table_cleanup_tree };
+static const struct codec codegen_record = {
+    codegen_pack_record, codegen_unpack_record, codegen_unpack_reuse_record,
+    codegen_unpack_arena_record, codegen_unpack_views_record,
+    codegen_reset_record, codegen_cleanup_record };
+static const struct codec codegen_tree = {
+    codegen_pack_tree, codegen_unpack_tree, codegen_unpack_reuse_tree,
+    codegen_unpack_arena_tree, codegen_unpack_views_tree,
+    codegen_reset_tree, codegen_cleanup_tree };
+
+
+int main(int argc, char *argv[])
+{
+  struct bench_record record;
+  struct bench_tree chain, tree;
+  char name[32];
+  int id;
+
+  for ( int i = 1; i < argc; ++i ) {
+    if ( strcmp(argv[i], "-n") == 0 && i + 1 < argc ) {
+      nb_iterations = atoi(argv[++i]);
+    }
+    else if ( strcmp(argv[i], "-depth") == 0 && i + 1 < argc ) {
+      max_depth = atoi(argv[++i]);
+    }
+    else if ( strcmp(argv[i], "-fanout") == 0 && i + 1 < argc ) {
+      fanout = atoi(argv[++i]);
+    }
+    else {
+      fprintf(stderr, "Usage: %s [-n iterations] [-depth levels] [-fanout children]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  if ( nb_iterations < 1 || max_depth < 0 || fanout < 1 ) {
+    fprintf(stderr, "Invalid arguments\n");
+    return 1;
+  }
+
+  cf_set_logfilename("stderr");
+  cf_set_loglevel(CF_LOG_ERROR);
+
+  printf("%d iterations\n", nb_iterations);
+  printf("%-8s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "", "bytes", "size us", "pack us",
+      "unpack us", "arena unpk", "views unpk", "reuse unpk", "gen pack", "gen unpk", "gen arena", "gen views",
+      "gen reuse");
+
+  init_record(&record, 0);
+  run("flat", &record, bench_record_fields, &table_record, &codegen_record,
+      cleanup_record_msg, sizeof(record));
+  cleanup_record(&record);
+
+  for ( int depth = 1; depth <= max_depth; depth *= 2 ) {
+    id = 0;
+    init_tree(&chain, depth, 1, &id);
+    snprintf(name, sizeof(name), "chain%d", depth);
+    run(name, &chain, bench_tree_fields, &table_tree, &codegen_tree,
+        cleanup_tree_msg, sizeof(chain));
+    cleanup_tree(&chain);
+  }
+
+  id = 0;
+  init_tree(&tree, tree_depth < max_depth ? tree_depth : max_depth, fanout, &id);
+  snprintf(name, sizeof(name), "tree%d", id);
+  run(name, &tree, bench_tree_fields, &table_tree, &codegen_tree,
+      cleanup_tree_msg, sizeof(tree));
+  cleanup_tree(&tree);
+
+  return 0;
+}
@@ -0,0 +1,688 @@
+/*
+ * pb-suite.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: agent
+ *
+ *  cuttle-pb benchmark suite on representative message shapes: small flat, deeply nested,
+ *  large packed arrays, string heavy and oneof heavy.
+ *
+ *  Each shape goes through cf_pb_get_encoded_size(), cf_pb_encode() and cf_pb_decode() on memory
+ *  streams, cf_pb_pack(), cf_pb_decode_reuse() into message emptied with cf_pb_reset(), cf_pb_decode_arena()
+ *  and the functions generated with --c_opt=codegen. The packed shape also measures bare nanopb
+ *  varint coding of its integer arrays as the floor for cf_pb_encode() / cf_pb_decode() there.
+ *  Built with 'make PROTOBUF_C=1' the suite adds protobuf_c_message_pack() / _unpack() of the
+ *  same encoding for comparison.
+ *
+ *  Each operation repeats in doubling batches until one batch takes at least -t milliseconds,
+ *  and reports messages per second, megabytes (10^6) of encoding per second and allocations
+ *  per message: the malloc() / calloc() / realloc() calls counted with ld --wrap, see Makefile.
+ *  The -csv output is for scripts comparing runs.
+ *
+ *  Usage: pb-suite [-t ms] [-csv] [-depth levels] [-count items] [shape ...]
+ *    shapes: small nested packed strings oneof, all by default
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cuttle/debug.h>
+#include <cuttle/time.h>
+#include "pb-suite.pb.h"
+
+#if HAVE_PROTOBUF_C
+# include "pb-suite.pb-c.h"
+#endif
+
+
+static int64_t min_time_us = 200 * 1000;
+static bool csv = false;
+static int nested_depth = 32;
+static int packed_count = 4096;
+static int strings_count = 64;
+static int variants_count = 256;
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Allocation counter, the Makefile links with -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc
+
+static size_t nb_allocs;
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t n, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+void * __wrap_malloc(size_t size)
+{
+  ++nb_allocs;
+  return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t n, size_t size)
+{
+  ++nb_allocs;
+  return __real_calloc(n, size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size)
+{
+  ++nb_allocs;
+  return __real_realloc(ptr, size);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+// Source messages. Arrays of strings and messages are filled up to their capacity,
+// so cf_pb_cleanup() can release the messages built here.
+
+static char * make_string(int id, size_t minlen, size_t maxlen)
+{
+  size_t len = minlen + (size_t) (id * 7919) % (maxlen - minlen + 1);
+  char * s = malloc(len + 1);
+
+  for ( size_t i = 0; i < len; ++i ) {
+    s[i] = 'a' + (id + i) % 26;
+  }
+  s[len] = 0;
+
+  return s;
+}
+
+static void init_small(struct suite_small * m, int id)
+{
+  memset(m, 0, sizeof(*m));
+
+  m->id = 1000 + id;
+  m->timestamp = 1700000000000000LL + id;
+  m->has_status = true;
+  m->status = id % 3 - 1;
+  m->has_value = true;
+  m->value = id * 2.718281828;
+  m->has_flag = true;
+  m->flag = id & 1;
+  m->has_crc = true;
+  m->crc = 0x9e3779b9u * (id + 1);
+  m->has_method = true;
+  m->method = strdup("suite.method");
+}
+
+static void init_nested(struct suite_nested * m, int depth)
+{
+  memset(m, 0, sizeof(*m));
+
+  m->level = depth;
+  m->has_label = true;
+  m->label = make_string(depth, 4, 16);
+
+  if ( depth > 0 ) {
+    ccarray_init(&m->next, 1, sizeof(struct suite_nested));
+    init_nested(ccarray_peek_end(&m->next), depth - 1);
+    ++m->next.size;
+  }
+}
+
+static void init_packed(struct suite_packed * m, int count)
+{
+  memset(m, 0, sizeof(*m));
+
+  ccarray_init(&m->int32s, count, sizeof(int32_t));
+  ccarray_init(&m->uint64s, count, sizeof(uint64_t));
+  ccarray_init(&m->fixed32s, count, sizeof(uint32_t));
+  ccarray_init(&m->doubles, count, sizeof(double));
+
+  for ( int i = 0; i < count; ++i ) {
+    int32_t i32 = (i & 1 ? -1 : 1) * (i * 37 % (1 << (i % 31)));
+    uint64_t u64 = (uint64_t) i * 0x9e3779b97f4a7c15ull >> (i % 64);
+    uint32_t u32 = 0x9e3779b9u * i;
+    double d = i / 3.0;
+
+    ccarray_push_back(&m->int32s, &i32);
+    ccarray_push_back(&m->uint64s, &u64);
+    ccarray_push_back(&m->fixed32s, &u32);
+    ccarray_push_back(&m->doubles, &d);
+  }
+}
+
+static void init_strings(struct suite_strings * m, int count)
+{
+  char * s;
+
+  memset(m, 0, sizeof(*m));
+
+  ccarray_init(&m->keys, count, sizeof(char *));
+  ccarray_init(&m->values, count, sizeof(char *));
+
+  for ( int i = 0; i < count; ++i ) {
+    s = make_string(i, 8, 24);
+    ccarray_push_back(&m->keys, &s);
+    s = make_string(count + i, 16, 128);
+    ccarray_push_back(&m->values, &s);
+  }
+
+  m->has_comment = true;
+  m->comment = make_string(0, 256, 256);
+
+  m->has_blob = true;
+  m->blob.size = 1024;
+  m->blob.data = make_string(1, 1024, 1024);
+}
+
+static void init_variants(struct suite_variants * m, int count)
+{
+  struct suite_variant * v;
+
+  memset(m, 0, sizeof(*m));
+
+  ccarray_init(&m->items, count, sizeof(struct suite_variant));
+
+  for ( int i = 0; i < count; ++i, ++m->items.size ) {
+
+    memset(v = ccarray_peek_end(&m->items), 0, sizeof(*v));
+
+    switch ( i % 4 ) {
+    case 0 :
+      v->value.tag = suite_variant_value_i;
+      v->value.i = -1000000007LL * i;
+      break;
+    case 1 :
+      v->value.tag = suite_variant_value_d;
+      v->value.d = i * 1.5;
+      break;
+    case 2 :
+      v->value.tag = suite_variant_value_s;
+      v->value.s = make_string(i, 4, 32);
+      break;
+    default :
+      v->value.tag = suite_variant_value_m;
+      init_small(&v->value.m, i);
+      break;
+    }
+  }
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+struct shape {
+  const char * name;
+  const cf_pb_field_t * fields;
+  size_t msg_size;
+  void (*init)(void * msg);
+  size_t (*gen_pack)(const void * msg, void ** buf);
+  bool (*gen_unpack)(void * msg, const void * buf, size_t size);
+  void (*gen_cleanup)(void * msg);
+#if HAVE_PROTOBUF_C
+  const ProtobufCMessageDescriptor * pbc;
+#endif
+};
+
+struct context {
+  const struct shape * shape;
+  void * msg;         // source message
+  void * buf;         // its encoding
+  size_t size;
+  void * dst;         // decoded message
+  void * out;         // encoder output, size bytes
+  cf_arena * arena;
+  void * varints;     // suite_packed integers as bare varints
+  size_t varints_size;
+#if HAVE_PROTOBUF_C
+  ProtobufCMessage * pbc_msg;
+#endif
+};
+
+static void report_header(void)
+{
+  if ( csv ) {
+    printf("shape,op,bytes,iterations,msgs_per_sec,mb_per_sec,allocs_per_msg\n");
+  }
+  else {
+    printf("%-8s %-12s %10s %12s %10s %10s\n", "shape", "op", "bytes", "msg/s", "MB/s", "allocs/msg");
+  }
+}
+
+static void report(const char * shape, const char * op, size_t size, int n, int64_t us, size_t allocs)
+{
+  double rate = n * 1e6 / (us > 0 ? us : 1);
+
+  if ( csv ) {
+    printf("%s,%s,%zu,%d,%.1f,%.3f,%.3f\n", shape, op, size, n, rate, rate * size / 1e6,
+        (double) allocs / n);
+  }
+  else {
+    printf("%-8s %-12s %10zu %12.1f %10.3f %10.3f\n", shape, op, size, rate, rate * size / 1e6,
+        (double) allocs / n);
+  }
+}
+
+static bool measure(struct context * ctx, const char * op, size_t size, bool (*func)(struct context * ctx))
+{
+  int64_t t0, t1;
+  size_t allocs;
+  int n;
+
+  for ( n = 1;; n *= 2 ) {
+
+    allocs = nb_allocs;
+    t0 = cf_get_monotic_us();
+
+    for ( int i = 0; i < n; ++i ) {
+      if ( !func(ctx) ) {
+        CF_FATAL("%s: %s fails", ctx->shape->name, op);
+        return false;
+      }
+    }
+
+    t1 = cf_get_monotic_us();
+    allocs = nb_allocs - allocs;
+
+    if ( t1 - t0 >= min_time_us || n >= (1 << 30) ) {
+      break;
+    }
+  }
+
+  report(ctx->shape->name, op, size, n, t1 - t0, allocs);
+
+  return true;
+}
+
+static bool op_size(struct context * ctx)
+{
+  size_t size;
+  return cf_pb_get_encoded_size(&size, ctx->shape->fields, ctx->msg) && size == ctx->size;
+}
+
+static bool op_encode(struct context * ctx)
+{
+  pb_ostream_t ostream = pb_ostream_from_buffer(ctx->out, ctx->size);
+  return cf_pb_encode(&ostream, ctx->shape->fields, ctx->msg);
+}
+
+static bool op_pack(struct context * ctx)
+{
+  void * buf = NULL;
+  size_t size = cf_pb_pack(ctx->msg, ctx->shape->fields, &buf);
+  free(buf);
+  return size == ctx->size;
+}
+
+static bool op_decode(struct context * ctx)
+{
+  pb_istream_t istream = pb_istream_from_buffer(ctx->buf, ctx->size);
+  bool fok = cf_pb_decode(&istream, ctx->shape->fields, ctx->dst);
+  cf_pb_cleanup(ctx->shape->fields, ctx->dst);
+  return fok;
+}
+
+static bool op_decode_reuse(struct context * ctx)
+{
+  pb_istream_t istream = pb_istream_from_buffer(ctx->buf, ctx->size);
+  bool fok = cf_pb_decode_reuse(&istream, ctx->shape->fields, ctx->dst);
+  cf_pb_reset(ctx->shape->fields, ctx->dst);
+  return fok;
+}
+
+static bool op_decode_arena(struct context * ctx)
+{
+  pb_istream_t istream = pb_istream_from_buffer(ctx->buf, ctx->size);
+  bool fok = cf_pb_decode_arena(&istream, ctx->shape->fields, ctx->dst, ctx->arena);
+  cf_arena_reset(ctx->arena);
+  memset(ctx->dst, 0, ctx->shape->msg_size);
+  return fok;
+}
+
+static bool op_gen_pack(struct context * ctx)
+{
+  void * buf = NULL;
+  size_t size = ctx->shape->gen_pack(ctx->msg, &buf);
+  free(buf);
+  return size == ctx->size;
+}
+
+static bool op_gen_unpack(struct context * ctx)
+{
+  bool fok = ctx->shape->gen_unpack(ctx->dst, ctx->buf, ctx->size);
+  ctx->shape->gen_cleanup(ctx->dst);
+  return fok;
+}
+
+/* bare nanopb varint coding of suite_packed integer arrays */
+static bool encode_varints(pb_ostream_t * ostream, const struct suite_packed * m)
+{
+  for ( size_t i = 0, n = ccarray_size(&m->int32s); i < n; ++i ) {
+    if ( !pb_encode_svarint(ostream, *(int32_t *) ccarray_peek(&m->int32s, i)) ) {
+      return false;
+    }
+  }
+
+  for ( size_t i = 0, n = ccarray_size(&m->uint64s); i < n; ++i ) {
+    if ( !pb_encode_varint(ostream, *(uint64_t *) ccarray_peek(&m->uint64s, i)) ) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+static bool op_varint_encode(struct context * ctx)
+{
+  pb_ostream_t ostream = pb_ostream_from_buffer(ctx->out, ctx->varints_size);
+  return encode_varints(&ostream, ctx->msg);
+}
+
+static bool op_varint_decode(struct context * ctx)
+{
+  const struct suite_packed * m = ctx->msg;
+  pb_istream_t istream = pb_istream_from_buffer(ctx->varints, ctx->varints_size);
+  int64_t svalue;
+  uint64_t value;
+
+  for ( size_t n = ccarray_size(&m->int32s); n > 0; --n ) {
+    if ( !pb_decode_svarint(&istream, &svalue) ) {
+      return false;
+    }
+  }
+
+  for ( size_t n = ccarray_size(&m->uint64s); n > 0; --n ) {
+    if ( !pb_decode_varint(&istream, &value) ) {
+      return false;
+    }
+  }
+
+  return istream.bytes_left == 0;
+}
+
+#if HAVE_PROTOBUF_C
+
+/* protobuf-c allocations go through the wrapped malloc() to be counted the same way */
+static void * pbc_alloc(void * allocator_data, size_t size)
+{
+  (void) allocator_data;
+  return malloc(size);
+}
+
+static void pbc_free(void * allocator_data, void * ptr)
+{
+  (void) allocator_data;
+  free(ptr);
+}
+
+static ProtobufCAllocator pbc_allocator = {
+  .alloc = pbc_alloc,
+  .free = pbc_free,
+  .allocator_data = NULL,
+};
+
+static bool op_pbc_pack(struct context * ctx)
+{
+  return protobuf_c_message_get_packed_size(ctx->pbc_msg) == ctx->size
+      && protobuf_c_message_pack(ctx->pbc_msg, ctx->out) == ctx->size;
+}
+
+static bool op_pbc_unpack(struct context * ctx)
+{
+  ProtobufCMessage * msg = protobuf_c_message_unpack(ctx->shape->pbc, &pbc_allocator, ctx->size, ctx->buf);
+  if ( !msg ) {
+    return false;
+  }
+  protobuf_c_message_free_unpacked(msg, &pbc_allocator);
+  return true;
+}
+
+#endif
+
+static void run(const struct shape * shape)
+{
+  struct context ctx;
+  void * buf = NULL;
+  size_t size;
+
+  memset(&ctx, 0, sizeof(ctx));
+  ctx.shape = shape;
+
+  if ( !(ctx.msg = calloc(1, shape->msg_size)) || !(ctx.dst = calloc(1, shape->msg_size))
+      || !(ctx.arena = cf_arena_create(0)) ) {
+    CF_FATAL("%s: memory allocation fails", shape->name);
+    goto end;
+  }
+
+  shape->init(ctx.msg);
+
+  if ( !(ctx.size = cf_pb_pack(ctx.msg, shape->fields, &ctx.buf)) || !(ctx.out = malloc(ctx.size)) ) {
+    CF_FATAL("%s: cf_pb_pack() fails", shape->name);
+    goto end;
+  }
+
+  /* all paths must agree on the encoding before they are timed */
+  if ( (size = shape->gen_pack(ctx.msg, &buf)) != ctx.size || memcmp(buf, ctx.buf, size) != 0 ) {
+    CF_FATAL("%s: generated encoding differs from cf_pb_pack()", shape->name);
+    goto end;
+  }
+
+  free(buf), buf = NULL;
+
+  if ( !cf_pb_unpack(ctx.buf, ctx.size, shape->fields, ctx.dst)
+      || (size = cf_pb_pack(ctx.dst, shape->fields, &buf)) != ctx.size || memcmp(buf, ctx.buf, size) != 0 ) {
+    CF_FATAL("%s: decoded message encodes differently", shape->name);
+    goto end;
+  }
+
+  cf_pb_cleanup(shape->fields, ctx.dst);
+
+  if ( !measure(&ctx, "size", ctx.size, op_size) ) {
+    goto end;
+  }
+
+  if ( !measure(&ctx, "encode", ctx.size, op_encode) ) {
+    goto end;
+  }
+
+  if ( !measure(&ctx, "pack", ctx.size, op_pack) ) {
+    goto end;
+  }
+
+  if ( !measure(&ctx, "decode", ctx.size, op_decode) ) {
+    goto end;
+  }
+
+  if ( !measure(&ctx, "decode-reuse", ctx.size, op_decode_reuse) ) {
+    goto end;
+  }
+
+  cf_pb_cleanup(shape->fields, ctx.dst);
+
+  if ( !measure(&ctx, "decode-arena", ctx.size, op_decode_arena) ) {
+    goto end;
+  }
+
+  if ( !measure(&ctx, "gen-pack", ctx.size, op_gen_pack) ) {
+    goto end;
+  }
+
+  if ( !measure(&ctx, "gen-unpack", ctx.size, op_gen_unpack) ) {
+    goto end;
+  }
+
+  if ( shape->fields == suite_packed_fields ) {
+
+    pb_ostream_t ostream = pb_ostream_from_buffer(ctx.out, ctx.size);
+
+    if ( !encode_varints(&ostream, ctx.msg) || !(ctx.varints = malloc(ostream.bytes_written)) ) {
+      CF_FATAL("%s: pb_encode_varint() fails", shape->name);
+      goto end;
+    }
+
+    memcpy(ctx.varints, ctx.out, ctx.varints_size = ostream.bytes_written);
+
+    if ( !measure(&ctx, "varint-enc", ctx.varints_size, op_varint_encode) ) {
+      goto end;
+    }
+
+    if ( !measure(&ctx, "varint-dec", ctx.varints_size, op_varint_decode) ) {
+      goto end;
+    }
+  }
+
+#if HAVE_PROTOBUF_C
+  if ( !(ctx.pbc_msg = protobuf_c_message_unpack(shape->pbc, &pbc_allocator, ctx.size, ctx.buf)) ) {
+    CF_FATAL("%s: protobuf_c_message_unpack() fails", shape->name);
+    goto end;
+  }
+
+  if ( protobuf_c_message_get_packed_size(ctx.pbc_msg) != ctx.size
+      || protobuf_c_message_pack(ctx.pbc_msg, ctx.out) != ctx.size || memcmp(ctx.out, ctx.buf, ctx.size) != 0 ) {
+    CF_ERROR("%s: protobuf-c encoding differs, pbc-pack skipped", shape->name);
+  }
+  else if ( !measure(&ctx, "pbc-pack", ctx.size, op_pbc_pack) ) {
+    goto end;
+  }
+
+  if ( !measure(&ctx, "pbc-unpack", ctx.size, op_pbc_unpack) ) {
+    goto end;
+  }
+#endif
+
+end:
+
+#if HAVE_PROTOBUF_C
+  if ( ctx.pbc_msg ) {
+    protobuf_c_message_free_unpacked(ctx.pbc_msg, &pbc_allocator);
+  }
+#endif
+
+  if ( ctx.msg ) {
+    cf_pb_cleanup(shape->fields, ctx.msg);
+    free(ctx.msg);
+  }
+
+  if ( ctx.dst ) {
+    cf_pb_cleanup(shape->fields, ctx.dst);
+    free(ctx.dst);
+  }
+
+  cf_arena_destroy(&ctx.arena);
+  free(ctx.varints);
+  free(ctx.out);
+  free(ctx.buf);
+  free(buf);
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////
+
+static void init_small_msg(void * msg)
+{
+  init_small(msg, 0);
+}
+
+static void init_nested_msg(void * msg)
+{
+  init_nested(msg, nested_depth);
+}
+
+static void init_packed_msg(void * msg)
+{
+  init_packed(msg, packed_count);
+}
+
+static void init_strings_msg(void * msg)
+{
+  init_strings(msg, strings_count);
+}
+
+static void init_variants_msg(void * msg)
+{
+  init_variants(msg, variants_count);
+}
+
+#define SUITE_CODEGEN(type) \
+  static size_t gen_pack_##type(const void * msg, void ** buf) \
+  { \
+    return cf_pb_pack_##type(msg, buf); \
+  } \
+  static bool gen_unpack_##type(void * msg, const void * buf, size_t size) \
+  { \
+    return cf_pb_unpack_##type(msg, buf, size); \
+  } \
+  static void gen_cleanup_##type(void * msg) \
+  { \
+    cf_pb_cleanup_##type(msg); \
+  }
+
+SUITE_CODEGEN(suite_small)
+SUITE_CODEGEN(suite_nested)
+SUITE_CODEGEN(suite_packed)
+SUITE_CODEGEN(suite_strings)
+SUITE_CODEGEN(suite_variants)
+
+#if HAVE_PROTOBUF_C
+# define SUITE_PBC(type)  , &type##__descriptor
+#else
+# define SUITE_PBC(type)
+#endif
+
+#define SUITE_SHAPE(name, type, init) \
+  { name, type##_fields, sizeof(struct type), init, \
+    gen_pack_##type, gen_unpack_##type, gen_cleanup_##type SUITE_PBC(type) }
+
+static const struct shape shapes[] = {
+  SUITE_SHAPE("small", suite_small, init_small_msg),
+  SUITE_SHAPE("nested", suite_nested, init_nested_msg),
+  SUITE_SHAPE("packed", suite_packed, init_packed_msg),
+  SUITE_SHAPE("strings", suite_strings, init_strings_msg),
+  SUITE_SHAPE("oneof", suite_variants, init_variants_msg),
+};
+
+static const int nb_shapes = sizeof(shapes) / sizeof(shapes[0]);
+
+
+int main(int argc, char *argv[])
+{
+  bool selected[sizeof(shapes) / sizeof(shapes[0])] = { false };
+  bool all = true;
+  int j;
+
+  for ( int i = 1; i < argc; ++i ) {
+    if ( strcmp(argv[i], "-t") == 0 && i + 1 < argc ) {
+      min_time_us = atoi(argv[++i]) * 1000LL;
+    }
+    else if ( strcmp(argv[i], "-csv") == 0 ) {
+      csv = true;
+    }
+    else if ( strcmp(argv[i], "-depth") == 0 && i + 1 < argc ) {
+      nested_depth = atoi(argv[++i]);
+    }
+    else if ( strcmp(argv[i], "-count") == 0 && i + 1 < argc ) {
+      packed_count = atoi(argv[++i]);
+    }
+    else {
+      for ( j = 0; j < nb_shapes; ++j ) {
+        if ( strcmp(argv[i], shapes[j].name) == 0 ) {
+          selected[j] = true, all = false;
+          break;
+        }
+      }
+      if ( j == nb_shapes ) {
+        fprintf(stderr, "Usage: %s [-t ms] [-csv] [-depth levels] [-count items] [shape ...]\n"
+            "  shapes: small nested packed strings oneof\n", argv[0]);
+        return 1;
+      }
+    }
+  }
+
+  if ( min_time_us < 1 || nested_depth < 0 || packed_count < 1 ) {
+    fprintf(stderr, "Invalid arguments\n");
+    return 1;
+  }
+
+  cf_set_logfilename("stderr");
+  cf_set_loglevel(CF_LOG_ERROR);
+
+  report_header();
+
+  for ( j = 0; j < nb_shapes; ++j ) {
+    if ( all || selected[j] ) {
+      run(&shapes[j]);
+    }
+  }
+
+  return 0;
+}